@@ -0,0 +1,262 @@
+/* port/c55x/emu/bench.c -- throughput benchmark on the emulator */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Runs the port and the core against the emulated host: enumerates, then 
+streams bulk OUT and bulk IN data through the pool and times control 
+reads.  Bus time is the emulator's; CPU time is that spent in the ISR. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "usb.h"
+#include "emu.h"
+
+#define EP_SIZE 64
+
+static u32 block=4096, total=1<<20, nctl=1000;
+static u32 queued, done, errors;
+
+/* byte i of the stream */
+static u8 pattern(u32 i)
+{
+	return (u8)(i*7+(i>>9));
+}
+
+static void fill(usb_data_t *buf, u32 ofs, u32 len)
+{
+	u32 i;
+
+	for (i=0;i<len;i+=2)
+		buf[i>>1]=(pattern(ofs+i)<<8)|pattern(ofs+i+1);
+}
+
+static u32 check(const usb_data_t *buf, u32 ofs, u32 len)
+{
+	u32 i,bad=0;
+
+	for (i=0;i<len;++i)
+		if (((i&1)?buf[i>>1]&0xff:buf[i>>1]>>8)!=pattern(ofs+i))
+			++bad;
+	return bad;
+}
+
+/* ------ Control */
+
+int ctl_read(void)
+{
+	static usb_data_t buf[32];
+	u16 len=usb_setup.len>sizeof(buf)*2?sizeof(buf)*2:usb_setup.len;
+
+	fill(buf,0,len);
+	usb_ctl_read_end(len,buf);
+	return 0;
+}
+
+void usb_ctl(void)
+{
+	if (!usb_ctl_std())
+		usb_ctl_stall();
+}
+
+/* ------ Bulk */
+
+static void out_done(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	if (evt!=USB_EVT_READY) return;
+	if (len!=block) ++errors;
+	errors+=check(data,done,len);
+	done+=len;
+	if (queued<total) {
+		queued+=block;
+		if (usb_rx(ep,data,block)) ++errors;
+	}
+}
+
+static void in_done(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	if (evt!=USB_EVT_READY) return;
+	done+=len;
+	if (queued<total) {
+		fill(data,queued,block);
+		queued+=block;
+		if (usb_tx(ep,data,block)) ++errors;
+	}
+}
+
+/* queues the first requests, as many as the endpoint holds */
+static void start(usb_endpoint_t *ep, usb_evt_cb cb, int in)
+{
+	usb_data_t *buf;
+	int i;
+
+	queued=done=0;
+	usb_set_evt_cb(ep,cb);
+	for (i=0;i<2&&queued<total;++i) {
+		buf=usb_pool_alloc(&benchpool);
+		if (!buf) {
+			++errors;
+			return;
+		}
+		// the DMA may finish, and the callback run, before usb_tx() returns
+		queued+=block;
+		if (in) {
+			fill(buf,queued-block,block);
+			usb_tx(ep,buf,block);
+		} else
+			usb_rx(ep,buf,block);
+	}
+}
+
+static void report(const char *name, u32 bytes, emu_time_t ns)
+{
+	double ms=ns/1e6;
+
+	printf("%-8s %10lu %10.1f %8.3f %8lu %8lu %8.0f\n",name,
+		(unsigned long)bytes,ms,ms?bytes/ms/1000:0,
+		emu_stats.naks,emu_stats.irqs,
+		emu_stats.irqs?(double)emu_stats.isr_ns/emu_stats.irqs:0);
+}
+
+static u8 host[1<<16];
+
+static void bench_out(usb_endpoint_t *ep)
+{
+	emu_time_t t;
+	u32 ofs,n,i;
+	long r;
+
+	emu_clear_stats();
+	t=emu_now();
+	start(ep,out_done,0);
+	for (ofs=0;ofs<total;ofs+=n) {
+		n=total-ofs<sizeof(host)?total-ofs:sizeof(host);
+		for (i=0;i<n;++i)
+			host[i]=pattern(ofs+i);
+		r=emu_bulk_out(1,host,n,EP_SIZE);
+		if (r!=(long)n) {
+			printf("bulk out: %ld\n",r);
+			++errors;
+			return;
+		}
+	}
+	emu_wait(1000);
+	if (done!=total) ++errors;
+	report("out",done,emu_now()-t);
+	usb_cancel(ep);
+}
+
+static void bench_in(usb_endpoint_t *ep)
+{
+	emu_time_t t;
+	u32 ofs,n,i;
+	long r;
+
+	emu_clear_stats();
+	t=emu_now();
+	start(ep,in_done,1);
+	for (ofs=0;ofs<total;ofs+=n) {
+		n=total-ofs<sizeof(host)?total-ofs:sizeof(host);
+		r=emu_bulk_in(1,host,n,EP_SIZE);
+		if (r!=(long)n) {
+			printf("bulk in: %ld\n",r);
+			++errors;
+			return;
+		}
+		for (i=0;i<n;++i)
+			if (host[i]!=pattern(ofs+i))
+				++errors;
+	}
+	emu_wait(1000);
+	if (done!=total) ++errors;
+	report("in",total,emu_now()-t);
+}
+
+static void bench_ctl(void)
+{
+	u8 setup[8]={0xc0,0x01,0,0,0,0,EP_SIZE,0},buf[EP_SIZE];
+	emu_time_t t;
+	u32 k,i;
+	int r;
+
+	emu_clear_stats();
+	t=emu_now();
+	for (k=0;k<nctl;++k) {
+		r=emu_control(setup,buf);
+		if (r!=EP_SIZE) {
+			printf("control read: %d\n",r);
+			++errors;
+			return;
+		}
+		for (i=0;i<EP_SIZE;++i)
+			if (buf[i]!=pattern(i))
+				++errors;
+	}
+	report("control",nctl*EP_SIZE,emu_now()-t);
+}
+
+int main(int argc, char **argv)
+{
+	struct c55x_params p;
+	int c,r;
+
+	while ((c=getopt(argc,argv,"n:b:c:"))!=-1)
+		switch (c) {
+		case 'n': total=strtoul(optarg,0,0); break;
+		case 'b': block=strtoul(optarg,0,0); break;
+		case 'c': nctl=strtoul(optarg,0,0); break;
+		default:
+			fprintf(stderr,"usage: %s [-n bytes] [-b block] [-c control reads]\n",argv[0]);
+			return 2;
+		}
+	if (!block||block>4096||block%EP_SIZE||total%block) {
+		fprintf(stderr,"block must be a multiple of %d up to 4096, and divide bytes\n",EP_SIZE);
+		return 2;
+	}
+	p.clkin_khz=12000;
+	p.us_per_prd_tick=1000;
+	emu_init();
+	usb_init(&p);
+	usb_attach();
+	emu_bus_reset();
+	r=emu_enumerate(1,1);
+	if (r||usb_get_state()!=USB_STATE_CONFIGURED) {
+		printf("enumeration failed: %d\n",r);
+		return 1;
+	}
+	printf("%-8s %10s %10s %8s %8s %8s %8s\n","test","bytes","bus ms",
+		"MB/s","naks","irqs","ns/irq");
+	bench_out(usb_get_ep(usb_get_config(),1));
+	bench_in(usb_get_ep(usb_get_config(),17));
+	bench_ctl();
+	if (emu_stats.dma_faults||errors) {
+		printf("%lu errors\n",(unsigned long)(errors+emu_stats.dma_faults));
+		return 1;
+	}
+	return 0;
+}
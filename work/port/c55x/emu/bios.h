@@ -0,0 +1,81 @@
+/* port/c55x/emu/bios.h -- DSP/BIOS stand-ins for the host build */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_emu_bios_h
+#define GUARD_emu_bios_h
+
+#include <stddef.h>
+
+/* Just enough of DSP/BIOS, and of the TI compiler's keywords, for 
+usbhw.c to build on the host.  std.h, c55.h, mem.h, sem.h and clk.h 
+all include this file.  The functions are in emu.c, and run against 
+the model's clock. */
+
+#define interrupt
+#define ioport
+
+typedef int Int;
+typedef unsigned int Uns;
+typedef int Bool;
+typedef void *Ptr;
+typedef unsigned long LgUns;
+typedef float Float;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define SYS_FOREVER ((Uns)-1)
+
+/* c55.h: only the USB interrupt (IER0 bit 8) matters to the model */
+#define C55_IEN08 (1<<8)
+void C55_disableIER0(Uns mask);
+void C55_enableIER0(Uns mask);
+
+/* mem.h: sizes are in 16-bit words, as on the C55x, and memory comes 
+from an arena the model's DMA can reach */
+void *MEM_alloc(Int segid, size_t size, size_t align);
+Bool MEM_free(Int segid, Ptr addr, size_t size);
+
+/* sem.h: SEM_pend() lets bus time pass until the semaphore is posted 
+or the timeout expires; SYS_FOREVER gives up after one second */
+typedef struct SEM_Obj *SEM_Handle;
+typedef struct SEM_Attrs SEM_Attrs;
+SEM_Handle SEM_create(Int count, SEM_Attrs *attrs);
+void SEM_delete(SEM_Handle sem);
+Bool SEM_pend(SEM_Handle sem, Uns timeout);
+void SEM_post(SEM_Handle sem);
+
+/* clk.h: ticks of emu_set_clk() microseconds of bus time, and a 
+high-resolution time of one count per bit time (12 MHz) */
+LgUns CLK_getltime(void);
+LgUns CLK_gethtime(void);
+Float CLK_countspms(void);
+
+#endif
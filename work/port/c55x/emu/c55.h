@@ -0,0 +1,2 @@
+/* port/c55x/emu/c55.h -- see bios.h */
+#include "bios.h"
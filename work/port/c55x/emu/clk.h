@@ -0,0 +1,2 @@
+/* port/c55x/emu/clk.h -- see bios.h */
+#include "bios.h"
@@ -0,0 +1,969 @@
+/* port/c55x/emu/emu.c -- host-side model of the C5509 USB module */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bios.h"
+#include "emu.h"
+
+/* The model's view of the I/O space.  Here the register macros name the 
+array directly; the port's go through emu_io(). */
+static u16 io[0x10000];
+
+#include "../usb_5509.h"
+#undef IOTYPE
+#undef IOREG
+#define IOTYPE		volatile u16 *
+#define IOREG(a)		(io[(a)])
+
+#define ADR(reg) ((u32)(&(reg)-io))
+
+void usbhw_isr(void);
+void usbhw_check_timeouts(void);
+
+emu_stats_t emu_stats;
+
+/* bus timing, in full-speed bit times */
+#define BIT_NS(b) ((b)*250/3)
+#define US_BITS(us) ((emu_time_t)(us)*12)
+#define FRAME_BITS 12000
+#define PSOF_LEAD US_BITS(100)
+#define GAP_BITS 8
+#define TOKEN_BITS (35+GAP_BITS)
+#define DATA_BITS(n) (35+8*(n)+GAP_BITS)
+#define HS_BITS (19+GAP_BITS)
+
+static emu_time_t now, frame_start, frame_end, next_prd, timeout;
+static u32 clk_us, prd_us;
+static u16 fnum;
+static u8 psof_done, quiet;
+static u8 host_addr, dev_addr, ep0_size;
+static void (*idle)(void);
+
+/* CPU state: IER0, and whether usbhw_isr() is running */
+static Uns ier;
+static u8 in_isr;
+
+/* the register access in progress; see emu_io() */
+static u32 pend_adr;
+static u16 pend_old, w1c_val;
+static u8 pend;
+
+/* per DMA slot (1-7 OUT, 9-15 IN): packet lengths in the X and Y 
+buffers, which OUT buffers hold a packet the DMA has not moved, and 
+whether an IN transfer owes a zero-length packet */
+typedef struct slot_t {
+	u16 cnt[2];
+	u8 held[2];
+	u8 zlp;
+} slot_t;
+
+static slot_t slots[16];
+
+static void written(u32 a, u16 old, u16 val);
+static void dma_run(int s);
+
+/* ------ Register access */
+
+static int is_w1c(u32 a)
+{
+	return a==ADR(USBIF)||(a>=ADR(USBIEPIF)&&a<=ADR(USBODGIF));
+}
+
+static int int_src(int clear);
+
+/* applies the access before this one, if it changed the register */
+static void flush(void)
+{
+	u32 a=pend_adr;
+
+	if (!pend) return;
+	pend=0;
+	if (is_w1c(a))
+		io[a]=w1c_val&~io[a];
+	else if (a==ADR(USBINTSRC))
+		io[a]=pend_old;
+	else if (io[a]!=pend_old)
+		written(a,pend_old,io[a]);
+}
+
+volatile unsigned short *emu_io(unsigned long adr)
+{
+	u32 a=adr&0xffff;
+
+	flush();
+	if (is_w1c(a)) {
+		w1c_val=io[a];
+		io[a]=0;
+	} else if (a==ADR(USBINTSRC))
+		io[a]=int_src(1);
+	pend=1;
+	pend_adr=a;
+	pend_old=io[a];
+	return io+a;
+}
+
+/* ------ Endpoint buffers */
+
+static int maxpkt(int s)
+{
+	u16 size=USBOSIZ(s)&0x7f;
+
+	if (USBOCNF(s)&USBOCNF_ISO)
+		size|=(USBOCNF(s)&7)<<7;
+	return size;
+}
+
+static int dbuf(int s)
+{
+	return USBOCNF(s)&(USBOCNF_DBUF|USBOCNF_ISO);
+}
+
+/* the buffer the host uses next */
+static int cur_buf(int s)
+{
+	return dbuf(s)&&(USBOCNF(s)&USBOCNF_TOGGLE);
+}
+
+static volatile u16 *ctreg(int s, int y)
+{
+	return y?&USBOCTY(s):&USBOCTX(s);
+}
+
+static u32 buf_adr(int s, int y)
+{
+	return USB_BASE+((u32)(y?USBOBAY(s):USBOBAX(s))<<4);
+}
+
+static void set_ct(int s, int y, u16 nak)
+{
+	*ctreg(s,y)=nak|(slots[s].cnt[y]&0x7f);
+}
+
+/* ------ DMA */
+
+extern char __data_start[], _end[];
+static u16 scratch[0x8000];
+
+/* The port writes (u32)ptr<<1 to the 24-bit address registers, which 
+keeps the low 23 bits of the pointer; the rest are those of static 
+data, if the transfer fits there. */
+static u16 *dma_mem(int s, u16 adl, u16 adh)
+{
+	u32 a=(((u32)(adh&0xff)<<16)|adl)>>1;
+	char *p=__data_start+((a-(u32)__data_start)&0x7fffff);
+
+	if (p+USBODSIZ(s)+4>_end) {
+		++emu_stats.dma_faults;
+		return scratch;
+	}
+	return (u16 *)p;
+}
+
+#define dma_base(s) dma_mem(s,USBODADL(s),USBODADH(s))
+
+static void put_byte(u16 *w, u32 i, u8 b)
+{
+	if (i&1)
+		w[i>>1]=(w[i>>1]&0xff00)|b;
+	else
+		w[i>>1]=(w[i>>1]&0xff)|(b<<8);
+}
+
+static u8 get_byte(const u16 *w, u32 i)
+{
+	return (i&1)?w[i>>1]&0xff:w[i>>1]>>8;
+}
+
+static void dma_start(int s)
+{
+	USBODCT(s)=0;
+	if (s<8)
+		dma_base(s)[0]=0;
+	else
+		slots[s].zlp=!USBODSIZ(s);
+}
+
+/* ends the current transfer, or goes on to the reload registers */
+static void dma_end(int s)
+{
+	if (USBODCTL(s)&USBODCTL_RLD) {
+		USBODSIZ(s)=USBODRSZ(s);
+		USBODADL(s)=USBODRAL(s);
+		USBODADH(s)=USBODRAH(s);
+		USBODCTL(s)&=~USBODCTL_RLD;
+		if (s<8) USBODRIF|=1<<s;
+		else USBIDRIF|=1<<(s-8);
+		dma_start(s);
+	} else {
+		USBODCTL(s)&=~USBODCTL_GO;
+		if (s<8) USBODGIF|=1<<s;
+		else USBIDGIF|=1<<(s-8);
+	}
+}
+
+/* OUT: moves held packets to memory in arrival order, and arms empty 
+buffers */
+static int dma_out(int s)
+{
+	slot_t *st=slots+s;
+	int y=cur_buf(s),n,i;
+	u32 base,ct;
+	u16 *mem;
+
+	if (!st->held[y]&&dbuf(s)) y^=1;
+	if (!st->held[y]) {
+		for (y=0;y<(dbuf(s)?2:1);++y)
+			if (!st->held[y]) *ctreg(s,y)=0;
+		return 0;
+	}
+	mem=dma_base(s);
+	ct=USBODCT(s);
+	n=st->cnt[y];
+	if (n>USBODSIZ(s)-ct) n=USBODSIZ(s)-ct;	// overflow: the rest is lost
+	base=buf_adr(s,y);
+	for (i=0;i<n;++i)
+		put_byte(mem+1,ct+i,(u8)io[base+i]);
+	ct+=n;
+	USBODCT(s)=ct;
+	mem[0]=ct;
+	st->held[y]=0;
+	*ctreg(s,y)=0;
+	if (st->cnt[y]<maxpkt(s)||ct>=USBODSIZ(s))
+		dma_end(s);
+	return 1;
+}
+
+/* IN: loads empty buffers from memory, in the order the host reads them */
+static int dma_in(int s)
+{
+	slot_t *st=slots+s;
+	int y=cur_buf(s),n,i;
+	u32 base,ct=USBODCT(s);
+	u16 *mem;
+
+	if (!(*ctreg(s,y)&USBICTX_NAK)&&dbuf(s)) y^=1;
+	if (!(*ctreg(s,y)&USBICTX_NAK))
+		return 0;
+	n=USBODSIZ(s)-ct;
+	if (n>maxpkt(s)) n=maxpkt(s);
+	if (!n&&!st->zlp) {
+		dma_end(s);
+		return 1;
+	}
+	mem=dma_base(s);
+	base=buf_adr(s,y);
+	for (i=0;i<n;++i)
+		io[base+i]=get_byte(mem,ct+i);
+	st->cnt[y]=n;
+	set_ct(s,y,0);
+	st->zlp=0;
+	ct+=n;
+	USBODCT(s)=ct;
+	if (ct>=USBODSIZ(s)) {
+		if ((USBODCTL(s)&USBODCTL_SHT)&&n&&n==maxpkt(s))
+			st->zlp=1;
+		else
+			dma_end(s);
+	}
+	return 1;
+}
+
+static void dma_run(int s)
+{
+	while ((USBODCTL(s)&USBODCTL_GO)&&(s<8?dma_out(s):dma_in(s)))
+		;
+}
+
+/* ------ Register writes */
+
+static void module_reset(void)
+{
+	u32 a;
+
+	for (a=USB_BASE;a<USB_BASE+0x1000;++a)
+		io[a]=0;
+	for (a=0;a<16;++a) {
+		slots[a].held[0]=slots[a].held[1]=0;
+		slots[a].cnt[0]=slots[a].cnt[1]=0;
+		slots[a].zlp=0;
+	}
+	dev_addr=0;
+}
+
+static void written(u32 a, u16 old, u16 val)
+{
+	u32 ofs=a-USB_BASE;
+	int s,y;
+
+	if (a==ADR(USBPLL)) {
+		USBPLL|=1;	// locks at once
+		return;
+	}
+	if (a==ADR(USBIDLECTL)) {
+		if (!(val&USBIDLECTL_USBRST))
+			module_reset();
+		return;
+	}
+	if (ofs<0x80) {	// DMA registers
+		s=ofs>>3;
+		if ((ofs&7)||!s||s==8)
+			return;
+		if (val&USBODCTL_STP) {
+			USBODCTL(s)&=~(USBODCTL_STP|USBODCTL_GO|USBODCTL_RLD);
+			if (s<8) USBODGIF|=1<<s;
+			else USBIDGIF|=1<<(s-8);
+		} else if ((val&USBODCTL_GO)&&!(old&USBODCTL_GO)) {
+			dma_start(s);
+			dma_run(s);
+		}
+		return;
+	}
+	if (ofs>=0xf08&&ofs<0xf80) {	// endpoint definitions
+		s=(ofs-0xf00)>>3;
+		if (s==8) return;
+		switch (ofs&7) {
+		case 0:
+			if (!(val&USBOCNF_UBME)) {
+				slots[s].held[0]=slots[s].held[1]=0;
+				slots[s].zlp=0;
+			}
+			break;
+		case 2:
+		case 6:
+			y=(ofs&7)==6;
+			if (s<8) {
+				// a full OUT buffer stays full until the DMA has moved it
+				if (slots[s].held[y])
+					set_ct(s,y,USBOCTX_NAK);
+			} else {
+				slots[s].cnt[y]=(val&USBICTX_NAK)?0:val&0x7f;
+			}
+			dma_run(s);
+			break;
+		}
+	}
+}
+
+/* ------ Interrupts */
+
+/* The source codes of usbhw_isr(): EP0, bus, endpoint packet (0x10 plus 
+twice the slot) and DMA (0x30 plus twice the slot for reload, one more 
+for go). */
+static int int_src(int clear)
+{
+	// by USBIF bit: STPOW, -, SETUP, PSOF, SOF, RESR, SUSR, RSTR
+	static const u8 bus_code[8]={0xe,0,0xc,0x11,0x10,0xa,8,6};
+	u16 best=0,f,bit;
+	volatile u16 *reg=0;
+	int i;
+
+#define TRY(REG,MASK,CODE) \
+	if ((REG)&(MASK)&&(!best||(CODE)<best)) { best=(CODE); reg=&(REG); bit=(MASK); }
+
+	bit=0;
+	TRY(USBOEPIF,(USBOEPIE&(USBOCNF0&USBOCNF0_INTE?1:0)),2);
+	TRY(USBIEPIF,(USBIEPIE&(USBICNF0&USBICNF0_INTE?1:0)),4);
+	f=USBIF&USBIE;
+	for (i=0;i<8;++i) {
+		TRY(USBIF,f&(1<<i),bus_code[i]);
+	}
+	for (i=1;i<8;++i) {
+		TRY(USBOEPIF,USBOEPIE&(1<<i),0x10+2*i);
+		TRY(USBIEPIF,USBIEPIE&(1<<i),0x20+2*i);
+		TRY(USBODRIF,USBODIE&(1<<i),0x30+2*i);
+		TRY(USBODGIF,USBODIE&(1<<i),0x31+2*i);
+		TRY(USBIDRIF,USBIDIE&(1<<i),0x40+2*i);
+		TRY(USBIDGIF,USBIDIE&(1<<i),0x41+2*i);
+	}
+#undef TRY
+	if (best&&clear)
+		*reg&=~bit;
+	return best;
+}
+
+static emu_time_t cpu_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return (emu_time_t)t.tv_sec*1000000000u+t.tv_nsec;
+}
+
+/* takes pending interrupts, unless they are disabled or one is being 
+taken already */
+static void irq(void)
+{
+	emu_time_t t;
+
+	flush();
+	if (in_isr||!(ier&C55_IEN08))
+		return;
+	while (int_src(0)) {
+		in_isr=1;
+		t=cpu_ns();
+		usbhw_isr();
+		flush();
+		emu_stats.isr_ns+=cpu_ns()-t;
+		++emu_stats.irqs;
+		in_isr=0;
+	}
+}
+
+void C55_disableIER0(Uns mask)
+{
+	flush();
+	ier&=~mask;
+}
+
+void C55_enableIER0(Uns mask)
+{
+	flush();
+	ier|=mask;
+	irq();
+}
+
+/* lets the DSP run: interrupts, the idle hook and the PRD */
+static void run(void)
+{
+	emu_time_t t;
+
+	irq();
+	if (prd_us&&now>=next_prd) {
+		next_prd+=US_BITS(prd_us);
+		usbhw_check_timeouts();
+		irq();
+	}
+	if (idle&&!in_isr) {
+		t=cpu_ns();
+		idle();
+		flush();
+		emu_stats.idle_ns+=cpu_ns()-t;
+		irq();
+	}
+}
+
+/* ------ Bus time */
+
+static void sof(void)
+{
+	now=frame_start=frame_end;
+	frame_end+=FRAME_BITS;
+	psof_done=0;
+	fnum=(fnum+1)&0x7ff;
+	USBFNUML=fnum&0xff;
+	USBFNUMH=fnum>>8;
+	USBIF|=USBIF_SOF;
+	++emu_stats.frames;
+	run();
+}
+
+/* moves the clock on, with SOFs and pre-SOFs on the way */
+static void advance(emu_time_t bits)
+{
+	emu_time_t t=now+bits;
+
+	flush();
+	while (!quiet) {
+		if (!psof_done&&frame_end-PSOF_LEAD<=t) {
+			if (now<frame_end-PSOF_LEAD)
+				now=frame_end-PSOF_LEAD;
+			psof_done=1;
+			USBIF|=USBIF_PSOF;
+			run();
+		} else if (frame_end<=t)
+			sof();
+		else
+			break;
+	}
+	now=t;
+	run();
+}
+
+/* restarts frames after a quiet bus */
+static void wake(void)
+{
+	quiet=0;
+	frame_start=now;
+	frame_end=now+FRAME_BITS;
+	psof_done=0;
+}
+
+static int attached(void)
+{
+	return (USBIDLECTL&USBIDLECTL_USBRST)&&(USBCTL&USBCTL_CONN);
+}
+
+/* waits for room in the frame for a transaction of the given length; 
+returns nonzero if the device will answer */
+static int begin(emu_time_t bits)
+{
+	flush();
+	if (now+bits>frame_end&&bits<=FRAME_BITS-TOKEN_BITS)
+		advance(frame_end-now);
+	if (now<frame_start+TOKEN_BITS)
+		now=frame_start+TOKEN_BITS;	// the SOF
+	++emu_stats.transactions;
+	return !quiet&&attached()&&host_addr==dev_addr;
+}
+
+static int result(int r)
+{
+	if (r==EMU_NAK) ++emu_stats.naks;
+	else if (r==EMU_STALL) ++emu_stats.stalls;
+	return r;
+}
+
+/* ------ Host */
+
+void emu_wait(u32 us)
+{
+	advance(US_BITS(us));
+}
+
+void emu_bus_reset(void)
+{
+	flush();
+	quiet=1;
+	if (attached()) {
+		USBIF|=USBIF_RSTR;
+		USBADDR=0;
+		USBICT0=USBICT0_NAK;
+		USBOCT0=USBOCT0_NAK;
+	}
+	dev_addr=host_addr=0;
+	advance(US_BITS(10000));
+	wake();
+}
+
+void emu_suspend(void)
+{
+	flush();
+	quiet=1;
+	advance(US_BITS(3000));
+	if (attached())
+		USBIF|=USBIF_SUSR;
+	run();
+}
+
+void emu_resume(void)
+{
+	flush();
+	if (attached())
+		USBIF|=USBIF_RESR;
+	advance(US_BITS(20000));
+	wake();
+}
+
+int emu_setup(const u8 *pkt)
+{
+	emu_time_t bits=TOKEN_BITS+DATA_BITS(8)+HS_BITS;
+	int i;
+
+	if (!begin(bits)) {
+		advance(bits);
+		return EMU_NORESP;
+	}
+	for (i=0;i<8;++i)
+		USBBUFSETUP(i)=pkt[i];
+	USBICT0=USBICT0_NAK;
+	USBOCT0=USBOCT0_NAK;
+	USBICNF0&=~USBICNF0_STALL;
+	USBOCNF0&=~USBOCNF0_STALL;
+	if (USBIF&USBIF_SETUP)
+		USBIF|=USBIF_STPOW;
+	USBIF|=USBIF_SETUP;
+	advance(bits);
+	return EMU_ACK;
+}
+
+static int ep0_in(u8 *buf, int max)
+{
+	int n,i;
+
+	if (USBICNF0&USBICNF0_STALL) return EMU_STALL;
+	if (USBICT0&USBICT0_NAK) return EMU_NAK;
+	n=USBICT0&USBICT0_COUNT;
+	for (i=0;i<n&&i<max;++i)
+		buf[i]=(u8)USBBUFIN0(i);
+	USBICT0|=USBICT0_NAK;
+	// an empty packet is the status stage, unless it ends the data of 
+	// a control read
+	if (n||USBBUFSETUP(0)&0x80)
+		USBIEPIF|=1;
+	else
+		dev_addr=USBADDR&0x7f;
+	return n;
+}
+
+static int ep_in(int s, u8 *buf, int max)
+{
+	slot_t *st=slots+s;
+	int y=cur_buf(s),n,i;
+	u32 base=buf_adr(s,y);
+
+	if (!(USBICNF(s)&USBICNF_UBME)) return EMU_NORESP;
+	if ((USBICNF(s)&USBICNF_STALL)&&!(USBICNF(s)&USBICNF_ISO)) return EMU_STALL;
+	if (*ctreg(s,y)&USBICTX_NAK) return EMU_NAK;
+	n=st->cnt[y];
+	for (i=0;i<n&&i<max;++i)
+		buf[i]=(u8)io[base+i];
+	st->cnt[y]=0;
+	set_ct(s,y,USBICTX_NAK);
+	USBICNF(s)^=USBICNF_TOGGLE;
+	USBIEPIF|=1<<(s-8);
+	dma_run(s);
+	return n;
+}
+
+int emu_in(int ep, u8 *buf, int max)
+{
+	int s=ep?(ep&7)+8:0,r;
+	int iso=s&&(USBICNF(s)&USBICNF_ISO);
+
+	if (!begin(TOKEN_BITS+HS_BITS)) {
+		advance(TOKEN_BITS+HS_BITS);
+		return EMU_NORESP;
+	}
+	r=s?ep_in(s,buf,max):ep0_in(buf,max);
+	if (r>=0)
+		advance(TOKEN_BITS+DATA_BITS(r)+(iso?0:HS_BITS));
+	else
+		advance(TOKEN_BITS+HS_BITS);
+	return result(r);
+}
+
+static int ep0_out(const u8 *buf, int len)
+{
+	int i;
+
+	if (USBOCNF0&USBOCNF0_STALL) return EMU_STALL;
+	if (USBOCT0&USBOCT0_NAK) return EMU_NAK;
+	if (!len) {	// status stage
+		USBOCT0=USBOCT0_NAK;
+		dev_addr=USBADDR&0x7f;
+		return EMU_ACK;
+	}
+	for (i=0;i<len;++i)
+		USBBUFOUT0(i)=buf[i];
+	USBOCT0=USBOCT0_NAK|len;
+	USBOEPIF|=1;
+	return EMU_ACK;
+}
+
+static int ep_out(int s, const u8 *buf, int len)
+{
+	slot_t *st=slots+s;
+	int y=cur_buf(s),iso=USBOCNF(s)&USBOCNF_ISO,i;
+	u32 base=buf_adr(s,y);
+
+	if (!(USBOCNF(s)&USBOCNF_UBME)) return EMU_NORESP;
+	if ((USBOCNF(s)&USBOCNF_STALL)&&!iso) return EMU_STALL;
+	if (*ctreg(s,y)&USBOCTX_NAK||st->held[y])
+		return iso?EMU_ACK:EMU_NAK;
+	if (len>maxpkt(s)) len=maxpkt(s);
+	for (i=0;i<len;++i)
+		io[base+i]=buf[i];
+	st->cnt[y]=len;
+	st->held[y]=1;
+	set_ct(s,y,USBOCTX_NAK);
+	USBOCNF(s)^=USBOCNF_TOGGLE;
+	USBOEPIF|=1<<s;
+	dma_run(s);
+	return EMU_ACK;
+}
+
+int emu_out(int ep, const u8 *buf, int len)
+{
+	emu_time_t bits=TOKEN_BITS+DATA_BITS(len)+HS_BITS;
+	int s=ep&7,r;
+
+	if (!begin(bits)) {
+		advance(bits);
+		return EMU_NORESP;
+	}
+	r=s?ep_out(s,buf,len):ep0_out(buf,len);
+	advance(bits);
+	return result(r);
+}
+
+static int in_retry(int ep, u8 *buf, int max)
+{
+	emu_time_t t0=now;
+	int r;
+
+	while ((r=emu_in(ep,buf,max))==EMU_NAK)
+		if (now-t0>=timeout) return EMU_TIMEOUT;
+	if (r>max) return EMU_BABBLE;
+	return r;
+}
+
+static int out_retry(int ep, const u8 *buf, int len)
+{
+	emu_time_t t0=now;
+	int r;
+
+	while ((r=emu_out(ep,buf,len))==EMU_NAK)
+		if (now-t0>=timeout) return EMU_TIMEOUT;
+	return r;
+}
+
+int emu_control(const u8 *setup, u8 *data)
+{
+	int len=setup[6]|(setup[7]<<8),ct=0,n,r;
+
+	r=emu_setup(setup);
+	if (r) return r;
+	if (setup[0]&0x80) {
+		while (ct<len) {
+			n=len-ct;
+			if (n>ep0_size) n=ep0_size;
+			r=in_retry(0,data+ct,n);
+			if (r<0) return r;
+			ct+=r;
+			if (r<ep0_size) break;
+		}
+		r=out_retry(0,0,0);
+	} else {
+		while (ct<len) {
+			n=len-ct;
+			if (n>ep0_size) n=ep0_size;
+			r=out_retry(0,data+ct,n);
+			if (r<0) return r;
+			ct+=n;
+		}
+		r=in_retry(0,0,0);
+	}
+	if (r<0) return r;
+	if (setup[0]==0&&setup[1]==5)	// SET_ADDRESS
+		host_addr=setup[2]&0x7f;
+	return ct;
+}
+
+long emu_bulk_in(int ep, u8 *buf, u32 len, int maxpkt)
+{
+	u32 ct=0;
+	int n,r;
+
+	while (ct<len) {
+		n=len-ct<(u32)maxpkt?(int)(len-ct):maxpkt;
+		r=in_retry(ep,buf+ct,n);
+		if (r<0) return r;
+		ct+=r;
+		if (r<maxpkt) break;
+	}
+	return ct;
+}
+
+long emu_bulk_out(int ep, const u8 *buf, u32 len, int maxpkt)
+{
+	u32 ct=0;
+	int n,r;
+
+	while (ct<len) {
+		n=len-ct<(u32)maxpkt?(int)(len-ct):maxpkt;
+		r=out_retry(ep,buf+ct,n);
+		if (r<0) return r;
+		ct+=n;
+	}
+	return ct;
+}
+
+int emu_enumerate(int addr, int config)
+{
+	u8 s[8]={0x80,6,0,1,0,0,8,0},d[255];
+	int r;
+
+	ep0_size=8;
+	r=emu_control(s,d);
+	if (r<0) return r;
+	if (r<8) return EMU_BABBLE;
+	ep0_size=d[7];
+	s[0]=0; s[1]=5; s[2]=addr; s[3]=0; s[6]=0;
+	if ((r=emu_control(s,0))<0) return r;
+	emu_wait(2000);
+	s[0]=0x80; s[1]=6; s[2]=0; s[3]=1; s[6]=18;
+	if ((r=emu_control(s,d))<0) return r;
+	s[3]=2; s[6]=9;
+	if ((r=emu_control(s,d))<0) return r;
+	s[6]=d[2]; s[7]=d[3];
+	if (s[7]) { s[6]=255; s[7]=0; }
+	if ((r=emu_control(s,d))<0) return r;
+	s[0]=0; s[1]=9; s[2]=config; s[3]=0; s[6]=s[7]=0;
+	if ((r=emu_control(s,0))<0) return r;
+	return 0;
+}
+
+/* ------ Set-up */
+
+void emu_clear_stats(void)
+{
+	emu_stats_t z={0};
+
+	emu_stats=z;
+}
+
+void emu_init(void)
+{
+	u32 a;
+
+	for (a=0;a<0x10000;++a)
+		io[a]=0;
+	module_reset();
+	pend=0;
+	ier=0;
+	in_isr=0;
+	now=frame_start=0;
+	frame_end=FRAME_BITS;
+	psof_done=0;
+	fnum=0;
+	quiet=0;
+	host_addr=dev_addr=0;
+	ep0_size=8;
+	if (!clk_us) clk_us=1000;
+	if (!timeout) timeout=US_BITS(1000000);
+	next_prd=US_BITS(prd_us);
+	emu_clear_stats();
+}
+
+void emu_set_idle(void (*fn)(void))
+{
+	idle=fn;
+}
+
+void emu_set_clk(u32 us)
+{
+	clk_us=us?us:1;
+}
+
+void emu_set_prd(u32 us)
+{
+	prd_us=us;
+	next_prd=now+US_BITS(us);
+}
+
+void emu_set_timeout(u32 us)
+{
+	timeout=US_BITS(us);
+}
+
+emu_time_t emu_now(void)
+{
+	return BIT_NS(now);
+}
+
+/* ------ DSP/BIOS */
+
+LgUns CLK_getltime(void)
+{
+	return (LgUns)(now/12/clk_us);
+}
+
+LgUns CLK_gethtime(void)
+{
+	return (LgUns)now;
+}
+
+Float CLK_countspms(void)
+{
+	return 12000;
+}
+
+struct SEM_Obj {
+	Int count;
+};
+
+SEM_Handle SEM_create(Int count, SEM_Attrs *attrs)
+{
+	SEM_Handle sem=malloc(sizeof(*sem));
+
+	if (sem) sem->count=count;
+	return sem;
+}
+
+void SEM_delete(SEM_Handle sem)
+{
+	free(sem);
+}
+
+void SEM_post(SEM_Handle sem)
+{
+	++sem->count;
+}
+
+Bool SEM_pend(SEM_Handle sem, Uns ticks)
+{
+	emu_time_t end=now+(ticks==SYS_FOREVER?US_BITS(1000000):US_BITS((emu_time_t)ticks*clk_us));
+
+	while (!sem->count) {
+		if (now>=end) return FALSE;
+		advance(US_BITS(1000));
+	}
+	--sem->count;
+	return TRUE;
+}
+
+/* MEM_alloc() carves blocks from a static arena, first fit, with a 
+header word pair holding each block's size and whether it is free. */
+#define ARENA_WORDS 0x40000
+
+static u16 arena[ARENA_WORDS];
+static u32 arena_top;
+
+void *MEM_alloc(Int segid, size_t size, size_t align)
+{
+	u32 i,n,len;
+
+	size=(size+1)&~(size_t)1;	// keep blocks 32-bit aligned
+	for (i=0;i<arena_top;i+=2+n) {
+		n=arena[i]|((u32)arena[i+1]&0x7fff)<<16;
+		if ((arena[i+1]&0x8000)&&n>=size) {
+			arena[i+1]&=0x7fff;
+			return arena+i+2;
+		}
+	}
+	len=size;
+	if (arena_top+2+len>ARENA_WORDS)
+		return 0;
+	arena[arena_top]=len&0xffff;
+	arena[arena_top+1]=(len>>16)&0x7fff;
+	i=arena_top;
+	arena_top+=2+len;
+	return arena+i+2;
+}
+
+Bool MEM_free(Int segid, Ptr addr, size_t size)
+{
+	u16 *p=addr;
+
+	if (p<arena+2||p>=arena+ARENA_WORDS)
+		return FALSE;
+	p[-1]|=0x8000;
+	return TRUE;
+}
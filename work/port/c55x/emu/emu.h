@@ -0,0 +1,173 @@
+// :wrap=soft:
+
+/* port/c55x/emu/emu.h -- host-side model of the C5509 USB module */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_emu_h
+#define GUARD_emu_h
+
+#include "types.h"
+
+/*! \defgroup port_c55x_emu C5509 model
+\ingroup port_c55x
+
+A register-level software model of the C5509 USB module, with a scripted USB host, so that the C55x port (port/c55x/usbhw.c, unmodified) and the core can be built and run on a Linux PC.  It is meant for measuring the core: the model counts bus time, NAKs and interrupts, and the CPU time spent in usbhw_isr() and in the idle hook.  Build it with the Makefile in port/c55x/emu; \c make \c check runs the benchmark (bench.c) on a small transfer.
+
+\section emu_model The model
+
+The port reaches the registers through emu_io(), by way of the usb_5509.h in port/c55x/emu, which the host build finds before the port's own.  The model sees a write when the next register access, or the next call into the model, finds the register changed; writing a register with the value it already holds therefore does nothing, which matches the hardware for every write the port makes.  Interrupt flag registers read as 0 and are cleared by writing 1s, and reading USBINTSRC clears the flag it reports.  Sources are reported lowest code first.
+
+Endpoints 1-7 have X and Y buffers in the module's buffer RAM, selected by the TOGGLE bit when double buffered (DBUF or ISO); otherwise X is used.  An OUT buffer with NAK clear accepts a packet, which sets NAK until the DMA has moved it; a full buffer stays full if the CPU clears NAK.  An IN buffer with NAK clear holds a packet for the host.  While GO is set, the DMA moves packets between the buffers and memory at once, writes the received length in front of OUT data (the length word, see "Buffer count in buffer"), arms empty OUT buffers, appends a zero-length packet to an IN transfer that ends on a packet boundary when SHT is set, and switches to the reload registers when RLD is set.  Addresses in the DMA registers are taken to lie in the program's static data, which includes the arena used by MEM_alloc(); a transfer anywhere else (such as the port's toggle-flipping dummy) goes to a scratch buffer and is counted in emu_stats_t#dma_faults.
+
+On endpoint 0, a SETUP clears the STALL bits and sets both NAK bits.  A zero-length packet in either direction is the status stage: it completes without an interrupt, and the address written to USBADDR takes effect after it.
+
+Data toggles, bit stuffing, remote wakeup and the pre-SOF timer are not modelled.  Pre-SOF comes 100 us before each SOF.
+
+\section emu_time Time
+
+Bus time is counted in full-speed bit times (12 MHz), in 1 ms frames.  Each transaction takes its token, data and handshake packets plus an 8 bit time gap after each, and does not start unless it fits before the next SOF.  The DSP takes no bus time: after each transaction the model calls usbhw_isr() for any pending interrupt, then the idle hook (emu_set_idle()), which stands in for the application's threads.  usbhw_check_timeouts() runs every emu_set_prd() microseconds.
+
+\section emu_host The host
+
+emu_setup(), emu_in() and emu_out() send one transaction each, to the address set by the last successful SET_ADDRESS through emu_control().  The other host calls retry NAKs for up to emu_set_timeout() microseconds of bus time.
+*/
+//@{
+
+//! Device answered with ACK (or DATA, for emu_in())
+#define EMU_ACK 0
+//! Device answered with NAK
+#define EMU_NAK (-1)
+//! Device answered with STALL
+#define EMU_STALL (-2)
+//! Device did not answer: detached, wrong address or endpoint disabled
+#define EMU_NORESP (-3)
+//! NAKs went on for longer than the timeout
+#define EMU_TIMEOUT (-4)
+//! Device sent more data than asked for
+#define EMU_BABBLE (-5)
+
+//! Time in nanoseconds
+typedef unsigned long long emu_time_t;
+
+//! Counters kept by the model
+/*! Cleared by emu_init() and emu_clear_stats(). */
+typedef struct emu_stats_t {
+	//! Frames started
+	u32 frames;
+	//! Transactions sent by the host
+	u32 transactions;
+	//! Transactions NAKed by the device
+	u32 naks;
+	//! Transactions STALLed by the device
+	u32 stalls;
+	//! Calls to usbhw_isr()
+	u32 irqs;
+	//! DMA transfers to or from addresses outside static data
+	u32 dma_faults;
+	//! CPU time spent in usbhw_isr()
+	emu_time_t isr_ns;
+	//! CPU time spent in the idle hook
+	emu_time_t idle_ns;
+} emu_stats_t;
+
+extern emu_stats_t emu_stats;
+
+//! Power up the model
+/*! Resets every register, the bus clock and the counters.  The device is detached until the port attaches it.  Call before usb_init(). */
+void emu_init(void);
+
+//! Set the idle hook
+/*! \p fn is called after every transaction and interrupt, at thread level with interrupts enabled; for example, it can call usb_dispatch(). */
+void emu_set_idle(void (*fn)(void));
+
+//! Set the CLK tick
+/*! CLK_getltime() counts ticks of \p us microseconds of bus time.  Pass the same value in c55x_params#us_per_prd_tick.  Default 1000. */
+void emu_set_clk(u32 us);
+
+//! Set the PRD period
+/*! usbhw_check_timeouts() is called every \p us microseconds of bus time, or never if \p us is 0.  Default 50000. */
+void emu_set_prd(u32 us);
+
+//! Set the NAK timeout
+/*! Sets how long, in microseconds of bus time, the retrying host calls keep at it.  Default 1000000. */
+void emu_set_timeout(u32 us);
+
+//! Bus time
+/*! Returns the bus time since emu_init(), in nanoseconds. */
+emu_time_t emu_now(void);
+
+//! Clear the counters
+void emu_clear_stats(void);
+
+//! Let bus time pass
+/*! Sends SOFs (unless the bus is suspended) for \p us microseconds. */
+void emu_wait(u32 us);
+
+//! Reset the bus
+/*! Signals reset for 10 ms, and sets the host's device address to 0. */
+void emu_bus_reset(void);
+
+//! Suspend the bus
+/*! Stops SOFs; the device sees the suspend 3 ms later. */
+void emu_suspend(void);
+
+//! Resume the bus
+/*! Signals resume for 20 ms, then starts SOFs again. */
+void emu_resume(void);
+
+//! Send a SETUP transaction
+/*! \p pkt is the 8-byte setup packet.  Returns EMU_ACK or EMU_NORESP. */
+int emu_setup(const u8 *pkt);
+
+//! Send an IN transaction
+/*! Returns the number of bytes the device sent, of which at most \p max are copied to \p buf, or EMU_NAK, EMU_STALL or EMU_NORESP.  An isochronous endpoint with no data ready returns EMU_NAK. */
+int emu_in(int ep, u8 *buf, int max);
+
+//! Send an OUT transaction
+/*! Sends \p len bytes from \p buf.  Returns EMU_ACK, EMU_NAK, EMU_STALL or EMU_NORESP.  An isochronous endpoint always returns EMU_ACK, although the data is lost if the device has no buffer ready. */
+int emu_out(int ep, const u8 *buf, int len);
+
+//! Run a control transfer
+/*! Sends \p setup, then the data stage to or from \p data (wLength bytes at most), then the status stage.  Returns the length of the data stage, or an error code. */
+int emu_control(const u8 *setup, u8 *data);
+
+//! Receive a bulk or interrupt transfer
+/*! Reads packets from IN endpoint \p ep until \p len bytes have come, or a short packet.  Returns the number of bytes, or an error code. */
+long emu_bulk_in(int ep, u8 *buf, u32 len, int maxpkt);
+
+//! Send a bulk or interrupt transfer
+/*! Sends \p len bytes to OUT endpoint \p ep in packets of \p maxpkt.  Returns \p len, or an error code. */
+long emu_bulk_out(int ep, const u8 *buf, u32 len, int maxpkt);
+
+//! Enumerate the device
+/*! Reads the device descriptor, sets address \p addr, reads the device and configuration descriptors, and selects configuration \p config.  Returns 0, or an error code. */
+int emu_enumerate(int addr, int config);
+
+//@}
+
+#endif
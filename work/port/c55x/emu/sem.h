@@ -0,0 +1,2 @@
+/* port/c55x/emu/sem.h -- see bios.h */
+#include "bios.h"
@@ -0,0 +1,2 @@
+/* port/c55x/emu/std.h -- see bios.h */
+#include "bios.h"
@@ -0,0 +1,44 @@
+/* port/c55x/emu/usb_5509.h -- C55x USB module registers, as seen through the model */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_emu_usb_5509_h
+#define GUARD_emu_usb_5509_h
+
+#include "../usb_5509.h"
+
+/* Every register access goes through emu_io(), so that the model sees 
+writes (see emu.c).  The register map itself is the port's; its macros 
+expand IOREG only where they are used, so replacing it here is enough. */
+volatile unsigned short *emu_io(unsigned long adr);
+
+#undef IOTYPE
+#undef IOREG
+#define IOTYPE		volatile unsigned short *
+#define IOREG(a)		(*emu_io(a))
+
+#endif
@@ -36,12 +36,21 @@
 /*! Define this if the port supports timeouts */
 #define USBHW_HAVE_TIMEOUT
 
+/*! Define this if the port has a fine clock (usbhw_clock()) */
+#define USBHW_HAVE_CLOCK
+
 /*! Define this if the hardware can attach / deattach from the bus */
 #define USBHW_HAVE_ATTACH
 
 /*! Defined if the hardware supports auto-chaining */
 #define USBHW_AUTO_CHAIN
 
+/*! Defined if the hardware has a pre-SOF interrupt */
+#define USBHW_HAVE_PRESOF
+
+/*! Number of requests the port can hold per endpoint (one running, one in the DMA reload registers) */
+#define USBHW_MAX_REQS 2
+
 //! C55X parameters
 /*! This structure is used to initialise the C55X port. */
 struct c55x_params {
@@ -76,34 +85,54 @@ The DSP/BIOS configuration must include the following:
 
 - HWI 8 must point to _usbhw_isr.
 
-- A PRD object must be created to execute the function _usbhw_check_timeouts() (not a standard PORUS function).  The more often it runs, the more accurate timeouts will be, but the more processor time will be occupied.  50-100ms may be a good value to start with.
+- A PRD object must be created to execute the function _usbhw_check_timeouts() (not a standard PORUS function), unless timeouts are clocked from SOF (see below).  The more often it runs, the more accurate timeouts will be, but the more processor time will be occupied.  50-100ms may be a good value to start with.
 
 \section Implementation notes
 
 This port is DMA driven and non-blocking.  It uses the undocumented ability of the USB peripheral to automatically produce chained packets on a single DMA transaction.  usb_evt_cpdone is therefore called only twice, since it need not participate in packet chaining.
 
+\subsection Reload chaining
+
+The port holds two requests per endpoint.  While the first is running, the second is written to the DMA reload registers and the RLD bit is set, so the hardware moves on to the second buffer without waiting for the CPU.  The reload interrupt retires the first request, and the core immediately hands the port the next one from its queue.  An endpoint with a queue depth of 2 or more therefore streams without gaps between requests.
+
+The reload registers cannot change the short packet (chain) setting, so a chained request following an unchained one (or vice versa) is started from the DMA interrupt instead.
+
 \subsection Buffer count in buffer
 
 The USB peripheral in the C5509 has a curious and unfortunate property.  When the DMA copies from the USB hardware to DSP memory, it inserts a word containing the actual transfer length at the beginning of the buffer.  The buffer is therefore two bytes (one word) longer than requested.
 
-There is unfortunately no way to disable this "feature", save by copying the data manually from the USB peripheral, which, on the C5509, is a very inefficient operation.  Code which must run on the C5509 must therefore take this extra word into account when allocating buffers and processing data.
+There is unfortunately no way to disable this "feature", save by copying the data manually from the USB peripheral, which, on the C5509, is a very inefficient operation.  The generated header therefore sets USB_BUF_LEN_SIZE to 1, and the core points the DMA one word in front of each received buffer, so that the data lands where the application asked for it and the length word falls in the word before.  usb_pool_alloc(), usb_buf_sizeof() and USB_BUF_STATIC() leave room for it, and applications need only use them for buffers they receive into; the data pointer and length they get back are those of the data itself.
+
+\subsection Endpoint buffer RAM
+
+The USB peripheral has 3.5 KB of buffer RAM for endpoints 1-15, from byte offset 0x80 to 0xe80 in the module.  When a configuration is activated, the port lays out each endpoint's buffers in endpoint list order.  Each buffer is the endpoint's packet size (the largest in any alternate setting) rounded up to 16 bytes, the granularity of the base address registers.  Interrupt endpoints are single buffered; bulk and isochronous endpoints get an X and a Y buffer.  If the endpoints do not fit, SET_CONFIGURATION fails.
+
+Set \c bufferRam=3584 in the configuration file to have usbgen make the same plan, report it in the generated source, and refuse configurations that do not fit.  At run time, c55x_buf_free() gives the space left over.
 
 \subsection Timeouts
 
-Timeouts are implemented using a watchdog function called by the PRD module, which the user must configure (see above).  This function checks for pending transactions on all endpoints which have timed out.  If it finds any, it cancels the transaction and sets the endpoint's timeout flag.
+Deadlines are kept by the core (see usb_timer_arm()).  The port only feeds the core's millisecond clock: the PRD function _usbhw_check_timeouts() converts the CLK ticks since its last run to milliseconds, carrying the remainder, and passes them to usb_evt_tick().  Its cost does not depend on the number of endpoints.  Timeouts are accurate to one PRD period.
+
+The port pushes an endpoint's deadline back at each IN and OUT packet interrupt; the core does so as each request or segment completes.
 
-Timeout depends on the check_time field.  The watchdog function compares the current time to check_time, and if it is greater than the endpoint's timeout value, it times out the endpoint.
+If the configuration sets \c timeoutBase=sof, the core clocks timeouts from SOF instead, giving 1 ms resolution, and no PRD object is needed.  Timeouts then stop while the bus is suspended.
 
-check_time is updated by the static function update_check_time(), which calls PRD_getticks.  check_time is therefore in units of ticks.  The watchdog function converts the timeout_ms field to ticks each time it is run (using ticks_to_ms()).
+The fine clock, usbhw_clock(), is the DSP/BIOS high-resolution time (CLK_gethtime()); the core times control requests with it.
 
-check_time is set at the following points:
+\subsection Deferred events
 
-- In the i/o functions
-- At the DMA interrupt
-- At IN and OUT interrupts
+If the configuration sets \c eventMode=deferred, _usbhw_isr() still acknowledges the interrupt, services the DMA reload registers and reads the endpoint counters, but hands every event to the ring read by usb_dispatch().  A SWI which calls usb_dispatch() may be posted from the callback set with usb_set_dispatch_cb().  The host retries control transfers until the SWI has handled them, so the SWI should have a higher priority than any long-running one.
+
+\subsection Host emulation
+
+port/c55x/emu holds a register-level model of the USB module and a scripted host, with which this port and the core build and run on a Linux PC, unmodified, for benchmarking.  See \ref port_c55x_emu.
 
 */
 
+//! Free endpoint buffer RAM
+/*! Returns the number of bytes of endpoint buffer RAM which configuration \p cnf leaves unused, or -1 if its endpoints do not fit or there is no such configuration.  See "Endpoint buffer RAM" in the port notes. */
+int c55x_buf_free(int cnf);
+
 void usbhw_pack55(u8 *src, u16 *dest, u16 len);
 void usbhw_unpack55(u16 *src, u8 *dest, u16 len);
 
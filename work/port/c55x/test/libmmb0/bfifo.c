@@ -46,13 +46,13 @@ int bfifo_isempty(bfifo_t *f)
 int bfifo_ravail(bfifo_t *f)
 {
 	if (!f) return 0;
-	return f->len;
+	return f->len-f->rres;
 }
 
 int bfifo_wavail(bfifo_t *f)
 {
 	if (!f) return 0;
-	return f->size-f->len;
+	return f->size-f->len-f->wres;
 }
 
 u32 bfifo_wstart(bfifo_t *f)
@@ -80,6 +80,38 @@ void bfifo_wcancel(bfifo_t *f)
 	f->writing=0;
 }
 
+/* reserves the next unreserved block for writing; 0 if full */
+u32 bfifo_wreserve(bfifo_t *f)
+{
+	u32 pos;
+
+	if (!f) return 0;
+	if (f->len+f->wres>=f->size) return 0;
+	pos=f->wpos+f->wres;
+	if (pos>=f->size) pos-=f->size;
+	++f->wres;
+	return f->adr+(pos*f->blocksize);
+}
+
+/* the oldest reserved block has been written */
+void bfifo_wcommit(bfifo_t *f)
+{
+	if (!f) return;
+	if (!f->wres) return;
+	--f->wres;
+	++f->wpos;
+	if (f->wpos>=f->size) f->wpos=0;
+	++f->len;
+}
+
+/* gives back the newest reserved block unwritten */
+void bfifo_wrelease(bfifo_t *f)
+{
+	if (!f) return;
+	if (!f->wres) return;
+	--f->wres;
+}
+
 u32 bfifo_rstart(bfifo_t *f)
 {
 	if (!f) return 0;
@@ -107,11 +139,45 @@ void bfifo_rcancel(bfifo_t *f)
 	++f->len;
 }
 
+/* reserves the next unreserved block for reading; 0 if empty */
+u32 bfifo_rreserve(bfifo_t *f)
+{
+	u32 pos;
+
+	if (!f) return 0;
+	if (f->rres>=f->len) return 0;
+	pos=f->rpos+f->rres;
+	if (pos>=f->size) pos-=f->size;
+	++f->rres;
+	return f->adr+(pos*f->blocksize);
+}
+
+/* the oldest reserved block has been read */
+void bfifo_rcommit(bfifo_t *f)
+{
+	if (!f) return;
+	if (!f->rres) return;
+	--f->rres;
+	++f->rpos;
+	if (f->rpos>=f->size) f->rpos=0;
+	--f->len;
+}
+
+/* gives back the newest reserved block unread */
+void bfifo_rrelease(bfifo_t *f)
+{
+	if (!f) return;
+	if (!f->rres) return;
+	--f->rres;
+}
+
 void bfifo_clear(bfifo_t *f)
 {
 	if (!f) return;
 	f->wpos=0;
+	f->wres=0;
 	f->rpos=0;
+	f->rres=0;
 	f->writing=0;
 	f->reading=0;
 	f->len=0;
@@ -14,6 +14,12 @@ write to.
 - Read operations are not atomic.  You reserve a region of the FIFO to read
 from.
 - This implementation can interrupt blocks at page boundaries.
+- A writer which needs several blocks at once (e.g. a DMA with a reload
+slot) can reserve them with bfifo_wreserve() and commit them in order
+with bfifo_wcommit().  Don't mix this with bfifo_wstart().
+- Likewise, a reader can reserve several blocks with bfifo_rreserve()
+and retire them in order with bfifo_rcommit().  Don't mix this with
+bfifo_rstart().
 
 */
 
@@ -23,6 +29,8 @@ typedef size_t bfifo_size_t;
 typedef struct bfifo_t {
 	u32 adr, blocksize, size, len;
 	u32 wpos, rpos;
+	u32 wres; // blocks reserved past wpos
+	u32 rres; // blocks reserved past rpos
 	unsigned int writing:1,
 		reading:1;
 } bfifo_t;
@@ -30,9 +38,15 @@ typedef struct bfifo_t {
 u32 bfifo_wstart(bfifo_t *f);
 void bfifo_wend(bfifo_t *f);
 void bfifo_wcancel(bfifo_t *f);
+u32 bfifo_wreserve(bfifo_t *f);
+void bfifo_wcommit(bfifo_t *f);
+void bfifo_wrelease(bfifo_t *f);
 u32 bfifo_rstart(bfifo_t *f);
 void bfifo_rend(bfifo_t *f);
 void bfifo_rcancel(bfifo_t *f);
+u32 bfifo_rreserve(bfifo_t *f);
+void bfifo_rcommit(bfifo_t *f);
+void bfifo_rrelease(bfifo_t *f);
 
 void bfifo_init(bfifo_t *f, u32 adr, u32 size, u32 blocksize);
 void bfifo_clear(bfifo_t *f);
@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <c55.h>
 #include <mbx.h>
+#include <hwi.h>
+#include "bfifo.h"
 
 // commands
 #define CMD_WVAR	0x01
@@ -43,6 +45,15 @@
 #define CMD_RCRC	0x06
 #define CMD_TMOI	0x07
 #define CMD_TMOO	0x08
+#define CMD_STRO	0x09
+#define CMD_RSTR	0x0a
+#define CMD_STRI	0x0b
+#define CMD_CTLO	0x0c
+#define CMD_CTLI	0x0d
+
+// internal messages
+#define MSG_STRO_DATA	0x80
+#define MSG_STRI_DATA	0x81
 
 // stat codes
 #define STAT_IDLE	0x00
@@ -52,6 +63,8 @@
 #define STAT_BITX	0x04
 #define STAT_TIMO	0x05
 #define STAT_EROR	0x06
+#define STAT_STRO	0x07
+#define STAT_STRI	0x08
 
 typedef struct msg_t {
 	u16 msg;
@@ -63,10 +76,11 @@ typedef struct msg_t {
 static usb_data_t usbtxbuf[32];
 
 static volatile struct {
-	unsigned int test_stat:3,
+	unsigned int test_stat:4,
 		initted:1,
 		err:1,
-		timeout:1;
+		timeout:1,
+		rstr:1;
 	int state;
 	u16 var;
 	u32 crc;
@@ -95,6 +109,25 @@ static void sys_free(void *mem)
 	MEM_free(0,mem,0);
 }
 
+/* Test buffers come from testpool (see test.usbconfig) when they fit, 
+and from the heap otherwise.  len is in words.  Either way they have 
+headroom for reception. */
+static usb_data_t *buf_alloc(size_t len)
+{
+	usb_data_t *mem;
+
+	if (len+USB_BUF_LEN_SIZE<=testpool.blocklen)
+		return usb_pool_alloc(&testpool);
+	mem=sys_malloc(len+USB_BUF_LEN_SIZE);
+	return mem?usb_buf_data(mem):0;
+}
+
+static void buf_free(usb_data_t *buf)
+{
+	if (usb_pool_free(&testpool,buf))
+		sys_free(usb_buf_mem(buf));
+}
+
 static u32 usbU32(usb_data_t *buf)
 {
 	u32 d;
@@ -161,7 +194,7 @@ static void test_blki(u16 len)
 
 	usb_cancel(ep);
 	flags.test_stat=STAT_BICC;
-	buf=sys_malloc(usb_mem_len(len));
+	buf=buf_alloc(usb_mem_len(len));
 	if (!buf) {
 		flags.err=1;
 		return;
@@ -174,7 +207,7 @@ static void test_blki(u16 len)
 		flags.timeout=1;
 	else if (err)
 		flags.err=1;
-	sys_free(buf);
+	buf_free(buf);
 	flags.test_stat=STAT_IDLE;
 }
 
@@ -186,7 +219,7 @@ static void test_blko(u16 len)
 
 	usb_cancel(ep);
 	flags.test_stat=STAT_BORX;
-	buf=sys_malloc(usb_mem_len(len)+2);
+	buf=buf_alloc(usb_mem_len(len));
 	if (!buf) {
 		flags.test_stat=STAT_IDLE;
 		flags.err=1;
@@ -199,12 +232,12 @@ static void test_blko(u16 len)
 		flags.err=1;
 	if (err) {
 		flags.test_stat=STAT_IDLE;
-		sys_free(buf);
+		buf_free(buf);
 		return;
 	}
 	flags.test_stat=STAT_BOCC;
-	flags.crc=crc32(0,(unsigned int *)buf+1,len);
-	sys_free(buf);
+	flags.crc=crc32(0,(unsigned int *)buf,len);
+	buf_free(buf);
 	flags.test_stat=STAT_IDLE;
 }
 
@@ -217,7 +250,7 @@ static void test_tmoi(u16 len, char c)
 
 	usb_cancel(ep);
 	flags.test_stat=STAT_BITX;
-	buf=sys_malloc(usb_mem_len(len));
+	buf=buf_alloc(usb_mem_len(len));
 	if (!buf) {
 		flags.err=1;
 		return;
@@ -227,7 +260,180 @@ static void test_tmoi(u16 len, char c)
 		buf[i]=fill;
 	if (usb_move_wait(ep,buf,len))
 		flags.timeout=1;
+	buf_free(buf);
+	flags.test_stat=STAT_IDLE;
+}
+
+/* OUT streaming: the core fills blocks of a bfifo ring under interrupt,
+   and the test thread CRCs them as they arrive */
+
+#define STRO_BLOCKLEN	512
+#define STRO_BLOCKS	8
+
+#define STRO_BLOCKSIZE	(usb_buf_sizeof(STRO_BLOCKLEN)/sizeof(usb_data_t))
+
+static usb_data_t stro_mem[STRO_BLOCKS*STRO_BLOCKSIZE];
+static u16 stro_len[STRO_BLOCKS]; // bytes received into each block
+static bfifo_t stro_fifo;
+static usb_stream_t stro;
+
+static void msg_post(MBX_Handle mbx, u16 msg, u32 arg1);
+
+static usb_data_t *stro_get(usb_stream_t *s, u32 *len)
+{
+	usb_data_t *mem=(usb_data_t *)bfifo_wreserve(&stro_fifo);
+
+	return mem?usb_buf_data(mem):0;
+}
+
+/* Blocks come back oldest first, with up to the queue depth reserved, so
+each is committed in turn, even if a zero-length packet left it empty;
+bfifo_wrelease() would give up the newest reservation instead.  The
+reader skips empty blocks. */
+static u32 stro_put(usb_stream_t *s, usb_data_t *block, u32 len)
+{
+	stro_len[(usb_buf_mem(block)-stro_mem)/STRO_BLOCKSIZE]=(u16)len;
+	bfifo_wcommit(&stro_fifo);
+	return stro_fifo.len;
+}
+
+static void stro_mark(usb_stream_t *s, u32 level)
+{
+	if (level)
+		msg_post(&test_mbx,MSG_STRO_DATA,0);
+}
+
+static void test_stro(u16 on)
+{
+	usb_endpoint_t *ep=usb_get_ep(usb_get_config(),1);
+
+	usb_stream_stop(ep);
+	if (!on) {
+		flags.test_stat=STAT_IDLE;
+		return;
+	}
+	usb_cancel(ep);
+	bfifo_init(&stro_fifo,(u32)stro_mem,STRO_BLOCKS,STRO_BLOCKSIZE);
+	stro.get=stro_get;
+	stro.put=stro_put;
+	stro.mark=stro_mark;
+	stro.blocklen=STRO_BLOCKLEN;
+	stro.lowat=0;
+	stro.hiwat=1;
+	flags.crc=0;
+	flags.test_stat=STAT_STRO;
+	if (usb_rx_stream(ep,&stro)) {
+		flags.test_stat=STAT_IDLE;
+		flags.err=1;
+	}
+}
+
+static void test_stro_data(void)
+{
+	usb_data_t *buf;
+	u16 len;
+	Uns mask;
+
+	for (;;) {
+		mask=HWI_disable();
+		buf=(usb_data_t *)bfifo_rstart(&stro_fifo);
+		HWI_restore(mask);
+		if (!buf)
+			break;
+		len=stro_len[(buf-stro_mem)/STRO_BLOCKSIZE];
+		if (len)
+			flags.crc=crc32(flags.crc,(unsigned int *)usb_buf_data(buf),len);
+		mask=HWI_disable();
+		bfifo_rend(&stro_fifo);
+		HWI_restore(mask);
+	}
+	if (flags.test_stat==STAT_STRO)
+		usb_stream_kick(usb_get_ep(usb_get_config(),1));
+}
+
+/* IN streaming: the test thread fills a bfifo ring with random blocks, 
+   and the core sends them under interrupt, waking the thread when the 
+   ring runs low */
+
+#define STRI_BLOCKLEN	512
+#define STRI_BLOCKS	8
+
+static usb_data_t stri_mem[STRI_BLOCKS*usb_mem_len(STRI_BLOCKLEN)];
+static bfifo_t stri_fifo;
+static usb_stream_t stri;
+static u32 stri_left;
+
+static usb_data_t *stri_get(usb_stream_t *s, u32 *len)
+{
+	return (usb_data_t *)bfifo_rreserve(&stri_fifo);
+}
+
+static u32 stri_put(usb_stream_t *s, usb_data_t *block, u32 len)
+{
+	if (len)
+		bfifo_rcommit(&stri_fifo);
+	else
+		bfifo_rrelease(&stri_fifo);
+	return bfifo_ravail(&stri_fifo);
+}
+
+static void stri_mark(usb_stream_t *s, u32 level)
+{
+	msg_post(&test_mbx,MSG_STRI_DATA,0);
+}
+
+static void test_stri_data(void)
+{
+	usb_endpoint_t *ep=usb_get_ep(usb_get_config(),17);
+	usb_data_t *buf;
+	Uns mask;
+
+	if (flags.test_stat!=STAT_STRI)
+		return;
+	while (stri_left) {
+		mask=HWI_disable();
+		buf=(usb_data_t *)bfifo_wstart(&stri_fifo);
+		HWI_restore(mask);
+		if (!buf)
+			break;
+		genrnd(buf,STRI_BLOCKLEN);
+		flags.crc=crc32(flags.crc,(unsigned int *)buf,STRI_BLOCKLEN);
+		mask=HWI_disable();
+		bfifo_wend(&stri_fifo);
+		HWI_restore(mask);
+		--stri_left;
+	}
+	usb_stream_kick(ep);
+	if (!stri_left) {
+		usb_stream_flush(ep);
+		flags.test_stat=STAT_IDLE;
+	}
+}
+
+static void test_stri(u32 n)
+{
+	usb_endpoint_t *ep=usb_get_ep(usb_get_config(),17);
+
+	usb_stream_stop(ep);
 	flags.test_stat=STAT_IDLE;
+	if (!n)
+		return;
+	usb_cancel(ep);
+	bfifo_init(&stri_fifo,(u32)stri_mem,STRI_BLOCKS,usb_mem_len(STRI_BLOCKLEN));
+	stri.get=stri_get;
+	stri.put=stri_put;
+	stri.mark=stri_mark;
+	stri.blocklen=STRI_BLOCKLEN;
+	stri.lowat=STRI_BLOCKS/2;
+	stri.hiwat=0;
+	stri_left=n;
+	flags.crc=0;
+	if (usb_tx_stream(ep,&stri)) {
+		flags.err=1;
+		return;
+	}
+	flags.test_stat=STAT_STRI;
+	test_stri_data();
 }
 
 void test_thread(void)
@@ -246,6 +452,18 @@ void test_thread(void)
 		case CMD_TMOI:
 			test_tmoi(m.arg1&0xffff,(m.arg1>>16)&0xff);
 			break;
+		case CMD_STRO:
+			test_stro(m.arg1);
+			break;
+		case MSG_STRO_DATA:
+			test_stro_data();
+			break;
+		case CMD_STRI:
+			test_stri(m.arg1);
+			break;
+		case MSG_STRI_DATA:
+			test_stri_data();
+			break;
 		default:
 			break;
 		}
@@ -276,35 +494,76 @@ static void start_tmoi(u16 len, char c)
 	msg_post(&test_mbx,CMD_TMOI,(u32)len|((u32)c<<16));
 }
 
-static void ctl_write(void)
+static void start_stro(u16 on)
 {
-	int err;
+	msg_post(&test_mbx,CMD_STRO,on);
+}
 
-	err=0;
-	switch(usb_setup.request) {
-	case CMD_WVAR:
-		flags.var=usb_setup.value;
-		break;
-	case CMD_BLKI:
-		start_blki(usb_setup.value);
-		break;
-	case CMD_BLKO:
-		start_blko(usb_setup.value);
-		break;
-	case CMD_TMOI:
-		start_tmoi(usb_setup.value,usbU8(usb_ctl_write_data));
-		break;
-	default:
-		err=-1;
-	}
-	if (err)
-		usb_ctl_stall();
-	else
+static void start_stri(u16 n)
+{
+	msg_post(&test_mbx,CMD_STRI,n);
+}
+
+int ctl_wvar(void)
+{
+	flags.var=usb_setup.value;
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_blki(void)
+{
+	start_blki(usb_setup.value);
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_blko(void)
+{
+	start_blko(usb_setup.value);
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_tmoi(void)
+{
+	start_tmoi(usb_setup.value,usbU8(usb_ctl_write_data));
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_stro(void)
+{
+	start_stro(usb_setup.value);
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_stri(void)
+{
+	start_stri(usb_setup.value);
+	usb_ctl_write_end();
+	return 0;
+}
+
+// Chunked: takes any length, a control write buffer at a time.
+int ctl_ctlo(void)
+{
+	u16 ofs=usb_ctl_write_ofs(),len=usb_ctl_write_len();
+
+	if (!ofs)
+		flags.crc=0;
+	flags.crc=crc32(flags.crc,(unsigned int *)usb_ctl_write_data,len);
+	if (ofs+len>=usb_setup.len)
 		usb_ctl_write_end();
+	return 0;
 }
 
 static u8 get_stat(void)
 {
+	// a lost event leaves the core out of step, so it fails every test
+	if (usb_dispatch_lost())
+		return STAT_EROR;
 	if (flags.err) {
 		flags.err=0;
 		return STAT_EROR;
@@ -316,38 +575,69 @@ static u8 get_stat(void)
 	return flags.test_stat;
 }
 
-static void ctl_read(void)
-{
-	switch(usb_setup.request) {
-	case CMD_RVAR:
-		usbPutU16(usbtxbuf,flags.var);
-		usb_ctl_read_end(2,usbtxbuf);
-		break;
-	case CMD_STAT:
-		usbPutU8(usbtxbuf,get_stat());
-		usb_ctl_read_end(1,usbtxbuf);
-		break;
-	case CMD_RCRC:
-		usbPutU32(usbtxbuf,flags.crc);
-		usb_ctl_read_end(4,usbtxbuf);
-		break;
-	default:
-		usb_ctl_stall();
-		break;
-	}
+int ctl_rvar(void)
+{
+	usbPutU16(usbtxbuf,flags.var);
+	usb_ctl_read_end(2,usbtxbuf);
+	return 0;
+}
+
+int ctl_stat(void)
+{
+	usbPutU8(usbtxbuf,get_stat());
+	usb_ctl_read_end(1,usbtxbuf);
+	return 0;
+}
+
+int ctl_rcrc(void)
+{
+	usbPutU32(usbtxbuf,flags.crc);
+	usb_ctl_read_end(4,usbtxbuf);
+	return 0;
+}
+
+// Generated: byte n of the data is n modulo 256.
+static int ctli_gen(u16 ofs, u16 len, usb_data_t *buf)
+{
+	u16 i;
+
+	for (i=0;i<len;i+=2)
+		*buf++=(((ofs+i)&0xff)<<8)|((ofs+i+1)&0xff);
+	return len;
+}
+
+int ctl_ctli(void)
+{
+	usb_ctl_read_gen(usb_setup.len,ctli_gen);
+	return 0;
+}
+
+// The stream counters are not read under interrupt; the SWI replies.
+int ctl_rstr(void)
+{
+	flags.rstr=1;
+	SWI_post(&swi_ctl);
+	return 0;
+}
+
+static void reply_rstr(void)
+{
+	usb_stream_t *s;
+
+	s=usb_setup.value?&stri:&stro;
+	usbPutU32(usbtxbuf,s->blocks);
+	usbPutU32(usbtxbuf+2,s->maxlevel);
+	usbPutU16(usbtxbuf+4,s->full);
+	usb_ctl_read_end(10,usbtxbuf);
 }
 
 void handle_ctl(void)
 {
-	int err;
-	
-	err=usb_ctl_std();
-	if (!err) {
-		if (usb_setup.dataDir)
-			ctl_read();
-		else
-			ctl_write();
-	}
+	if (flags.rstr) {
+		flags.rstr=0;
+		reply_rstr();
+	} else if (!usb_ctl_std())
+		usb_ctl_stall();
 }
 
 void usb_ctl(void)
@@ -367,6 +657,7 @@ void main(void)
 	flags.test_stat=STAT_IDLE;
 	flags.lastbuf=0;
 	flags.timeout=0;
+	flags.rstr=0;
 	flags.err=0;
 	led_showchar('i');
 	//usb_set_state_cb(state);
@@ -7,8 +7,8 @@
 */
 
 /*
-   Generated by usbdescgen 0.5.0a
-   from test.usbconfig on Mon Nov 28 10:57:07 2005
+   Generated by usbdescgen 0.1.0
+   from test.usbconfig on Sat Oct 17 19:40:56 2026
 */
 
 #include "usbconfig.h"
@@ -57,6 +57,12 @@ static const usb_data_t config1[17]={
 	0x0001
 };
 
+static const usb_data_t *config_descs[1]={
+	config1
+};
+
+static const usb_data_t **cur_config_descs=(const usb_data_t **)config_descs;
+
 static const unsigned int iface_counts[1]={
 	1
 };
@@ -65,6 +71,16 @@ static const unsigned int config_features[1]={
 	1
 };
 
+static const u8 alt_counts1[1]={
+	1
+};
+
+static const u8 *alt_counts[1]={
+	alt_counts1
+};
+
+u8 usb_iface_alt[USB_MAX_IFACES];
+
 static const usb_data_t device_desc[10]={
 	0x0012, 0x1201, 0x0101, 0x0000,
 	0x0040, 0xFFFF, 0x0000, 0x0000,
@@ -73,34 +89,148 @@ static const usb_data_t device_desc[10]={
 
 usb_endpoint_data_t epout1_data;
 
+static usb_req_t epout1_queue[2];
+
 static const usb_endpoint_t epout1={
 	1,
 	USB_EPTYPE_BULK,
 	64,
 	&epout1_data,
 	0,
+	(usb_endpoint_t *)(0),
+	epout1_queue,
+	2,
+	0,
+	0,
+	0,
+	0,
+	0,
 	0
 };
 
 usb_endpoint_data_t epin1_data;
 
+static usb_req_t epin1_queue[2];
+
 static const usb_endpoint_t epin1={
 	17,
 	USB_EPTYPE_BULK,
 	64,
 	&epin1_data,
 	0,
-	(usb_endpoint_t *)(&epout1)
+	(usb_endpoint_t *)(&epout1),
+	epin1_queue,
+	2,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0
 };
 
-static const usb_endpoint_t *endpoints[32]={
+static const usb_endpoint_t *endpoints1[32]={
 	0, &epout1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, &epin1, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-static const usb_endpoint_t *first_endpoint=&epin1;
+static const usb_endpoint_t *no_endpoints[32]={
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0
+};
 
-usb_data_t usb_ctl_write_data[16];
+static const usb_endpoint_t **ep_tables[2]={
+	no_endpoints, endpoints1
+};
+
+const usb_endpoint_t **usb_ep_table=no_endpoints;
+
+static const usb_endpoint_t *first_endpoints[2]={
+	0, &epin1
+};
+
+/* Endpoint buffer RAM plan (3584 bytes, 16-byte aligned; offsets from 
+   the start of buffer RAM, sizes per buffer)
+
+   Configuration 1:
+	epin1        bulk         X 0x0000  Y 0x0040   64
+	epout1       bulk         X 0x0080  Y 0x00c0   64
+	256 bytes used, 3328 free
+*/
+
+USB_POOL_STATIC(testpool,4096,2);
+
+int ctl_wvar(void);
+int ctl_rvar(void);
+int ctl_blki(void);
+int ctl_blko(void);
+int ctl_stat(void);
+int ctl_rcrc(void);
+int ctl_tmoi(void);
+int ctl_stro(void);
+int ctl_rstr(void);
+int ctl_stri(void);
+int ctl_ctlo(void);
+int ctl_ctli(void);
+
+usb_ctl_stat_t usb_ctl_stat[USB_CTL_HANDLERS];
+
+static const usb_ctl_entry_t ctl_entries0[13]={
+	{ctl_wvar,usb_ctl_stat+0,0},
+	{ctl_rvar,usb_ctl_stat+1,0},
+	{ctl_blki,usb_ctl_stat+2,0},
+	{ctl_blko,usb_ctl_stat+3,0},
+	{ctl_stat,usb_ctl_stat+4,0},
+	{ctl_rcrc,usb_ctl_stat+5,0},
+	{ctl_tmoi,usb_ctl_stat+6,0},
+	{0,0,0},
+	{ctl_stro,usb_ctl_stat+7,0},
+	{ctl_rstr,usb_ctl_stat+8,0},
+	{ctl_stri,usb_ctl_stat+9,0},
+	{ctl_ctlo,usb_ctl_stat+10,1},
+	{ctl_ctli,usb_ctl_stat+11,0}
+};
+
+static const usb_ctl_table_t ctl_tables[1]={
+	{1,13,ctl_entries0}
+};
+
+/* 0 for none, else 1 + index into ctl_tables */
+static const u8 ctl_slots[2][34]={
+	{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
+	{0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
+};
+
+const usb_ctl_entry_t *usb_ctl_find(unsigned int type, unsigned int recipient, unsigned int index, unsigned int request)
+{
+	const usb_ctl_table_t *t;
+	unsigned int n;
+
+	if (type<1||type>2) return 0;
+	switch (recipient) {
+	case 0:
+		n=0;
+		break;
+	case 1:
+		n=index&0xff;
+		if (n>=USB_MAX_IFACES) return 0;
+		n+=1;
+		break;
+	case 2:
+		n=1+USB_MAX_IFACES+(index&0x0f)+((index&0x80)>>3);
+		break;
+	default:
+		return 0;
+	}
+	n=ctl_slots[type-1][n];
+	if (!n) return 0;
+	t=ctl_tables+n-1;
+	request-=t->first;
+	if (request>=t->count||!t->entries[request].handler) return 0;
+	return t->entries+request;
+}
+
+usb_data_t usb_ctl_write_data[32];
 
 static int get_len(usb_data_t *bytes)
 {
@@ -118,28 +248,47 @@ int usb_get_config_desc(unsigned int index, usb_data_t **bytes, int *len)
 	usb_data_t *data;
 
 	if (index>=CONFIG_DESC_COUNT) return -1;
-	data=(usb_data_t *)config1;
+	data=(usb_data_t *)cur_config_descs[index];
 	*len=get_len(data);
 	*bytes=data+1;
 	return 0;
 }
 
+int usb_get_other_speed_desc(unsigned int index, usb_data_t **bytes, int *len)
+{
+	return -1;
+}
+
+int usb_get_qualifier_desc(usb_data_t **bytes, int *len)
+{
+	return -1;
+}
+
+void usb_select_speed(int high)
+{
+}
+
 usb_endpoint_t *usb_get_ep(unsigned int config, unsigned int ep)
 {
-	if (!usb_have_config(config)) return 0;
+	if (config>CONFIG_DESC_COUNT) return 0;
 	if (ep>31) return 0;
-	return (usb_endpoint_t *)(endpoints[ep]);
+	return (usb_endpoint_t *)(ep_tables[config][ep]);
+}
+
+void usb_select_ep_table(unsigned int config)
+{
+	usb_ep_table=usb_have_config(config)?ep_tables[config]:no_endpoints;
 }
 
 usb_endpoint_t *usb_get_first_ep(unsigned int config)
 {
-	if (!usb_have_config(config)) return 0;
-	return (usb_endpoint_t *)first_endpoint;
+	if (config>CONFIG_DESC_COUNT) return 0;
+	return (usb_endpoint_t *)first_endpoints[config];
 }
 
 int usb_have_config(unsigned int config)
 {
-	if (config>CONFIG_DESC_COUNT) return 0;
+	if (!config||config>CONFIG_DESC_COUNT) return 0;
 	return 1;
 }
 
@@ -152,7 +301,13 @@ int usb_config_features(unsigned int config)
 int usb_have_iface(unsigned int config, unsigned int iface)
 {
 	if (!usb_have_config(config)) return 0;
-	return (iface>iface_counts[config-1])?0:1;
+	return (iface>=iface_counts[config-1])?0:1;
+}
+
+int usb_alt_count(unsigned int config, unsigned int iface)
+{
+	if (!usb_have_iface(config,iface)) return 0;
+	return alt_counts[config-1][iface];
 }
 
 int usb_get_string_desc(unsigned int index, unsigned short langid, usb_data_t **bytes, int *len)
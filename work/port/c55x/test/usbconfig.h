@@ -10,32 +10,52 @@
 */
 
 /*
-   Generated by usbdescgen 0.5.0a
-   from test.usbconfig on Mon Nov 28 10:57:07 2005
+   Generated by usbdescgen 0.1.0
+   from test.usbconfig on Sat Oct 17 19:40:57 2026
 */
 
 typedef unsigned short usb_data_t;
 
 #define USB_BUF_LEN_SIZE 1
 #define USB_CTL_PACKET_SIZE 64
-#define USB_CTL_WRITE_BUF_SIZE 32
+#define USB_CTL_WRITE_BUF_SIZE 64
 #define usb_mem_len(l) ((l)>>1)
-#define usb_buf_len(buf) (buf[0])
-#define usb_buf_set_len(buf,len) buf[0]=len
-#define usb_buf_data(buf) (buf+1)
 
 #include "usbtypes.h"
 
 void usb_get_device_desc(usb_data_t **bytes, int *len);
 int usb_get_config_desc(unsigned int index, usb_data_t **bytes, int *len);
+/* other-speed configuration and device qualifier descriptors; -1 if the 
+device is not high-speed capable */
+int usb_get_other_speed_desc(unsigned int index, usb_data_t **bytes, int *len);
+int usb_get_qualifier_desc(usb_data_t **bytes, int *len);
+/* selects the descriptors for full (0) or high (1) speed */
+void usb_select_speed(int high);
 int usb_get_string_desc(unsigned int index, unsigned short langid, usb_data_t **bytes, int *len);
 int usb_have_config(unsigned int config);
 int usb_have_iface(unsigned int config, unsigned int iface);
+/* number of alternate settings of an interface, or 0 if there is no 
+such interface */
+int usb_alt_count(unsigned int config, unsigned int iface);
+/* current alternate setting of each interface, kept by the core */
+#define USB_MAX_IFACES 1
+extern u8 usb_iface_alt[USB_MAX_IFACES];
 usb_endpoint_t *usb_get_ep(unsigned int config, unsigned int ep);
+usb_endpoint_t *usb_get_first_ep(unsigned int config);
 /* bit 0: self powered; bit 1: remote wakeup */
 int usb_config_features(unsigned int config);
+/* endpoint table of the current configuration, set by the core */
+extern const usb_endpoint_t **usb_ep_table;
+void usb_select_ep_table(unsigned int config);
+/* endpoint EPN (0-31) of the current configuration, or 0; EPN is not 
+checked, so this is cheap enough for interrupt service routines */
+#define usb_cur_ep(EPN) ((usb_endpoint_t *)usb_ep_table[EPN])
 void usb_set_serial_number(usb_data_t *bytes);
-usb_endpoint_t *usb_get_first_ep(unsigned int config);
+extern usb_pool_t testpool;
+/* control request handlers; see usb_ctl_find() */
+#define USB_CTL_HANDLERS 12
+extern usb_ctl_stat_t usb_ctl_stat[USB_CTL_HANDLERS];
+const usb_ctl_entry_t *usb_ctl_find(unsigned int type, unsigned int recipient, unsigned int index, unsigned int request);
 
 #endif
 
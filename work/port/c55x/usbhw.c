@@ -136,16 +136,6 @@ static void sys_free(void *mem)
 
 /* timeouts -------------------- */
 
-static void update_check_time(usb_endpoint_t *ep)
-{
-	ep->data->check_time=CLK_getltime();
-}
-
-static u32 ticks_to_ms(u32 ticks)
-{
-	return params.us_per_prd_tick*ticks/1000;
-}
-
 static u32 ms_to_ticks(u32 ms)
 {
 	return (ms*1000)/params.us_per_prd_tick;
@@ -153,19 +143,23 @@ static u32 ms_to_ticks(u32 ms)
 
 //static u8 lastled;
 
+static u32 lasttick, tick_us;
+
+/* feeds the core's timeout clock with the time since the last call; 
+the part of a millisecond left over is carried to the next call */
 void usbhw_check_timeouts(void)
 {
-	usb_endpoint_t *ep;
+#ifndef USB_TIMEOUT_SOF
 	u32 curtime=CLK_getltime();
-
-	ep=usb_get_first_ep(usb_get_config());
-	while (ep) {
-		if (ep->data->stat==USB_EPSTAT_XFER) {
-			if (ticks_to_ms(curtime-ep->data->check_time)>ep->data->timeout)
-				usb_evt_timeout(ep);
-		}
-		ep=ep->next;
-	}
+	u32 ms;
+
+	tick_us+=(curtime-lasttick)*params.us_per_prd_tick;
+	lasttick=curtime;
+	ms=tick_us/1000;
+	if (!ms) return;
+	tick_us-=ms*1000;
+	usb_evt_tick(ms>0xffff?0xffff:ms);
+#endif
 #if 0
 	++lastled;
 	if (lastled>99) lastled=0;
@@ -174,6 +168,17 @@ void usbhw_check_timeouts(void)
 #endif
 }
 
+/* the fine clock is the DSP/BIOS high-resolution time */
+u32 usbhw_clock(void)
+{
+	return CLK_gethtime();
+}
+
+u32 usbhw_clock_khz(void)
+{
+	return (u32)CLK_countspms();
+}
+
 /* alarm clock ----------------- */
 
 usb_alarm_t *usbhw_mkalarm(void)
@@ -208,13 +213,20 @@ void usbhw_wake(usb_alarm_t *alarm)
 
 /* ------------------------------- */
 
+/* usbhw_int_dis() and usbhw_int_en() nest: callbacks submit and cancel 
+with the core's lock held, so only the outermost pair touches IER0 */
+static int int_depth;
+
 void usbhw_int_dis(void)
 {
 	C55_disableIER0(C55_IEN08);
+	++int_depth;
 }
 
 void usbhw_int_en(void)
 {
+	if (int_depth&&--int_depth)
+		return;
 	C55_enableIER0(C55_IEN08);
 }
 
@@ -327,37 +339,43 @@ int usbhw_get_setup(usb_setup_t *s)
 	return 0;
 }
 
+/* The EP0 buffers are byte-wide registers, one per I/O word, and control 
+data is packed two bytes to a word, high byte first (as usbgen packs the 
+descriptors).  The copies below split or join a whole word per step. */
 void usbhw_put_ctl_read_data(u8 len, usb_data_t *d)
 {
-	int i;
-	
-	for (i=0;i<len;++i) {
-		if (i&1)
-			USBBUFIN0(i)=d[i>>1];
-		else
-			USBBUFIN0(i)=d[i>>1]>>8;
+	IOTYPE p=&USBBUFIN0(0);
+	u8 n;
+
+	for (n=len>>1;n;--n) {
+		p[0]=*d>>8;
+		p[1]=*d++&0xff;
+		p+=2;
 	}
+	if (len&1)
+		*p=*d>>8;
 	USBICT0=len;
 }
 
 int usbhw_get_ctl_write_data(u8 *len, usb_data_t *d, int last)
 {
-	int i;
+	IOTYPE p=&USBBUFOUT0(0);
+	u8 n;
 
 	if (!*len) {
 		USBOCT0=0;
 		return 0;
 	}
-	if (*len>USBOCT0&USBOCT0_COUNT) {
+	if (*len>(USBOCT0&USBOCT0_COUNT)) {
 		return -1;
 	}
 	*len=USBOCT0&USBOCT0_COUNT;
-	for (i=0;i<*len;++i) {
-		if (i&1)
-			d[i>>1]|=USBBUFOUT0(i);
-		else
-			d[i>>1]=USBBUFOUT0(i)<<8;
+	for (n=*len>>1;n;--n) {
+		*d++=(p[0]<<8)|p[1];
+		p+=2;
 	}
+	if (*len&1)
+		*d=*p<<8;
 	if (last) {
 		USBCTL|=USBCTL_DIR;
 	} else {
@@ -438,69 +456,149 @@ static void dmaGo(int epn, u32 data, u16 len, int chain)
 	//showtoggle();
 }
 
-#define RXTX(CHAIN) \
-	if (ep->data->stat!=USB_EPSTAT_IDLE) return -1;\
-	update_check_time(ep);\
-	ep->data->buf=data;\
-	ep->data->reqlen=len;\
-	ep->data->actlen=0;\
-	usb_set_epstat(ep,USB_EPSTAT_XFER); \
-	dmaGo(ep->id,(u32)(data)<<1,len,CHAIN)
+/* dma reload ------------------ */
+
+/* The core hands us up to two requests per endpoint (USBHW_MAX_REQS).  
+The first one runs on the DMA and is described by ep->data->buf/reqlen/actlen.  
+The second one waits in rld[], and is also programmed into the DMA reload 
+registers if the first one is still running.  The hardware then switches 
+buffers by itself and gives us a reload interrupt, where we retire the 
+first request and let the core hand us the next.
+
+If the first transfer ends before RLD could be set, or the two requests 
+disagree about short packet handling (which is a DMA control bit, not a 
+reload register), the second one is started from the go interrupt instead.
+
+indexed by hardware endpoint no. 0-15 */
+typedef struct dma_rld_t {
+	usb_data_t *buf;
+	u16 len;
+	u8 chain;
+} dma_rld_t;
+
+static dma_rld_t rld[16];
+static u8 nreqs[16]; // requests held, 0-2
+static u8 curchain[16]; // chain flag of the running request
+
+static void start_req(usb_endpoint_t *ep, int epn, usb_data_t *data, u16 len, int chain)
+{
+	ep->data->buf=data;
+	ep->data->reqlen=len;
+	ep->data->actlen=0;
+	curchain[epn]=chain;
+	dmaGo(ep->id,(u32)(data)<<1,len,chain);
+}
+
+static int rxtx(usb_endpoint_t *ep, usb_data_t *data, u16 len, int chain)
+{
+	int epn=ep->id;
+	u32 adr=(u32)(data)<<1;
+
+	if (epn>15) epn-=8;
+	if (nreqs[epn]>=USBHW_MAX_REQS)
+		return -1;
+	if (!nreqs[epn]) {
+		start_req(ep,epn,data,len,chain);
+	} else {
+		rld[epn].buf=data;
+		rld[epn].len=len;
+		rld[epn].chain=chain;
+		if (chain==curchain[epn]&&(USBODCTL(epn)&USBODCTL_GO)) {
+			USBODRAL(epn)=adr&0xffff;
+			USBODRAH(epn)=(adr>>16)&0xff;
+			USBODRSZ(epn)=len;
+			USBODCTL(epn)|=USBODCTL_RLD;
+		}
+	}
+	++nreqs[epn];
+	return 0;
+}
 
 int usbhw_tx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
 {
-	RXTX(0);
-	//if (toggleok) { showtoggle(); toggleok=0; }
-	return 0;	
+	return rxtx(ep,data,len,0);
 }
 
 int usbhw_rx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
 {
-	RXTX(0);
-	return 0;
+	return rxtx(ep,data,len,0);
 }
 
 int usbhw_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
 {
-	RXTX(1);
-	return 0;
+	return rxtx(ep,data,len,1);
 }
 
 int usbhw_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
 {
-	RXTX(1);
-	return 0;
+	return rxtx(ep,data,len,1);
 }
 
-#undef RXTX
+/* the hardware has moved on to the reload buffer: retire the first request.  
+The transfer count register now belongs to the new buffer, so the length 
+comes from the request (IN) or from the length word the DMA wrote at the 
+start of the buffer (OUT). */
+static void isrReload(usb_endpoint_t *ep, int epn)
+{
+	usb_data_t *buf=ep->data->buf;
+	u16 len;
 
-static void isrDMA(int epn, int rld)
+	if (ep->data->stat!=USB_EPSTAT_XFER&&ep->data->stat!=USB_EPSTAT_STALLED)
+		return;
+	if (nreqs[epn]<2)
+		return;
+	if (ep->id&16)
+		len=ep->data->reqlen;
+	else
+		len=*buf;
+	ep->data->buf=rld[epn].buf;
+	ep->data->reqlen=rld[epn].len;
+	ep->data->actlen=0;
+	curchain[epn]=rld[epn].chain;
+	--nreqs[epn];
+	usb_evt_done(ep,buf,len,USB_EVT_READY);
+}
+
+/* DMA and endpoint interrupts number the slots 0-7 for OUT and 8-15 for 
+IN; the endpoint id is the slot plus 8 for IN. */
+#define slot_ep(S) usb_cur_ep((S)+((S)&8))
+
+static void isrDMA(int epn, int reload)
 {
 	usb_endpoint_t *ep;
+	usb_data_t *buf;
+	u16 len;
+	u8 evt;
 	//volatile u16 x,y;
 	//usb_packet_req_t *pkt;
 
-	ep=usb_get_ep(usb_get_config(),epn);
+	ep=slot_ep(epn);
 	if (!ep) return;
-	if (epn>15) epn-=8;
+	if (reload) {
+		isrReload(ep,epn);
+		return;
+	}
 	ep->data->actlen+=USBODCT(epn);
 	//usbhw_dmalog_write(USBHW_DMALOG_ISRDMA,epn);
 	// we get an interrupt even on timeout, so we need to check this
 	// (this is good b/c we can use this to detect a completed cancellation)
-	if (ep->data->stat==USB_EPSTAT_CANCELLING) {
-		usb_set_epstat(ep,USB_EPSTAT_IDLE);
-		usb_evt_done(ep,ep->data->buf,ep->data->actlen,USB_EVT_CANCELLED);
-		return;
-	}
-	if (ep->data->stat==USB_EPSTAT_TIMING_OUT) {
-		usb_set_epstat(ep,USB_EPSTAT_IDLE);
-		usb_evt_done(ep,ep->data->buf,ep->data->actlen,USB_EVT_TIMEOUT);
-		return;
-	}
 	// can't use timed_out because sometimes it gets cleared before 
 	// we get the interrupt
-	if (usb_get_epstat(ep)!=USB_EPSTAT_XFER) return;
-	update_check_time(ep);
+	switch (ep->data->stat) {
+	case USB_EPSTAT_CANCELLING:
+		evt=USB_EVT_CANCELLED;
+		break;
+	case USB_EPSTAT_TIMING_OUT:
+		evt=USB_EVT_TIMEOUT;
+		break;
+	case USB_EPSTAT_XFER:
+	case USB_EPSTAT_STALLED: // finished just as it was stalled
+		evt=USB_EVT_READY;
+		break;
+	default:
+		nreqs[epn]=0;
+		return;
+	}
 	//pkt=(usb_packet_req_t *)(ep->data->hwdata);
 	//pkt->done=1;
 	//txpkt->actlen=txpkt->reqlen;
@@ -508,20 +606,29 @@ static void isrDMA(int epn, int rld)
 	//ep->data->actlen+=USBODCT(epn);
 	//x=USBISIZ(epn);
 	//y=USBICTY(epn);
-	usb_set_epstat(ep,USB_EPSTAT_IDLE);
-	usb_evt_done(ep,ep->data->buf,ep->data->actlen,USB_EVT_READY);
+	buf=ep->data->buf;
+	len=ep->data->actlen;
+	if (evt!=USB_EVT_READY) {
+		// the core retires whatever else we were holding
+		nreqs[epn]=0;
+	} else if (nreqs[epn]&&--nreqs[epn]) {
+		// the second request missed the reload; start it by hand
+		USBODCTL(epn)&=~USBODCTL_RLD;
+		start_req(ep,epn,rld[epn].buf,rld[epn].len,rld[epn].chain);
+	}
+	usb_evt_done(ep,buf,len,evt);
 	//if (epn>8) { showtoggle(); }
 }
 
-// all we do here is update the timeout
+// all we do here is push back the timeout
 static void isrEP(int epn)
 {
 	usb_endpoint_t *ep;
 
-	if (epn>8) epn+=8;
-	ep=usb_get_ep(usb_get_config(),epn);
+	ep=slot_ep(epn);
 	if (!ep) return;
-	update_check_time(ep);
+	if (ep->data->armed)
+		usb_timer_arm(ep);
 }
 
 interrupt void usbhw_isr(void)
@@ -578,21 +685,8 @@ interrupt void usbhw_isr(void)
 		//	return; // spurious
 		//}
 		src-=0x30;
-		if (src&1) { // go
-			src>>=1;
-			if (src<8)
-				isrDMA(src,0);
-			else
-				isrDMA(src+8,0);
-		}
-#if 0
-		else { // reload
-			src>>=1;
-			if (src<8) { ; //isrDMAOUT(src,1);
-			}
-			else isrDMA(src+8,1);
-		}
-#endif
+		// odd is go, even is reload
+		isrDMA(src>>1,!(src&1));
 	}
 	//usb_unlock();
 }
@@ -733,45 +827,83 @@ static u16 usbhw_get_ep_buf_ofs(u8 epn)
 }
 #endif
 
-/* Sets the buffer base addresses and sizes for the X and Y buffers for 
-the given endpoint.  The address is a byte address and is relative 
-to the base address of the USB module.  The first usable address 
-is therefore 0x80.
+/* Endpoint buffer RAM, in bytes from the base of the USB module.  The 
+DMA registers lie below it. */
+#define BUF_RAM_START 0x80
+#define BUF_RAM_END 0xe80
 
-Packet size is taken from ep->packetSize.  If the endpoint is isochronous, 
-SIZH is written; otherwise only SIZ is written.
+/* Sets the packet size registers for the given endpoint.  Packet size 
+is taken from ep->data->maxpkt, the size in the current alternate 
+setting.  If the endpoint is isochronous, SIZH is written; otherwise 
+only SIZ is written.
 */
-static void set_ep_hwbuf(usb_endpoint_t *ep, u16 ofs)
+static void set_ep_size(usb_endpoint_t *ep, int epn)
 {
-	int epn=ep->id;
+	u16 size=ep->data->maxpkt;
 
-	if (epn>=16) epn-=8;
-	USBIBAX(epn)=(u8)(ofs>>4);
-	USBIBAY(epn)=(u8)((ofs+64)>>4);
-	USBISIZ(epn)=ep->packetSize&0x7f;
+	USBISIZ(epn)=size&0x7f;
 	if (ep->type==USB_EPTYPE_ISOCHRONOUS) {
 		if (epn<8)
-			USBOCNF(epn)=(USBOCNF(epn)&0xf8)|((ep->packetSize>>7)&7);
+			USBOCNF(epn)=(USBOCNF(epn)&0xf8)|((size>>7)&7);
 		else
-			USBOCNF(epn)=(ep->packetSize>>7)&7;
+			USBOCNF(epn)=(size>>7)&7;
 	}
 }
 
-static int alloc_ep_buffers(int conf)
+/* Sets the buffer base addresses of the X and Y buffers for the given 
+endpoint, and its packet size.  The addresses are byte addresses 
+relative to the base address of the USB module, and must be multiples 
+of 16.
+*/
+static void set_ep_hwbuf(usb_endpoint_t *ep, u16 x, u16 y)
 {
-	u16 ofs;
+	int epn=ep->id;
+
+	if (epn>=16) epn-=8;
+	USBIBAX(epn)=(u8)(x>>4);
+	USBIBAY(epn)=(u8)(y>>4);
+	set_ep_size(ep,epn);
+}
+
+/* Lays out the X and Y buffers of a configuration's endpoints in buffer 
+RAM, in endpoint list order.  Each buffer is ep->packetSize (the largest 
+size in any alternate setting, so buffers never move when the host 
+changes settings) rounded up to the 16 bytes the base address registers 
+can address.  Interrupt endpoints are single buffered, and use X only; 
+bulk and isochronous endpoints get X and Y.  Since the whole layout is 
+made at once, nothing is lost but the rounding.
+
+usbgen makes the same plan, and reports it in the generated source, if 
+the bufferRam option is set.
+
+If apply is nonzero, the hardware is programmed.  Returns the number of 
+bytes left over, or -1 if the endpoints do not fit.
+*/
+static int plan_ep_buffers(int conf, int apply)
+{
+	u16 ofs,size;
 	usb_endpoint_t *ep;
 
-	ofs=0x80;
-	ep=usb_get_first_ep(conf);
-	while (ep) {
-		if (ofs+ep->packetSize*2>=0xe80)
-			return -1;
-		set_ep_hwbuf(ep,ofs);
-		ofs+=ep->packetSize*2;
-		ep=ep->next;
+	ofs=BUF_RAM_START;
+	for (ep=usb_get_first_ep(conf);ep;ep=ep->next) {
+		size=(ep->packetSize+15)&~15;
+		if (ep->type==USB_EPTYPE_INTERRUPT) {
+			if (ofs+size>BUF_RAM_END) return -1;
+			if (apply) set_ep_hwbuf(ep,ofs,ofs);
+			ofs+=size;
+		} else {
+			if (ofs+2*size>BUF_RAM_END) return -1;
+			if (apply) set_ep_hwbuf(ep,ofs,ofs+size);
+			ofs+=2*size;
+		}
 	}
-	return 0;
+	return BUF_RAM_END-ofs;
+}
+
+int c55x_buf_free(int cnf)
+{
+	if (!usb_have_config(cnf)) return -1;
+	return plan_ep_buffers(cnf,0);
 }
 
 static int activate_ep(usb_endpoint_t *ep)
@@ -787,12 +919,13 @@ static int activate_ep(usb_endpoint_t *ep)
 	pkt->done=1;*/
 	if (ep->type==USB_EPTYPE_ISOCHRONOUS) {
 		USBICNF(epn)|=USBICNF_ISO;
-	} else {
+	} else if (ep->type!=USB_EPTYPE_INTERRUPT) {
 		USBICNF(epn)|=USBICNF_DBUF;
 	}
 	USBICTX(epn)=USBICTX_NAK;
 	USBICTY(epn)=USBICTY_NAK;
 	USBIDCTL(epn)=0;
+	nreqs[epn]=0;
 	USBIDADH(epn)=0;
 	USBIDADL(epn)=0;
 	USBIDSIZ(epn)=0;
@@ -811,11 +944,12 @@ int usbhw_activate_eps(int cnf)
 
 	ep=usb_get_first_ep(cnf);
 	while (ep) {
-		if (activate_ep(ep))
+		// endpoints outside alternate setting 0 get buffers but stay off
+		if (ep->data->maxpkt&&activate_ep(ep))
 			return -1;
 		ep=ep->next;
 	}
-	if (alloc_ep_buffers(cnf))
+	if (plan_ep_buffers(cnf,1)<0)
 		return -1;
 	return 0;
 }
@@ -838,6 +972,21 @@ void usbhw_deactivate_eps(int cnf)
 	}
 }
 
+int usbhw_set_ep_alt(usb_endpoint_t *ep)
+{
+	int epn=ep->id;
+
+	usbhw_cancel(ep);
+	if (epn>15) epn-=8;
+	USBICNF(epn)=0;
+	nreqs[epn]=0;
+	// activate_ep() clears the config register, so sizes go in after
+	if (ep->data->maxpkt&&activate_ep(ep))
+		return -1;
+	set_ep_size(ep,epn);
+	return 0;
+}
+
 //### TODO: support APLL on 5507 / 5509A
 static void usbhw_init_pll()
 {
@@ -885,6 +1034,8 @@ int usbhw_init(void *param)
 {
 	if (!param) return -1;
 	params=*(struct c55x_params *)param;
+	lasttick=CLK_getltime();
+	tick_us=0;
 	usbhw_init_pll();
 
 #ifdef USBHW_DMALOG
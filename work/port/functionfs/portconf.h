@@ -0,0 +1,111 @@
+// :wrap=soft:
+
+/* port/functionfs/portconf.h -- configuration header for the FunctionFS port */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_portconf_h
+#define GUARD_portconf_h
+
+/*! Define this if the port supports timeouts */
+#define USBHW_HAVE_TIMEOUT
+
+/*! Define this if the port has a fine clock (usbhw_clock()) */
+#define USBHW_HAVE_CLOCK
+
+/*! Define this if the hardware can attach / deattach from the bus */
+#define USBHW_HAVE_ATTACH
+
+/*! Defined if the hardware has a pre-SOF interrupt */
+#define USBHW_HAVE_PRESOF
+
+/*! Number of requests the port can hold per endpoint (all of them submitted to the kernel at once) */
+#define USBHW_MAX_REQS 4
+
+//! FunctionFS parameters
+/*! This structure is used to initialise the FunctionFS port. */
+struct functionfs_params {
+	//! FunctionFS mount point
+	/*! The directory where the function's instance of functionfs is mounted, such as "/dev/usb-ffs/porus".  ep0 is opened there by usb_attach(). */
+	const char *path;
+};
+
+typedef struct functionfs_params functionfs_params;
+
+/*! \defgroup port_functionfs
+
+This port runs the core and the application as an ordinary Linux process on a machine with a USB device controller, through the kernel's FunctionFS gadget function.  The device is one function of a gadget put together in configfs; the kernel answers the standard requests, and the port sees the rest.  On a machine without a device controller, the dummy_hcd module provides a loopback one, and the device appears on the same machine's host side.  See port/functionfs/test.
+
+\section usb_init() parameters
+
+The struct functionfs_params must be passed to usb_init().  See functionfs_params.
+
+\section Setup
+
+usb_attach() opens ep0, writes the full- and (for a high-speed configuration) high-speed descriptors of configuration 1 to it, without the configuration descriptor itself, and writes the strings they refer to.  The epN files then appear, and are opened.  The gadget may then be bound to a device controller, by writing the controller's name to its UDC file in configfs.  usb_detach() closes everything, which unbinds it.
+
+\section Event loop
+
+There are no interrupts.  The application calls functionfs_poll(), which waits for ep0, the I/O completions and the 1 ms timer, handles everything that has arrived, and submits the requests the callbacks have made.  Everything the core would do under interrupt is done inside functionfs_poll(), so callbacks run there, and usbhw_int_dis() and usbhw_int_en() do nothing.  functionfs_fd() gives the epoll descriptor, so that the loop can be nested in another.
+
+Requests made outside functionfs_poll() are submitted by the next call.  usb_move_wait() and other blocking calls run the loop themselves while they wait.
+
+\section Implementation notes
+
+Endpoint requests use the kernel's asynchronous I/O (io_submit()), which FunctionFS supports directly: each request the core hands the port becomes an iocb on the endpoint's file, and all the iocbs made in one turn of the loop are submitted with one system call.  Up to USBHW_MAX_REQS requests per endpoint are with the kernel at once, so an endpoint with a queue depth of USBHW_MAX_REQS streams without gaps.  Completions are signalled on an eventfd and collected in batches.
+
+Data is not copied in user space: the kernel reads and writes the application's buffers.
+
+The kernel ends every OUT transfer at a short packet, so a short packet ends usb_rx() requests as well as usb_rx_chain() ones.  A chained IN request whose length is a multiple of the packet size is followed by a zero-length write.
+
+The kernel takes SET_CONFIGURATION, SET_INTERFACE and SET_ADDRESS for itself.  When it enables the function, the port resets the device and runs SET_ADDRESS and SET_CONFIGURATION(1) itself, and reads the bus speed from the endpoint descriptors the kernel chose.  Only configuration 1 and alternate setting 0 of each interface are used.
+
+The data of a control write is read from ep0 when the core asks for it, so the core may still stall a request it will not take when the SETUP arrives; it cannot stall once it has taken the data.  Control reads are written to ep0 in one piece when the core has finished them.  ep0 is blocked while it does so.
+
+Halting an endpoint uses the usual FunctionFS trick of a transfer in the wrong direction.
+
+FunctionFS has no SOF.  SOF and pre-SOF come from the 1 ms timer, pre-SOF first, at high speed as at full speed.  Timeouts are clocked from the same timer, unless the configuration sets \c timeoutBase=sof.
+
+Only the u8 data format is supported.
+
+\section Test
+
+port/functionfs/test holds a bulk source and sink device, a script which sets up dummy_hcd and the gadget, and a host program which streams data to and from the device through usbfs and reports MB/s.
+*/
+
+//! Run the event loop once
+/*! Waits up to \p timeout_ms milliseconds (forever if negative) for ep0, the I/O completions or the timer, then handles everything which has arrived and submits the new requests.
+
+\return Number of events handled, or -1 if the device is not attached
+*/
+int functionfs_poll(int timeout_ms);
+
+//! Event loop descriptor
+/*! The epoll descriptor which functionfs_poll() waits on, or -1 before usb_init().  It becomes readable when functionfs_poll() has work to do. */
+int functionfs_fd(void);
+
+#endif
@@ -0,0 +1,58 @@
+#!/bin/sh
+# port/functionfs/test/gadget.sh -- runs the test device on dummy_hcd
+
+# Loads dummy_hcd, builds a gadget in configfs with one FunctionFS 
+# function, starts ./device on it, binds the gadget, and runs ./host with 
+# the arguments given.  Everything is taken down again afterwards.  Needs 
+# root.
+
+NAME=porus
+G=/sys/kernel/config/usb_gadget/$NAME
+FFS=/dev/usb-ffs/$NAME
+
+cleanup() {
+	[ -f $G/UDC ] && echo "" > $G/UDC 2>/dev/null
+	[ -n "$pid" ] && kill $pid 2>/dev/null && wait $pid 2>/dev/null
+	umount $FFS 2>/dev/null
+	rmdir $FFS 2>/dev/null
+	rm -f $G/configs/c.1/ffs.$NAME
+	rmdir $G/configs/c.1/strings/0x409 $G/configs/c.1 \
+		$G/functions/ffs.$NAME $G/strings/0x409 $G 2>/dev/null
+	rm -f "$fifo"
+}
+
+set -e
+trap cleanup EXIT
+modprobe libcomposite
+modprobe dummy_hcd
+mountpoint -q /sys/kernel/config || mount -t configfs none /sys/kernel/config
+
+mkdir $G
+echo 0xffff > $G/idVendor
+echo 0x0000 > $G/idProduct
+echo 0x0200 > $G/bcdUSB
+mkdir $G/strings/0x409
+echo "PORUS FunctionFS Test" > $G/strings/0x409/product
+mkdir $G/configs/c.1
+mkdir $G/configs/c.1/strings/0x409
+echo "Test" > $G/configs/c.1/strings/0x409/configuration
+mkdir $G/functions/ffs.$NAME
+ln -s $G/functions/ffs.$NAME $G/configs/c.1/
+mkdir -p $FFS
+mount -t functionfs $NAME $FFS
+
+# the descriptors must be written before the gadget can be bound
+fifo=$(mktemp -u)
+mkfifo "$fifo"
+./device $FFS > "$fifo" &
+pid=$!
+read line < "$fifo"
+[ "$line" = ready ]
+ls /sys/class/udc | grep dummy_udc | head -n 1 > $G/UDC
+
+# wait for the host side to enumerate it
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	./host -n 16384 >/dev/null 2>&1 && break
+	sleep 0.5
+done
+./host "$@"
@@ -0,0 +1,291 @@
+/* port/functionfs/test/host.c -- bulk throughput from the host side */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Finds the test device (main.c) on the host side, through usbfs, and 
+streams bulk data to and from it with a number of URBs in flight.  The 
+URBs which have completed are reaped and submitted again together.  
+Reports MB/s and the time from submission to completion of each URB, and 
+checks the data both ways.  Needs no library, only read and write access 
+to the device's file in /dev/bus/usb. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+#include <linux/usb/ch9.h>
+
+#define MAX_DEPTH 64
+#define BLOCK 16384 // as main.c
+
+static int fd;
+static unsigned char ep_in, ep_out;
+static unsigned long total=64ul<<20, urb_size=65536, depth=8;
+static unsigned long errors;
+
+/* byte i of the stream, as main.c makes it */
+static unsigned char pattern(unsigned long i)
+{
+	return (unsigned char)(i*7+(i>>9));
+}
+
+static double now_us(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec*1e6+t.tv_nsec/1e3;
+}
+
+static void fail(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* ------ Device */
+
+static unsigned long attr(const char *dev, const char *name, int base)
+{
+	char path[512],buf[32];
+	FILE *f;
+
+	snprintf(path,sizeof(path),"/sys/bus/usb/devices/%s/%s",dev,name);
+	f=fopen(path,"r");
+	if (!f) return ~0ul;
+	if (!fgets(buf,sizeof(buf),f)) buf[0]=0;
+	fclose(f);
+	return strtoul(buf,0,base);
+}
+
+/* opens the first device with the given IDs */
+static int find(unsigned vid, unsigned pid)
+{
+	char path[64];
+	struct dirent *d;
+	DIR *dir=opendir("/sys/bus/usb/devices");
+
+	if (!dir) return -1;
+	while ((d=readdir(dir)))
+		if (attr(d->d_name,"idVendor",16)==vid&&
+			attr(d->d_name,"idProduct",16)==pid) {
+			snprintf(path,sizeof(path),"/dev/bus/usb/%03lu/%03lu",
+				attr(d->d_name,"busnum",10),
+				attr(d->d_name,"devnum",10));
+			closedir(dir);
+			return open(path,O_RDWR);
+		}
+	closedir(dir);
+	return -1;
+}
+
+/* finds the bulk endpoints of interface 0, setting 0, in the descriptors 
+usbfs gives */
+static int find_eps(void)
+{
+	unsigned char d[4096];
+	int len=read(fd,d,sizeof(d)),i,iface=-1;
+
+	for (i=d[0];i+1<len&&d[i];i+=d[i]) {
+		if (d[i+1]==USB_DT_CONFIG&&iface>=0) break; // the first only
+		if (d[i+1]==USB_DT_INTERFACE)
+			iface=d[i+2]||d[i+3]?-2:0;
+		if (d[i+1]!=USB_DT_ENDPOINT||iface||(d[i+3]&3)!=USB_ENDPOINT_XFER_BULK)
+			continue;
+		if (d[i+2]&USB_DIR_IN) {
+			if (!ep_in) ep_in=d[i+2];
+		} else if (!ep_out)
+			ep_out=d[i+2];
+	}
+	return ep_in&&ep_out?0:-1;
+}
+
+/* ------ Streams */
+
+static double lat[1<<16];
+static unsigned long nlat;
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x=*(const double *)a,y=*(const double *)b;
+
+	return x<y?-1:x>y;
+}
+
+static void report(const char *name, double us)
+{
+	double sum=0;
+	unsigned long i;
+
+	qsort(lat,nlat,sizeof(*lat),cmp_double);
+	for (i=0;i<nlat;++i)
+		sum+=lat[i];
+	printf("%-4s %10lu %9.1f %8.2f %8.1f %8.1f %8.1f %8.1f\n",name,total,
+		us/1e3,total/us,lat[0],sum/nlat,lat[nlat*99/100],lat[nlat-1]);
+}
+
+/* Keeps depth URBs in flight until total bytes have moved.  OUT data is 
+the pattern; IN data is checked against it. */
+static void stream(int in)
+{
+	static struct usbdevfs_urb urbs[MAX_DEPTH];
+	struct usbdevfs_urb *u,*done[MAX_DEPTH];
+	unsigned char *buf,*p;
+	double sent[MAX_DEPTH],t0,t;
+	unsigned long ofs=0,got=0,len,i,free_urbs[MAX_DEPTH];
+	unsigned long nfree,inflight=0,ndone;
+	void *reaped;
+
+	buf=malloc(depth*urb_size);
+	if (!buf) fail("malloc");
+	for (nfree=0;nfree<depth;++nfree)
+		free_urbs[nfree]=nfree;
+	nlat=0;
+	t0=now_us();
+	for (;;) {
+		// submit every free URB
+		while (nfree&&ofs<total) {
+			i=free_urbs[--nfree];
+			u=urbs+i;
+			len=total-ofs<urb_size?total-ofs:urb_size;
+			memset(u,0,sizeof(*u));
+			u->type=USBDEVFS_URB_TYPE_BULK;
+			u->endpoint=in?ep_in:ep_out;
+			u->buffer=buf+i*urb_size;
+			u->buffer_length=len;
+			u->usercontext=(void *)i;
+			if (!in)
+				for (p=u->buffer;len--;++ofs)
+					*p++=pattern(ofs);
+			else
+				ofs+=len;
+			sent[i]=now_us();
+			if (ioctl(fd,USBDEVFS_SUBMITURB,u)) fail("submit");
+			++inflight;
+		}
+		if (!inflight) break;
+		// wait for one, then take every other which has finished
+		ndone=0;
+		if (ioctl(fd,USBDEVFS_REAPURB,&reaped)) fail("reap");
+		done[ndone++]=reaped;
+		while (ndone<inflight&&!ioctl(fd,USBDEVFS_REAPURBNDELAY,&reaped))
+			done[ndone++]=reaped;
+		t=now_us();
+		// URBs on one endpoint complete in the order they were 
+		// submitted, which is that of the data
+		for (i=0;i<ndone;++i) {
+			u=done[i];
+			if (u->status) {
+				fprintf(stderr,"urb: status %d\n",u->status);
+				exit(1);
+			}
+			if (nlat<sizeof(lat)/sizeof(*lat))
+				lat[nlat++]=t-sent[(unsigned long)u->usercontext];
+			if (in)
+				for (len=0;len<(unsigned long)u->actual_length;++len)
+					if (((unsigned char *)u->buffer)[len]!=pattern(got+len))
+						++errors;
+			got+=u->actual_length;
+			free_urbs[nfree++]=(unsigned long)u->usercontext;
+			--inflight;
+		}
+	}
+	t=now_us()-t0;
+	free(buf);
+	if (got!=total) {
+		fprintf(stderr,"%s: %lu of %lu bytes\n",in?"in":"out",got,total);
+		++errors;
+	}
+	report(in?"in":"out",t);
+}
+
+int main(int argc, char **argv)
+{
+	struct usbdevfs_ctrltransfer ct;
+	unsigned vid=0xffff,pid=0;
+	unsigned char d[8];
+	unsigned long got,bad;
+	int c,r,cfg=1,iface=0;
+
+	while ((c=getopt(argc,argv,"v:p:n:s:q:"))!=-1)
+		switch (c) {
+		case 'v': vid=strtoul(optarg,0,16); break;
+		case 'p': pid=strtoul(optarg,0,16); break;
+		case 'n': total=strtoul(optarg,0,0); break;
+		case 's': urb_size=strtoul(optarg,0,0); break;
+		case 'q': depth=strtoul(optarg,0,0); break;
+		default:
+		usage:
+			fprintf(stderr,"usage: %s [-v vid] [-p pid] [-n bytes] [-s urb size] [-q urbs in flight]\n"
+				"bytes must be a multiple of %d, and the URB size of 512\n",argv[0],BLOCK);
+			return 2;
+		}
+	// the device takes and sends whole blocks of BLOCK bytes
+	if (!total||total%BLOCK||!urb_size||urb_size>(1ul<<20)||
+		urb_size%512||!depth||depth>MAX_DEPTH)
+		goto usage;
+	fd=find(vid,pid);
+	if (fd<0) {
+		fprintf(stderr,"no device %04x:%04x\n",vid,pid);
+		return 1;
+	}
+	if (find_eps()) {
+		fprintf(stderr,"no bulk endpoints\n");
+		return 1;
+	}
+	// SET_CONFIGURATION starts both streams again
+	if (ioctl(fd,USBDEVFS_SETCONFIGURATION,&cfg)) fail("set configuration");
+	if (ioctl(fd,USBDEVFS_CLAIMINTERFACE,&iface)) fail("claim interface");
+	printf("%-4s %10s %9s %8s %8s %8s %8s %8s\n","dir","bytes","ms","MB/s",
+		"min us","avg us","p99 us","max us");
+	stream(0);
+	stream(1);
+	memset(&ct,0,sizeof(ct));
+	ct.bRequestType=USB_DIR_IN|USB_TYPE_VENDOR|USB_RECIP_DEVICE;
+	ct.bRequest=1;
+	ct.wLength=8;
+	ct.timeout=1000;
+	ct.data=d;
+	r=ioctl(fd,USBDEVFS_CONTROL,&ct);
+	got=d[0]|d[1]<<8|d[2]<<16|(unsigned long)d[3]<<24;
+	bad=d[4]|d[5]<<8|d[6]<<16|(unsigned long)d[7]<<24;
+	if (r!=8||got!=total||bad) {
+		fprintf(stderr,"device took %lu bytes, %lu wrong\n",got,bad);
+		++errors;
+	}
+	if (errors) {
+		printf("%lu errors\n",errors);
+		return 1;
+	}
+	return 0;
+}
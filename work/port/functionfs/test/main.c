@@ -0,0 +1,154 @@
+/* port/functionfs/test/main.c -- bulk source and sink gadget */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Endpoint 1 OUT is a sink which checks the data it receives against a 
+pattern; endpoint 1 IN is a source of the same pattern.  Vendor request 
+0x01 returns the number of bytes the sink has taken and the number which 
+were wrong, as two little-endian u32s.  Both streams start again at each 
+SET_CONFIGURATION.  See host.c. */
+
+#include <stdio.h>
+#include "usb.h"
+
+#define BLOCK 16384
+
+/* requests queued on each endpoint: its queueDepth, and the port's 
+USBHW_MAX_REQS */
+#define NBUF 4
+
+static USB_BUF_STATIC(sinkbuf[NBUF],BLOCK);
+static USB_BUF_STATIC(srcbuf[NBUF],BLOCK);
+
+static u32 sink_ofs, sink_errors, src_ofs;
+
+/* byte i of the stream */
+static u8 pattern(u32 i)
+{
+	return (u8)(i*7+(i>>9));
+}
+
+/* ------ Control */
+
+int ctl_stats(void)
+{
+	static usb_data_t buf[8];
+	int i;
+
+	for (i=0;i<4;++i) {
+		buf[i]=(u8)(sink_ofs>>(8*i));
+		buf[4+i]=(u8)(sink_errors>>(8*i));
+	}
+	usb_ctl_read_end(usb_setup.len<8?usb_setup.len:8,buf);
+	return 0;
+}
+
+void usb_ctl(void)
+{
+	if (!usb_ctl_std())
+		usb_ctl_stall();
+}
+
+/* ------ Bulk */
+
+static void sink(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	u32 i;
+
+	switch (evt) {
+	case USB_EVT_CONFIGURED:
+		sink_ofs=sink_errors=0;
+		for (i=0;i<NBUF;++i)
+			usb_rx(ep,usb_buf_data(sinkbuf[i]),BLOCK);
+		break;
+	case USB_EVT_READY:
+		for (i=0;i<len;++i)
+			if (data[i]!=pattern(sink_ofs+i))
+				++sink_errors;
+		sink_ofs+=len;
+		usb_rx(ep,data,BLOCK);
+		break;
+	}
+}
+
+static void fill(usb_data_t *data)
+{
+	u32 i;
+
+	for (i=0;i<BLOCK;++i)
+		data[i]=pattern(src_ofs+i);
+	src_ofs+=BLOCK;
+}
+
+static void source(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	int i;
+
+	switch (evt) {
+	case USB_EVT_CONFIGURED:
+		src_ofs=0;
+		for (i=0;i<NBUF;++i) {
+			fill(usb_buf_data(srcbuf[i]));
+			usb_tx(ep,usb_buf_data(srcbuf[i]),BLOCK);
+		}
+		break;
+	case USB_EVT_READY:
+		fill(data);
+		usb_tx(ep,data,BLOCK);
+		break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	functionfs_params p;
+
+	if (argc!=2) {
+		fprintf(stderr,"usage: %s functionfs-mount-point\n",argv[0]);
+		return 2;
+	}
+	p.path=argv[1];
+	usb_init(&p);
+	usb_set_evt_cb(usb_get_ep(1,1),sink);
+	usb_set_evt_cb(usb_get_ep(1,17),source);
+	// the host may leave the endpoints idle between runs
+	usb_set_ep_timeout(usb_get_ep(1,1),0);
+	usb_set_ep_timeout(usb_get_ep(1,17),0);
+	usb_attach();
+	if (functionfs_poll(0)<0) {
+		fprintf(stderr,"cannot attach at %s\n",p.path);
+		return 1;
+	}
+	// the gadget may now be bound to a UDC
+	printf("ready\n");
+	fflush(stdout);
+	for (;;)
+		if (functionfs_poll(-1)<0) {
+			perror("functionfs_poll");
+			return 1;
+		}
+}
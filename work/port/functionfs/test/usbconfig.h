@@ -0,0 +1,61 @@
+
+#ifndef GUARD_USB_DESC_GENERATED_H
+#define GUARD_USB_DESC_GENERATED_H
+
+/*
+   *** DO NOT EDIT THIS FILE ***
+   This is an automatically generated file.
+   Any edits you make will be lost if the file is regenerated.
+   *** DO NOT EDIT THIS FILE ***
+*/
+
+/*
+   Generated by usbdescgen 0.1.0
+   from test.usbconfig on Sat Oct 17 18:49:31 2026
+*/
+
+typedef unsigned char usb_data_t;
+
+#define USB_BUF_LEN_SIZE 1
+#define USB_CTL_PACKET_SIZE 64
+#define USB_CTL_WRITE_BUF_SIZE 64
+#define usb_mem_len(l) (l)
+
+#include "usbtypes.h"
+
+void usb_get_device_desc(usb_data_t **bytes, int *len);
+int usb_get_config_desc(unsigned int index, usb_data_t **bytes, int *len);
+/* other-speed configuration and device qualifier descriptors; -1 if the 
+device is not high-speed capable */
+int usb_get_other_speed_desc(unsigned int index, usb_data_t **bytes, int *len);
+int usb_get_qualifier_desc(usb_data_t **bytes, int *len);
+/* selects the descriptors for full (0) or high (1) speed */
+void usb_select_speed(int high);
+int usb_get_string_desc(unsigned int index, unsigned short langid, usb_data_t **bytes, int *len);
+int usb_have_config(unsigned int config);
+int usb_have_iface(unsigned int config, unsigned int iface);
+/* number of alternate settings of an interface, or 0 if there is no 
+such interface */
+int usb_alt_count(unsigned int config, unsigned int iface);
+/* current alternate setting of each interface, kept by the core */
+#define USB_MAX_IFACES 1
+extern u8 usb_iface_alt[USB_MAX_IFACES];
+usb_endpoint_t *usb_get_ep(unsigned int config, unsigned int ep);
+usb_endpoint_t *usb_get_first_ep(unsigned int config);
+/* bit 0: self powered; bit 1: remote wakeup */
+int usb_config_features(unsigned int config);
+/* endpoint table of the current configuration, set by the core */
+extern const usb_endpoint_t **usb_ep_table;
+void usb_select_ep_table(unsigned int config);
+/* endpoint EPN (0-31) of the current configuration, or 0; EPN is not 
+checked, so this is cheap enough for interrupt service routines */
+#define usb_cur_ep(EPN) ((usb_endpoint_t *)usb_ep_table[EPN])
+void usb_set_serial_number(usb_data_t *bytes);
+#define USB_HIGH_SPEED
+/* control request handlers; see usb_ctl_find() */
+#define USB_CTL_HANDLERS 1
+extern usb_ctl_stat_t usb_ctl_stat[USB_CTL_HANDLERS];
+const usb_ctl_entry_t *usb_ctl_find(unsigned int type, unsigned int recipient, unsigned int index, unsigned int request);
+
+#endif
+
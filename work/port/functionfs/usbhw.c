@@ -0,0 +1,1068 @@
+/* port/functionfs/usbhw.c -- Linux FunctionFS port */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* before usbhw.h: ch9.h has enums named like PORUS's macros */
+#include <linux/aio_abi.h>
+#include <linux/usb/functionfs.h>
+#include "usbhw.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+
+#if usb_mem_len(2)!=2
+#error "the FunctionFS port needs dataFormat=u8"
+#endif
+
+static struct functionfs_params params;
+
+/* aio ------------------------- */
+
+/* glibc has no wrappers for these */
+
+static int io_setup(unsigned n, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup,n,ctx);
+}
+
+static int io_submit(aio_context_t ctx, long n, struct iocb **cbs)
+{
+	return syscall(__NR_io_submit,ctx,n,cbs);
+}
+
+static int io_cancel(aio_context_t ctx, struct iocb *cb, struct io_event *ev)
+{
+	return syscall(__NR_io_cancel,ctx,cb,ev);
+}
+
+static int io_getevents(aio_context_t ctx, long min, long max, struct io_event *evs, struct timespec *t)
+{
+	return syscall(__NR_io_getevents,ctx,min,max,evs,t);
+}
+
+/* endpoints ------------------- */
+
+/* A request from the core, as iocbs: the transfer, and for a chained IN 
+request a multiple of the packet size long, a zero-length write after 
+it. */
+typedef struct req_t {
+	struct iocb cb[2];
+	struct req_t *next;
+	usb_data_t *data; // as handed to us
+	u32 ct;
+	u8 id;
+	u8 ncb; // iocbs made
+	u8 pending; // iocbs not yet back from the kernel
+	u8 dead; // cancelled: nobody is told when it comes back
+} req_t;
+
+typedef struct ep_t {
+	int fd; // epN file, or -1
+	u8 file; // N, or 0 if the endpoint is not in the descriptors
+	req_t *head, *tail; // live requests, oldest first
+	u8 n; // live requests
+	u8 dead; // cancelled requests not yet back from the kernel
+	u8 cevt; // USB_EVT_CANCELLED or USB_EVT_TIMEOUT, reported when dead reaches 0
+	u32 cct;
+	usb_data_t *cdata;
+	u8 stalled;
+	u16 fsmp, hsmp; // wMaxPacketSize of the full- and high-speed descriptors
+} ep_t;
+
+static ep_t eps[32];
+
+/* spare req_t's */
+static req_t *spare;
+
+/* iocbs made since the last submission */
+#define MAX_IOCBS (31*USBHW_MAX_REQS*2)
+
+static struct iocb *batch[MAX_IOCBS];
+static int nbatch;
+
+static aio_context_t ctx;
+
+/* endpoints to pump, by id */
+static u32 dirty;
+static int pumping;
+
+static int epfd=-1, ep0=-1, evfd=-1, tfd=-1;
+static u8 enabled, ep0_muted;
+static u8 sof_en, presof_en, address;
+
+/* control --------------------- */
+
+#define CTL_RX 1
+#define CTL_TX 2
+
+/* the control transfer in progress */
+static struct {
+	u8 setup[8];
+	u8 pending; // the core has not finished it
+	u8 internal; // made by the port: nothing goes to ep0
+	u8 evt; // CTL_RX or CTL_TX, still to be reported
+	u8 stalled;
+	u8 got; // control write: the data has been read
+	u32 len, ct;
+	u8 buf[65536];
+} ctl;
+
+/* SETUPs made by the port, to run when ep0 is free */
+static u8 iq[4][8];
+static int niq;
+
+/* descriptors ----------------- */
+
+static void put32(u8 *p, u32 v)
+{
+	p[0]=v;
+	p[1]=v>>8;
+	p[2]=v>>16;
+	p[3]=v>>24;
+}
+
+/* Appends the interface and endpoint descriptors of configuration 1 at 
+the selected speed, and returns their number, or -1 if they do not fit.  
+Notes the endpoints' files and packet sizes, and the highest string 
+index used. */
+static int put_descs(u8 *p, int *len, int max, int hs, int *nep, int *nstr)
+{
+	usb_data_t *cnf;
+	int clen,i,n=0,id;
+	u16 mp;
+
+	if (usb_get_config_desc(0,&cnf,&clen)) return -1;
+	for (i=cnf[0];i+1<clen&&cnf[i];i+=cnf[i],++n) {
+		if (*len+cnf[i]>max) return -1;
+		memcpy(p+*len,cnf+i,cnf[i]);
+		*len+=cnf[i];
+		if (cnf[i+1]==USB_DT_INTERFACE&&cnf[i+8]>*nstr)
+			*nstr=cnf[i+8];
+		if (cnf[i+1]==USB_DT_INTERFACE_ASSOCIATION&&cnf[i+7]>*nstr)
+			*nstr=cnf[i+7];
+		if (cnf[i+1]!=USB_DT_ENDPOINT) continue;
+		id=(cnf[i+2]&15)|(cnf[i+2]&0x80?16:0);
+		mp=cnf[i+4]|cnf[i+5]<<8;
+		if (hs) {
+			eps[id].hsmp=mp;
+			continue;
+		}
+		// the kernel makes a file for each endpoint descriptor, in 
+		// order; alternate settings repeat endpoints
+		++*nep;
+		if (!eps[id].file) {
+			eps[id].file=*nep;
+			eps[id].fsmp=mp;
+		}
+	}
+	return n;
+}
+
+/* writes the descriptors and strings to ep0 */
+static int write_descs(void)
+{
+	static u8 b[4096];
+	usb_data_t *s;
+	int len=20,n,nep=0,nstr=0,i,j,slen;
+	u16 lang=0x0409,c;
+
+	memset(b,0,20);
+	put32(b,FUNCTIONFS_DESCRIPTORS_MAGIC_V2);
+	put32(b+8,FUNCTIONFS_HAS_FS_DESC|FUNCTIONFS_VIRTUAL_ADDR|
+		FUNCTIONFS_ALL_CTRL_RECIP
+#ifdef USB_HIGH_SPEED
+		|FUNCTIONFS_HAS_HS_DESC
+#endif
+		);
+#ifndef USB_HIGH_SPEED
+	len=16;
+#endif
+	usb_select_speed(0);
+	n=put_descs(b,&len,sizeof(b),0,&nep,&nstr);
+	if (n<0) return -1;
+	put32(b+12,n);
+#ifdef USB_HIGH_SPEED
+	usb_select_speed(1);
+	n=put_descs(b,&len,sizeof(b),1,&nep,&nstr);
+	usb_select_speed(usb_get_speed()==USB_SPEED_HIGH);
+	if (n<0) return -1;
+	put32(b+16,n);
+#endif
+	put32(b+4,len);
+	if (write(ep0,b,len)!=len) return -1;
+	// strings, in the first language, from UTF-16 to UTF-8
+	if (!usb_get_string_desc(0,0,&s,&slen)&&slen>=4)
+		lang=s[2]|s[3]<<8;
+	len=16;
+	put32(b,FUNCTIONFS_STRINGS_MAGIC);
+	put32(b+8,nstr);
+	put32(b+12,nstr?1:0);
+	if (nstr) {
+		b[len++]=lang;
+		b[len++]=lang>>8;
+	}
+	for (i=1;i<=nstr;++i) {
+		if (usb_get_string_desc(i,lang,&s,&slen)) slen=0;
+		for (j=2;j+1<slen;j+=2) {
+			if (len+4>(int)sizeof(b)) return -1;
+			c=s[j]|s[j+1]<<8;
+			if (c<0x80)
+				b[len++]=c;
+			else if (c<0x800) {
+				b[len++]=0xc0|c>>6;
+				b[len++]=0x80|(c&0x3f);
+			} else {
+				b[len++]=0xe0|c>>12;
+				b[len++]=0x80|(c>>6&0x3f);
+				b[len++]=0x80|(c&0x3f);
+			}
+		}
+		if (len>=(int)sizeof(b)) return -1;
+		b[len++]=0;
+	}
+	put32(b+4,len);
+	if (write(ep0,b,len)!=len) return -1;
+	return 0;
+}
+
+/* opens the epN files noted by put_descs() */
+static int open_eps(void)
+{
+	char name[256];
+	int id,fd;
+
+	for (id=1;id<32;++id) {
+		if (!eps[id].file) continue;
+		snprintf(name,sizeof(name),"%s/ep%d",params.path,eps[id].file);
+		fd=open(name,O_RDWR|O_NONBLOCK);
+		if (fd<0) return -1;
+		eps[id].fd=fd;
+	}
+	return 0;
+}
+
+static void close_eps(void)
+{
+	int id;
+
+	for (id=1;id<32;++id) {
+		if (eps[id].fd>=0) close(eps[id].fd);
+		eps[id].fd=-1;
+		eps[id].file=0;
+		eps[id].fsmp=eps[id].hsmp=0;
+	}
+}
+
+/* transfers ------------------- */
+
+static void free_req(req_t *r)
+{
+	r->next=spare;
+	spare=r;
+}
+
+static req_t *alloc_req(void)
+{
+	req_t *r=spare;
+
+	if (r)
+		spare=r->next;
+	else
+		r=malloc(sizeof(req_t));
+	if (r) memset(r,0,sizeof(*r));
+	return r;
+}
+
+/* the completed requests at the head of the queue are reported */
+static void retire(int id)
+{
+	ep_t *e=eps+id;
+	usb_endpoint_t *ep;
+	req_t *r;
+
+	while ((r=e->head)&&!r->pending) {
+		e->head=r->next;
+		--e->n;
+		ep=usb_cur_ep(id);
+		if (ep) usb_evt_done(ep,r->data,r->ct,USB_EVT_READY);
+		free_req(r);
+	}
+}
+
+static void complete(struct iocb *cb, long res)
+{
+	req_t *r=(req_t *)(uintptr_t)cb->aio_data;
+	ep_t *e=eps+r->id;
+
+	--r->pending;
+	if (res>0&&cb==r->cb)
+		r->ct=res;
+	if (r->pending) return;
+	if (!r->dead) {
+		retire(r->id);
+		return;
+	}
+	free_req(r);
+	if (!--e->dead&&e->cevt)
+		dirty|=1u<<r->id;
+}
+
+/* submits the batch; an iocb the kernel refuses completes with the error */
+static void submit(void)
+{
+	struct iocb *cb;
+	int r;
+
+	while (nbatch) {
+		r=io_submit(ctx,nbatch,batch);
+		if (r<0&&errno==EINTR) continue;
+		if (r<=0) {
+			cb=batch[0];
+			memmove(batch,batch+1,--nbatch*sizeof(*batch));
+			complete(cb,r<0?-errno:-EIO);
+			continue;
+		}
+		nbatch-=r;
+		memmove(batch,batch+r,nbatch*sizeof(*batch));
+	}
+}
+
+/* Cancels every request on an endpoint.  They are forgotten at once, 
+but are kept until the kernel gives them back, since it may still be 
+using their buffers. */
+static void cancel_all(int id)
+{
+	ep_t *e=eps+id;
+	struct io_event ev;
+	req_t *r,*next;
+	int i;
+
+	submit();
+	r=e->head;
+	e->head=e->tail=0;
+	e->n=0;
+	for (;r;r=next) {
+		next=r->next;
+		if (!r->pending) { // back, but behind one which is not
+			free_req(r);
+			continue;
+		}
+		r->dead=1;
+		++e->dead;
+		for (i=r->ncb;i--;)
+			if (!io_cancel(ctx,r->cb+i,&ev))
+				complete(r->cb+i,ev.res); // older kernels
+	}
+}
+
+static void prep(struct iocb *cb, req_t *r, int fd, int in, void *buf, u32 len)
+{
+	memset(cb,0,sizeof(*cb));
+	cb->aio_data=(uintptr_t)r;
+	cb->aio_lio_opcode=in?IOCB_CMD_PWRITE:IOCB_CMD_PREAD;
+	cb->aio_fildes=fd;
+	cb->aio_buf=(uintptr_t)buf;
+	cb->aio_nbytes=len;
+	cb->aio_flags=IOCB_FLAG_RESFD;
+	cb->aio_resfd=evfd;
+	batch[nbatch++]=cb;
+	++r->ncb;
+	++r->pending;
+}
+
+static int rxtx(usb_endpoint_t *ep, usb_data_t *data, u16 len, int chain)
+{
+	int id=ep->id,in=id&16;
+	ep_t *e=eps+id;
+	req_t *r;
+
+	if (e->fd<0) return -2;
+	if (e->n>=USBHW_MAX_REQS||e->cevt) return -1;
+	r=alloc_req();
+	if (!r) return -1;
+	r->id=id;
+	r->data=data;
+	prep(r->cb,r,e->fd,in,in?data:data+USB_BUF_LEN_SIZE,len);
+	if (in&&chain&&len&&ep->data->maxpkt&&!(len%ep->data->maxpkt))
+		prep(r->cb+1,r,e->fd,1,data,0);
+	if (e->tail)
+		e->tail->next=r;
+	else
+		e->head=r;
+	e->tail=r;
+	++e->n;
+	return 0;
+}
+
+int usbhw_tx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,0);
+}
+
+int usbhw_rx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,0);
+}
+
+int usbhw_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,1);
+}
+
+int usbhw_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,1);
+}
+
+/* the oldest request is reported once the kernel has given every one 
+back */
+void usbhw_cancel(usb_endpoint_t *ep)
+{
+	ep_t *e=eps+ep->id;
+
+	if (!e->head) return;
+	e->cevt=ep->data->stat==USB_EPSTAT_TIMING_OUT?USB_EVT_TIMEOUT:USB_EVT_CANCELLED;
+	e->cdata=e->head->data;
+	e->cct=e->head->ct;
+	cancel_all(ep->id);
+	dirty|=1u<<ep->id;
+}
+
+/* control --------------------- */
+
+int usbhw_get_setup(usb_setup_t *s)
+{
+	u8 *b=ctl.setup;
+
+	if (!ctl.pending) return -1;
+	s->dataDir=b[0]&0x80?1:0;
+	s->type=(b[0]>>5)&3;
+	s->recipient=b[0]&31;
+	s->request=b[1];
+	s->value=b[3]<<8|b[2];
+	s->index=b[5]<<8|b[4];
+	s->len=b[7]<<8|b[6];
+	return 0;
+}
+
+void usbhw_put_ctl_read_data(u8 len, usb_data_t *d)
+{
+	if (!ctl.pending) return;
+	if (len>ctl.len-ctl.ct) len=ctl.len-ctl.ct;
+	memcpy(ctl.buf+ctl.ct,d,len);
+	ctl.ct+=len;
+	ctl.evt=CTL_TX;
+	dirty|=1;
+}
+
+int usbhw_get_ctl_write_data(u8 *len, usb_data_t *d, int last)
+{
+	u32 n;
+	int r;
+
+	if (!ctl.pending) return -1;
+	if (!*len) return 0;
+	if (!ctl.got) {
+		r=ctl.internal?0:read(ep0,ctl.buf,ctl.len);
+		if (r<0) return -1;
+		ctl.len=r;
+		ctl.got=1;
+	}
+	n=ctl.len-ctl.ct;
+	if (n>USB_CTL_PACKET_SIZE) n=USB_CTL_PACKET_SIZE;
+	if (n>*len) return -1;
+	memcpy(d,ctl.buf+ctl.ct,n);
+	ctl.ct+=n;
+	*len=n;
+	if (!last) {
+		ctl.evt=CTL_RX;
+		dirty|=1;
+	}
+	return 0;
+}
+
+static void ctl_done(void)
+{
+	ctl.pending=0;
+	ctl.evt=0;
+	dirty|=1;
+}
+
+void usbhw_ctl_write_handshake(void)
+{
+	if (!ctl.pending) return;
+	// a write without data is acknowledged by reading nothing
+	if (!ctl.internal&&!ctl.len)
+		(void)!read(ep0,0,0);
+	ctl_done();
+}
+
+void usbhw_ctl_read_handshake(void)
+{
+	if (!ctl.pending) return;
+	if (!ctl.internal)
+		(void)!write(ep0,ctl.buf,ctl.ct);
+	ctl_done();
+}
+
+/* ep0 stalls at a transfer in the wrong direction */
+void usbhw_ctl_stall(void)
+{
+	ctl.stalled=1;
+	if (!ctl.pending) return;
+	if (!ctl.internal) {
+		if (ctl.setup[0]&0x80)
+			(void)!read(ep0,0,0);
+		else if (!ctl.got)
+			(void)!write(ep0,0,0);
+	}
+	ctl_done();
+}
+
+int usbhw_ctl_is_stalled(void)
+{
+	return ctl.stalled;
+}
+
+/* so do the other endpoints */
+void usbhw_stall(int epn)
+{
+	ep_t *e=eps+epn;
+	u8 b;
+
+	e->stalled=1;
+	if (e->fd<0||!enabled) return;
+	if (epn&16)
+		(void)!read(e->fd,&b,0);
+	else
+		(void)!write(e->fd,&b,0);
+}
+
+void usbhw_unstall(int epn)
+{
+	ep_t *e=eps+epn;
+
+	e->stalled=0;
+	if (e->fd>=0&&enabled)
+		ioctl(e->fd,FUNCTIONFS_CLEAR_HALT);
+}
+
+int usbhw_is_stalled(int epn)
+{
+	return eps[epn].stalled;
+}
+
+void usbhw_set_address(u8 adr)
+{
+	address=adr;
+}
+
+static void start_setup(const u8 *setup, int internal)
+{
+	memcpy(ctl.setup,setup,8);
+	ctl.pending=1;
+	ctl.internal=internal;
+	ctl.stalled=0;
+	ctl.got=0;
+	ctl.ct=0;
+	ctl.len=setup[6]|setup[7]<<8;
+	usb_evt_setup();
+	if (ctl.pending&&!(setup[0]&0x80)&&ctl.len)
+		ctl.evt=CTL_RX;
+}
+
+/* Reports what the core is owed: each packet it put is taken at once, and 
+each packet of a control write is offered when the last has been taken.  
+Then runs the port's own SETUPs, if ep0 is free. */
+static void pump_ctl(void)
+{
+	u8 s[8];
+
+	for (;;) {
+		if (ctl.evt) {
+			u8 e=ctl.evt;
+
+			ctl.evt=0;
+			if (e==CTL_RX)
+				usb_evt_ctl_rx();
+			else
+				usb_evt_ctl_tx();
+			continue;
+		}
+		if (ctl.pending||!niq) return;
+		memcpy(s,iq[0],8);
+		memmove(iq,iq+1,--niq*sizeof(*iq));
+		start_setup(s,1);
+	}
+}
+
+static void pump(void)
+{
+	usb_endpoint_t *ep;
+	ep_t *e;
+	u32 d;
+	int id;
+	u8 evt;
+
+	if (pumping) return;
+	pumping=1;
+	while ((d=dirty)) {
+		dirty=0;
+		if (d&1) pump_ctl();
+		for (id=1;id<32;++id) {
+			e=eps+id;
+			if (!(d&(1u<<id))||!e->cevt||e->dead) continue;
+			evt=e->cevt;
+			e->cevt=0;
+			ep=usb_cur_ep(id);
+			if (ep) usb_evt_done(ep,e->cdata,e->cct,evt);
+		}
+	}
+	pumping=0;
+}
+
+/* endpoints ------------------- */
+
+static void reset_ep(int id)
+{
+	cancel_all(id);
+	eps[id].cevt=0;
+	eps[id].stalled=0;
+}
+
+int usbhw_activate_eps(int cnf)
+{
+	usb_endpoint_t *ep;
+
+	if (cnf!=1) return -1;
+	for (ep=usb_get_first_ep(cnf);ep;ep=ep->next)
+		reset_ep(ep->id);
+	return 0;
+}
+
+void usbhw_deactivate_eps(int cnf)
+{
+	usb_endpoint_t *ep;
+
+	for (ep=usb_get_first_ep(cnf);ep;ep=ep->next)
+		reset_ep(ep->id);
+}
+
+/* the kernel does not pass SET_INTERFACE on */
+int usbhw_set_ep_alt(usb_endpoint_t *ep)
+{
+	reset_ep(ep->id);
+	return usb_get_interface(ep->iface)?-1:0;
+}
+
+/* interrupts ------------------ */
+
+/* Everything runs in functionfs_poll(), so there is nothing to lock out. */
+
+void usbhw_int_dis(void)
+{
+}
+
+void usbhw_int_en(void)
+{
+}
+
+void usbhw_int_en_sof(void)
+{
+	sof_en=1;
+}
+
+void usbhw_int_dis_sof(void)
+{
+	sof_en=0;
+}
+
+void usbhw_int_en_presof(void)
+{
+	presof_en=1;
+}
+
+void usbhw_int_dis_presof(void)
+{
+	presof_en=0;
+}
+
+void usbhw_int_en_txdone(int epn)
+{
+}
+
+void usbhw_int_dis_txdone(int epn)
+{
+}
+
+void usbhw_int_en_rxdone(int epn)
+{
+}
+
+void usbhw_int_dis_rxdone(int epn)
+{
+}
+
+void usbhw_int_en_setup(void)
+{
+}
+
+void usbhw_int_dis_setup(void)
+{
+}
+
+void usbhw_int_en_ctlin(void)
+{
+}
+
+void usbhw_int_dis_ctlin(void)
+{
+}
+
+void usbhw_int_en_ctlout(void)
+{
+}
+
+void usbhw_int_dis_ctlout(void)
+{
+}
+
+/* alarm clock ----------------- */
+
+struct usb_alarm_t {
+	int set;
+};
+
+static long now_ms(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec*1000+t.tv_nsec/1000000;
+}
+
+u32 usbhw_clock(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return (u32)(t.tv_sec*1000000+t.tv_nsec/1000);
+}
+
+u32 usbhw_clock_khz(void)
+{
+	return 1000;
+}
+
+usb_alarm_t *usbhw_mkalarm(void)
+{
+	return calloc(1,sizeof(usb_alarm_t));
+}
+
+void usbhw_rmalarm(usb_alarm_t *alarm)
+{
+	free(alarm);
+}
+
+/* runs the event loop until woken */
+int usbhw_sleep(usb_alarm_t *alarm, int timeout_ms)
+{
+	long end=now_ms()+timeout_ms,left=-1;
+
+	while (!alarm->set) {
+		if (timeout_ms) {
+			left=end-now_ms();
+			if (left<=0) return -1;
+		}
+		if (functionfs_poll(left)<0) return -1;
+	}
+	alarm->set=0;
+	return 0;
+}
+
+void usbhw_wake(usb_alarm_t *alarm)
+{
+	alarm->set=1;
+}
+
+/* event loop ------------------ */
+
+static void set_events(int fd, u32 events)
+{
+	struct epoll_event ev;
+
+	ev.events=events;
+	ev.data.fd=fd;
+	epoll_ctl(epfd,EPOLL_CTL_MOD,fd,&ev);
+}
+
+static int add_fd(int fd)
+{
+	struct epoll_event ev;
+
+	ev.events=EPOLLIN;
+	ev.data.fd=fd;
+	return epoll_ctl(epfd,EPOLL_CTL_ADD,fd,&ev);
+}
+
+/* the 1 ms timer: frames and the timeout clock */
+static void tick(void)
+{
+	unsigned long long k;
+	u32 i;
+
+	if (read(tfd,&k,sizeof(k))!=sizeof(k)) return;
+	if (enabled)
+		for (i=0;i<k&&i<8;++i) {
+			if (presof_en) usb_evt_presof();
+			if (sof_en) usb_evt_sof();
+		}
+#ifndef USB_TIMEOUT_SOF
+	usb_evt_tick(k>0xffff?0xffff:k);
+#endif
+}
+
+/* collects every completion */
+static int reap(void)
+{
+	struct io_event ev[64];
+	struct timespec zero={0,0};
+	unsigned long long k;
+	int i,n,t=0;
+
+	(void)!read(evfd,&k,sizeof(k));
+	do {
+		n=io_getevents(ctx,0,64,ev,&zero);
+		for (i=0;i<n;++i)
+			complete((struct iocb *)(uintptr_t)ev[i].obj,ev[i].res);
+		if (n>0) t+=n;
+	} while (n==64);
+	return t;
+}
+
+static int hs_enabled(void)
+{
+#ifdef USB_HIGH_SPEED
+	struct usb_endpoint_descriptor d;
+	int id;
+
+	// the kernel enables the endpoints with the descriptors of the 
+	// bus speed; a packet size tells them apart
+	for (id=1;id<32;++id)
+		if (eps[id].fd>=0&&eps[id].fsmp!=eps[id].hsmp&&
+			!ioctl(eps[id].fd,FUNCTIONFS_ENDPOINT_DESC,&d))
+			return (le16toh(d.wMaxPacketSize)&0x7ff)==(eps[id].hsmp&0x7ff);
+#endif
+	return 0;
+}
+
+static void queue_setup(u8 type, u8 request, u16 value)
+{
+	u8 *s;
+
+	if (niq>=4) return;
+	s=iq[niq++];
+	memset(s,0,8);
+	s[0]=type;
+	s[1]=request;
+	s[2]=value;
+	s[3]=value>>8;
+	dirty|=1;
+}
+
+/* the host has configured the function */
+static void enable(void)
+{
+	enabled=1;
+	niq=0;
+	usb_evt_reset();
+	usb_evt_speed(hs_enabled()?USB_SPEED_HIGH:USB_SPEED_FULL);
+	queue_setup(0,USB_REQ_SET_ADDRESS,1);
+	queue_setup(0,USB_REQ_SET_CONFIGURATION,1);
+}
+
+static void disable(void)
+{
+	if (!enabled) return;
+	enabled=0;
+	niq=0;
+	usb_evt_reset();
+}
+
+/* reads ep0's events; a SETUP is always the last */
+static int ep0_events(void)
+{
+	struct usb_functionfs_event ev[4];
+	int n,i;
+
+	n=read(ep0,ev,sizeof(ev));
+	if (n<0) return errno==EAGAIN||errno==EINTR?0:-1;
+	n/=sizeof(*ev);
+	for (i=0;i<n;++i)
+		switch (ev[i].type) {
+		case FUNCTIONFS_UNBIND:
+			disable();
+			break;
+		case FUNCTIONFS_ENABLE:
+			enable();
+			break;
+		case FUNCTIONFS_DISABLE:
+			disable();
+			break;
+		case FUNCTIONFS_SETUP:
+			if (ctl.pending) {
+				// the host gave up on the last; a SETUP with 
+				// nothing behind it returns the core to idle
+				ctl_done();
+				usb_evt_setup();
+			}
+			start_setup((const u8 *)&ev[i].u.setup,0);
+			break;
+		case FUNCTIONFS_SUSPEND:
+			if (enabled) usb_evt_suspend();
+			break;
+		case FUNCTIONFS_RESUME:
+			if (enabled) usb_evt_resume();
+			break;
+		}
+	return n;
+}
+
+int functionfs_poll(int timeout_ms)
+{
+	struct epoll_event ev[4];
+	int i,n,r,handled=0;
+
+	if (ep0<0) return -1;
+	pump();
+	submit();
+	// while a SETUP waits for the core, ep0 reads as its data
+	if (ep0_muted!=(ctl.pending&&!ctl.internal)) {
+		ep0_muted=!ep0_muted;
+		set_events(ep0,ep0_muted?0:EPOLLIN);
+	}
+	n=epoll_wait(epfd,ev,4,dirty?0:timeout_ms);
+	if (n<0) return errno==EINTR?0:-1;
+	for (i=0;i<n;++i) {
+		if (ev[i].data.fd==evfd)
+			handled+=reap();
+		else if (ev[i].data.fd==tfd)
+			tick();
+		else if (ev[i].data.fd==ep0&&!ep0_muted) {
+			r=ep0_events();
+			if (r<0) return -1;
+			handled+=r;
+		}
+	}
+	pump();
+	submit();
+	return handled;
+}
+
+int functionfs_fd(void)
+{
+	return epfd;
+}
+
+/* setup ----------------------- */
+
+void usbhw_reset(void)
+{
+	int id;
+
+	for (id=1;id<32;++id)
+		reset_ep(id);
+	ctl.stalled=0;
+	sof_en=presof_en=0;
+	address=0;
+}
+
+void usbhw_detach(void)
+{
+	struct itimerspec its;
+	int id;
+
+	for (id=1;id<32;++id)
+		reset_ep(id);
+	submit();
+	close_eps();
+	if (ep0>=0) close(ep0);
+	ep0=-1;
+	ctl.pending=0;
+	ctl.evt=0;
+	niq=0;
+	enabled=0;
+	memset(&its,0,sizeof(its));
+	timerfd_settime(tfd,0,&its,0);
+}
+
+void usbhw_attach(void)
+{
+	char name[256];
+	struct itimerspec its;
+
+	if (ep0>=0) return;
+	snprintf(name,sizeof(name),"%s/ep0",params.path);
+	ep0=open(name,O_RDWR|O_NONBLOCK);
+	if (ep0<0) return;
+	if (write_descs()||open_eps()||add_fd(ep0)) {
+		usbhw_detach();
+		return;
+	}
+	ep0_muted=0;
+	its.it_interval.tv_sec=its.it_value.tv_sec=0;
+	its.it_interval.tv_nsec=its.it_value.tv_nsec=1000000;
+	timerfd_settime(tfd,0,&its,0);
+}
+
+int usbhw_init(void *param)
+{
+	int id;
+
+	if (!param) return -1;
+	params=*(struct functionfs_params *)param;
+	for (id=0;id<32;++id)
+		eps[id].fd=-1;
+	epfd=epoll_create1(0);
+	evfd=eventfd(0,EFD_NONBLOCK);
+	tfd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK);
+	if (epfd<0||evfd<0||tfd<0||io_setup(MAX_IOCBS,&ctx)||
+		add_fd(evfd)||add_fd(tfd))
+		return -1;
+	return 0;
+}
@@ -0,0 +1,111 @@
+// :wrap=soft:
+
+/* port/usbip/portconf.h -- configuration header for the USB/IP port */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_portconf_h
+#define GUARD_portconf_h
+
+/*! Define this if the port supports timeouts */
+#define USBHW_HAVE_TIMEOUT
+
+/*! Define this if the port has a fine clock (usbhw_clock()) */
+#define USBHW_HAVE_CLOCK
+
+/*! Define this if the hardware can attach / deattach from the bus */
+#define USBHW_HAVE_ATTACH
+
+/*! Defined if the hardware has a pre-SOF interrupt */
+#define USBHW_HAVE_PRESOF
+
+/*! Number of requests the port can hold per endpoint */
+#define USBHW_MAX_REQS 2
+
+//! USB/IP parameters
+/*! This structure is used to initialise the USB/IP port. */
+struct usbip_params {
+	//! Address to listen on
+	/*! A dotted IPv4 address, such as "127.0.0.1".  0 listens on every interface. */
+	const char *addr;
+
+	//! TCP port to listen on
+	/*! 0 for the standard port, 3240. */
+	u16 port;
+
+	//! Bus id
+	/*! The name under which the device is listed and imported, such as "1-1" (the default, if 0). */
+	const char *busid;
+};
+
+typedef struct usbip_params usbip_params;
+
+/*! \defgroup port_usbip
+
+This port runs the core and the application as an ordinary Linux process.  It acts as a USB/IP server with one device, so that the device can be attached to the local machine with the Linux usbip tools (usbip attach -r 127.0.0.1 -b 1-1) and used by ordinary host software, or driven directly over TCP, as the loopback client in port/usbip/test does.
+
+\section usb_init() parameters
+
+The struct usbip_params must be passed to usb_init().  See usbip_params.  The listening socket is opened by usb_attach().
+
+\section Event loop
+
+There are no interrupts.  The application calls usbip_poll(), which waits for the socket or the 1 ms timer, handles everything that has arrived, and sends the replies.  Everything the core would do under interrupt is done inside usbip_poll(), so callbacks run there, and usbhw_int_dis() and usbhw_int_en() do nothing.  usbip_fd() gives the epoll descriptor, so that the loop can be nested in another.
+
+Requests submitted outside usbip_poll() are started by the next call.  usb_move_wait() and other blocking calls run the loop themselves while they wait.
+
+\section Implementation notes
+
+The host sends URBs (whole transfers) rather than packets.  The port queues them per endpoint and cuts them into packets of the endpoint's size, so short packets, zero-length packets and the ends of requests fall where they would on the bus.  An IN packet that does not fit in the host's URB ends the URB with an overflow error; the rest of the packet is lost, as on the bus.
+
+Commands are read in batches: usbip_poll() reads everything the socket holds, handles every complete command, and sends the replies together with writev().  IN data is copied once, from the request buffer into the reply.  OUT data is copied once, from the batch into the request buffer, unless its URB is still waiting for a request when the next batch is read; it is then copied out of the way first.
+
+On the control endpoint, each URB is a whole control transfer.  SET_ADDRESS is never sent by the Linux host driver, so the port runs one itself when the device is imported.  Isochronous URBs are refused.
+
+Only the u8 data format is supported.
+
+SOF and pre-SOF come from the 1 ms timer, pre-SOF first, at high speed as at full speed.  Timeouts are clocked from the same timer, unless the configuration sets \c timeoutBase=sof.
+
+When the host disconnects, the port resets the device, drops every URB, and waits for the next connection.
+
+\section Test
+
+port/usbip/test holds a bulk source and sink device and a client which imports it over the loopback interface, streams data both ways with several URBs in flight, and reports MB/s and the time each URB takes.  make check runs both.
+*/
+
+//! Run the event loop once
+/*! Waits up to \p timeout_ms milliseconds (forever if negative) for the socket or the timer, then handles every command which has arrived and sends the replies.
+
+\return Number of commands handled, or -1 if the device is not attached
+*/
+int usbip_poll(int timeout_ms);
+
+//! Event loop descriptor
+/*! The epoll descriptor which usbip_poll() waits on, or -1 before usb_init().  It becomes readable when usbip_poll() has work to do. */
+int usbip_fd(void);
+
+#endif
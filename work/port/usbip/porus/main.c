@@ -0,0 +1,273 @@
+/* port/usbip/porus/main.c -- PORUS test device served over USB/IP */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* The PORUS test protocol (see test/porustest.py), for host test 
+programs which have no test board: WVAR, RVAR, BLKI, BLKO, STAT, RCRC 
+and TMOI, on bulk endpoint 1 in each direction.  BLKI data is 
+pseudo-random, and the CRCs are the CRC-32 of zlib.  See test/host. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "usb.h"
+
+// stat codes
+#define STAT_IDLE	0x00
+#define STAT_BORX	0x01
+#define STAT_BITX	0x04
+#define STAT_TIMO	0x05
+#define STAT_EROR	0x06
+
+// largest BLKI or BLKO, and room for the packet which ends a BLKO
+#define BLK_MAX 65535
+#define BLK_ROOM (BLK_MAX+1+512)
+
+static USB_BUF_STATIC(blkbuf,BLK_ROOM);
+
+static struct {
+	u8 test_stat, err, timeout;
+	u16 var;
+	u32 crc;
+} flags;
+
+static usb_data_t txbuf[4];
+
+/* ------ Test data */
+
+static u32 crc_table[256];
+
+static void crc_init(void)
+{
+	u32 c;
+	int i,k;
+
+	for (i=0;i<256;++i) {
+		for (c=i,k=0;k<8;++k)
+			c=c&1?0xedb88320ul^(c>>1):c>>1;
+		crc_table[i]=c;
+	}
+}
+
+// u32 may be wider than 32 bits on the host
+static u32 crc32(u32 crc, const u8 *buf, u32 len)
+{
+	crc=~crc&0xfffffffful;
+	while (len--)
+		crc=crc_table[(crc^*buf++)&0xff]^(crc>>8);
+	return ~crc&0xfffffffful;
+}
+
+// random gens from *DOCTOR* George Marsaglia, as in the C55x test
+static u32 z=362436069, w=521288629;
+#define znew   (z=36969*(z&65535)+(z>>16))
+#define wnew   (w=18000*(w&65535)+(w>>16))
+#define MWC    ((znew<<16)+wnew )
+
+static void genrnd(u8 *buf, u32 len)
+{
+	while (len--)
+		*buf++=(u8)(MWC>>8);
+}
+
+/* ------ Bulk */
+
+static void bulk_in(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	switch (evt) {
+	case USB_EVT_READY:
+		flags.test_stat=STAT_IDLE;
+		break;
+	case USB_EVT_TIMEOUT:
+		flags.timeout=1;
+		flags.test_stat=STAT_IDLE;
+		break;
+	case USB_EVT_CANCELLED:
+	case USB_EVT_DECONFIGURED:
+		flags.test_stat=STAT_IDLE;
+		break;
+	}
+}
+
+static void bulk_out(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	switch (evt) {
+	case USB_EVT_READY:
+		// BOCC: the CRC takes no time worth reporting here
+		flags.crc=crc32(0,data,len);
+		flags.test_stat=STAT_IDLE;
+		break;
+	case USB_EVT_TIMEOUT:
+		flags.timeout=1;
+		flags.test_stat=STAT_IDLE;
+		break;
+	case USB_EVT_CANCELLED:
+	case USB_EVT_DECONFIGURED:
+		flags.test_stat=STAT_IDLE;
+		break;
+	}
+}
+
+/* ------ Control */
+
+/* Starts a bulk test, or flags an error if one is running already */
+static usb_endpoint_t *start(int id, u8 stat)
+{
+	usb_endpoint_t *ep=usb_get_ep(usb_get_config(),id);
+
+	if (flags.test_stat!=STAT_IDLE||!ep) {
+		flags.err=1;
+		return 0;
+	}
+	flags.test_stat=stat;
+	return ep;
+}
+
+int ctl_wvar(void)
+{
+	flags.var=usb_setup.value;
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_rvar(void)
+{
+	txbuf[0]=(u8)(flags.var>>8);
+	txbuf[1]=(u8)flags.var;
+	usb_ctl_read_end(2,txbuf);
+	return 0;
+}
+
+int ctl_blki(void)
+{
+	usb_endpoint_t *ep;
+	u16 len=usb_setup.value;
+
+	if ((ep=start(17,STAT_BITX))) {
+		genrnd(blkbuf,len);
+		flags.crc=crc32(0,blkbuf,len);
+		if (usb_tx_chain(ep,blkbuf,len)) {
+			flags.err=1;
+			flags.test_stat=STAT_IDLE;
+		}
+	}
+	usb_ctl_write_end();
+	return 0;
+}
+
+/* The host ends the data with a short packet, which is a zero-length 
+packet if the length is a whole number of packets; asking for one byte 
+more takes that in too. */
+int ctl_blko(void)
+{
+	usb_endpoint_t *ep;
+
+	if ((ep=start(1,STAT_BORX)))
+		if (usb_rx_chain(ep,blkbuf,(u32)usb_setup.value+1)) {
+			flags.err=1;
+			flags.test_stat=STAT_IDLE;
+		}
+	usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_stat(void)
+{
+	if (flags.err) {
+		flags.err=0;
+		txbuf[0]=STAT_EROR;
+	} else if (flags.timeout) {
+		flags.timeout=0;
+		txbuf[0]=STAT_TIMO;
+	} else
+		txbuf[0]=flags.test_stat;
+	usb_ctl_read_end(1,txbuf);
+	return 0;
+}
+
+int ctl_rcrc(void)
+{
+	int i;
+
+	for (i=0;i<4;++i)
+		txbuf[i]=(u8)(flags.crc>>(24-8*i));
+	usb_ctl_read_end(4,txbuf);
+	return 0;
+}
+
+/* Offers len bytes of c, which the host is not meant to read, so that 
+the endpoint times out */
+int ctl_tmoi(void)
+{
+	usb_endpoint_t *ep;
+	u16 len=usb_setup.value;
+
+	if ((ep=start(17,STAT_BITX))) {
+		memset(blkbuf,usb_setup.len?usb_ctl_write_data[0]:0,len);
+		if (usb_tx_chain(ep,blkbuf,len)) {
+			flags.err=1;
+			flags.test_stat=STAT_IDLE;
+		}
+	}
+	usb_ctl_write_end();
+	return 0;
+}
+
+void usb_ctl(void)
+{
+	if (!usb_ctl_std())
+		usb_ctl_stall();
+}
+
+int main(int argc, char **argv)
+{
+	usbip_params p;
+	int c;
+
+	memset(&p,0,sizeof(p));
+	p.addr="127.0.0.1";
+	while ((c=getopt(argc,argv,"a:p:b:"))!=-1)
+		switch (c) {
+		case 'a': p.addr=optarg; break;
+		case 'p': p.port=strtoul(optarg,0,0); break;
+		case 'b': p.busid=optarg; break;
+		default:
+			fprintf(stderr,"usage: %s [-a address] [-p port] [-b busid]\n",argv[0]);
+			return 2;
+		}
+	crc_init();
+	usb_init(&p);
+	usb_set_evt_cb(usb_get_ep(1,1),bulk_out);
+	usb_set_evt_cb(usb_get_ep(1,17),bulk_in);
+	usb_attach();
+	for (;;)
+		if (usbip_poll(-1)<0) {
+			perror("usbip_poll");
+			return 1;
+		}
+}
@@ -0,0 +1,409 @@
+/* port/usbip/test/client.c -- USB/IP loopback throughput client */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Imports the test device (main.c) over USB/IP, as vhci-hcd would, and 
+streams bulk data to and from it with a number of URBs in flight.  
+Replies are read as they come; the URBs they free are submitted again 
+together, with one writev().  Reports MB/s and the time from submission 
+to reply of each URB, and checks the data both ways.  First it sends 
+control writes of lengths either side of 256 and of the write buffer, 
+which the device takes a chunk at a time.  Needs no kernel support, so 
+it runs anywhere the device does. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "usbip.h"
+
+#define MAX_DEPTH 64
+#define BLOCK 16384 // as main.c
+#define DEVID 0x00010001 // bus 1, device 1
+
+static int fd;
+static unsigned int seqnum;
+static unsigned long total=64ul<<20, urb_size=65536, depth=8;
+static unsigned long errors;
+
+/* byte i of the stream, as main.c makes it */
+static unsigned char pattern(unsigned long i)
+{
+	return (unsigned char)(i*7+(i>>9));
+}
+
+static double now_us(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec*1e6+t.tv_nsec/1e3;
+}
+
+static void fail(const char *what)
+{
+	fprintf(stderr,"%s: %s\n",what,errno?strerror(errno):"protocol error");
+	exit(1);
+}
+
+/* ------ Socket */
+
+static unsigned char rbuf[2<<20];
+static size_t rlen, rofs;
+
+/* returns the next n bytes received, reading only if they are not here 
+already; n must be less than sizeof(rbuf) */
+static unsigned char *take(size_t n)
+{
+	ssize_t r;
+
+	if (rlen-rofs<n) {
+		memmove(rbuf,rbuf+rofs,rlen-rofs);
+		rlen-=rofs;
+		rofs=0;
+		while (rlen<n) {
+			r=read(fd,rbuf+rlen,sizeof(rbuf)-rlen);
+			if (r<=0) {
+				if (r<0&&errno==EINTR) continue;
+				fail("read");
+			}
+			rlen+=r;
+		}
+	}
+	rofs+=n;
+	return rbuf+rofs-n;
+}
+
+/* whether n bytes are here without reading */
+static int have(size_t n)
+{
+	return rlen-rofs>=n;
+}
+
+static void send_all(struct iovec *iov, int n)
+{
+	ssize_t r;
+
+	while (n) {
+		r=writev(fd,iov,n);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			fail("write");
+		}
+		for (;n&&(size_t)r>=iov->iov_len;--n,++iov)
+			r-=iov->iov_len;
+		if (n) {
+			iov->iov_base=(char *)iov->iov_base+r;
+			iov->iov_len-=r;
+		}
+	}
+}
+
+static void connect_to(const char *addr, int port)
+{
+	struct sockaddr_in sa;
+	int one=1;
+
+	fd=socket(AF_INET,SOCK_STREAM,0);
+	memset(&sa,0,sizeof(sa));
+	sa.sin_family=AF_INET;
+	sa.sin_port=htons(port);
+	if (!inet_aton(addr,&sa.sin_addr)) {
+		fprintf(stderr,"bad address %s\n",addr);
+		exit(2);
+	}
+	if (fd<0||connect(fd,(struct sockaddr *)&sa,sizeof(sa)))
+		fail("connect");
+	setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+}
+
+static void import(const char *busid)
+{
+	unsigned char req[USBIP_OP_LEN+USBIP_BUSID_LEN];
+	usbip_op_header h;
+	struct iovec iov;
+
+	memset(req,0,sizeof(req));
+	h.version=USBIP_VERSION;
+	h.code=USBIP_OP_REQ_IMPORT;
+	h.status=0;
+	usbip_pack_op(req,&h);
+	strncpy((char *)req+USBIP_OP_LEN,busid,USBIP_BUSID_LEN-1);
+	iov.iov_base=req;
+	iov.iov_len=sizeof(req);
+	send_all(&iov,1);
+	usbip_unpack_op(take(USBIP_OP_LEN),&h);
+	if (h.code!=USBIP_OP_REP_IMPORT||h.status) {
+		fprintf(stderr,"import of %s refused\n",busid);
+		exit(1);
+	}
+	take(USBIP_DEVICE_LEN);
+}
+
+/* ------ URBs */
+
+static void pack_submit(unsigned char *hdr, int in, int ep, unsigned long len, const unsigned char *setup)
+{
+	usbip_cmd c;
+
+	memset(&c,0,sizeof(c));
+	c.base.command=USBIP_CMD_SUBMIT;
+	c.base.seqnum=++seqnum;
+	c.base.devid=DEVID;
+	c.base.direction=in?USBIP_DIR_IN:USBIP_DIR_OUT;
+	c.base.ep=ep;
+	c.u.submit.transfer_buffer_length=len;
+	if (setup) memcpy(c.u.submit.setup,setup,8);
+	usbip_pack_cmd(hdr,&c);
+}
+
+/* reads a RET_SUBMIT, but not its data */
+static void ret_submit(usbip_cmd *c)
+{
+	usbip_unpack_cmd(take(USBIP_CMD_LEN),c);
+	if (c->base.command!=USBIP_RET_SUBMIT) {
+		errno=0;
+		fail("reply");
+	}
+}
+
+/* a control transfer; returns the length moved, or the status if < 0 */
+static int control(int type, int request, int value, int index, int len, unsigned char *data)
+{
+	unsigned char hdr[USBIP_CMD_LEN],setup[8];
+	struct iovec iov[2];
+	usbip_cmd c;
+	int in=type&0x80;
+
+	setup[0]=type;
+	setup[1]=request;
+	setup[2]=value;
+	setup[3]=value>>8;
+	setup[4]=index;
+	setup[5]=index>>8;
+	setup[6]=len;
+	setup[7]=len>>8;
+	pack_submit(hdr,in,0,len,setup);
+	iov[0].iov_base=hdr;
+	iov[0].iov_len=USBIP_CMD_LEN;
+	iov[1].iov_base=data;
+	iov[1].iov_len=len;
+	send_all(iov,!in&&len?2:1);
+	ret_submit(&c);
+	if (c.u.ret.status) return c.u.ret.status;
+	if (in) memcpy(data,take(c.u.ret.actual_length),c.u.ret.actual_length);
+	return c.u.ret.actual_length;
+}
+
+/* Control writes of the pattern, which the device checks.  The lengths 
+cross 256 and several multiples of the 64-byte write buffer. */
+static void ctl_writes(void)
+{
+	static const int lens[]={1,63,64,65,200,255,256,257,300,511,512,1000,4096};
+	static unsigned char buf[4096];
+	unsigned char d[8];
+	unsigned long got,bad;
+	unsigned int i;
+	int k,r;
+
+	for (i=0;i<sizeof(buf);++i)
+		buf[i]=pattern(i);
+	for (k=0;k<(int)(sizeof(lens)/sizeof(*lens));++k) {
+		r=control(0x40,2,0,0,lens[k],buf);
+		if (r!=lens[k]) {
+			fprintf(stderr,"control write of %d: %d\n",lens[k],r);
+			++errors;
+			continue;
+		}
+		r=control(0xc0,3,0,0,8,d);
+		got=d[0]|d[1]<<8|d[2]<<16|(unsigned long)d[3]<<24;
+		bad=d[4]|d[5]<<8|d[6]<<16|(unsigned long)d[7]<<24;
+		if (r!=8||got!=(unsigned long)lens[k]||bad) {
+			fprintf(stderr,"control write of %d: device took %lu bytes, %lu wrong\n",
+				lens[k],got,bad);
+			++errors;
+		}
+	}
+	printf("control writes of 1 to %d bytes checked\n",lens[k-1]);
+}
+
+/* ------ Streams */
+
+static double lat[1<<16];
+static unsigned long nlat;
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x=*(const double *)a,y=*(const double *)b;
+
+	return x<y?-1:x>y;
+}
+
+static void report(const char *name, double us)
+{
+	double sum=0;
+	unsigned long i;
+
+	qsort(lat,nlat,sizeof(*lat),cmp_double);
+	for (i=0;i<nlat;++i)
+		sum+=lat[i];
+	printf("%-4s %10lu %9.1f %8.2f %8.1f %8.1f %8.1f %8.1f\n",name,total,
+		us/1e3,total/us,lat[0],sum/nlat,lat[nlat*99/100],lat[nlat-1]);
+}
+
+/* Keeps depth URBs in flight on endpoint 1 until total bytes have moved.  
+OUT data is the pattern; IN data is checked against it. */
+static void stream(int in)
+{
+	static unsigned char hdr[MAX_DEPTH][USBIP_CMD_LEN];
+	static struct iovec iov[2*MAX_DEPTH];
+	unsigned char *buf,*p;
+	double sent[MAX_DEPTH],t0,t;
+	unsigned long ofs=0,done=0,len,i;
+	unsigned int head=0,tail=0;
+	usbip_cmd c;
+	int n;
+
+	buf=malloc(depth*urb_size);
+	if (!buf) fail("malloc");
+	nlat=0;
+	t0=now_us();
+	for (;;) {
+		// submit everything that is free, together
+		n=0;
+		while (head-tail<depth&&ofs<total) {
+			i=head%depth;
+			len=total-ofs<urb_size?total-ofs:urb_size;
+			pack_submit(hdr[i],in,1,len,0);
+			iov[n].iov_base=hdr[i];
+			iov[n++].iov_len=USBIP_CMD_LEN;
+			if (!in) {
+				p=buf+i*urb_size;
+				iov[n].iov_base=p;
+				iov[n++].iov_len=len;
+				for (len+=ofs;ofs<len;++ofs)
+					*p++=pattern(ofs);
+			} else
+				ofs+=len;
+			sent[i]=now_us();
+			++head;
+		}
+		if (n) send_all(iov,n);
+		if (head==tail) break;
+		// then take every reply which has come
+		do {
+			ret_submit(&c);
+			t=now_us();
+			if (c.u.ret.status) {
+				fprintf(stderr,"urb %u: status %d\n",c.base.seqnum,c.u.ret.status);
+				exit(1);
+			}
+			i=tail++%depth;
+			if (nlat<sizeof(lat)/sizeof(*lat))
+				lat[nlat++]=t-sent[i];
+			if (in) {
+				p=take(c.u.ret.actual_length);
+				for (len=0;len<(unsigned long)c.u.ret.actual_length;++len)
+					if (p[len]!=pattern(done+len))
+						++errors;
+			}
+			done+=c.u.ret.actual_length;
+		} while (head!=tail&&have(USBIP_CMD_LEN)&&
+			(!in||have(USBIP_CMD_LEN+usbip_get32(rbuf+rofs+24))));
+	}
+	t=now_us()-t0;
+	free(buf);
+	if (done!=total) {
+		fprintf(stderr,"%s: %lu of %lu bytes\n",in?"in":"out",done,total);
+		++errors;
+	}
+	report(in?"in":"out",t);
+}
+
+int main(int argc, char **argv)
+{
+	const char *addr="127.0.0.1",*busid="1-1";
+	unsigned char d[64];
+	unsigned long got,bad;
+	int port=USBIP_PORT,c,r;
+
+	while ((c=getopt(argc,argv,"a:p:b:n:s:q:"))!=-1)
+		switch (c) {
+		case 'a': addr=optarg; break;
+		case 'p': port=strtoul(optarg,0,0); break;
+		case 'b': busid=optarg; break;
+		case 'n': total=strtoul(optarg,0,0); break;
+		case 's': urb_size=strtoul(optarg,0,0); break;
+		case 'q': depth=strtoul(optarg,0,0); break;
+		default:
+		usage:
+			fprintf(stderr,"usage: %s [-a address] [-p port] [-b busid] [-n bytes] [-s urb size] [-q urbs in flight]\n"
+				"bytes must be a multiple of %d, and the URB size of 512\n",argv[0],BLOCK);
+			return 2;
+		}
+	// the device takes and sends whole blocks of BLOCK bytes
+	if (!total||total%BLOCK||!urb_size||urb_size>sizeof(rbuf)/2||
+		urb_size%512||!depth||depth>MAX_DEPTH)
+		goto usage;
+	connect_to(addr,port);
+	import(busid);
+	r=control(0x80,6,0x100,0,18,d); // GET_DESCRIPTOR(device)
+	if (r!=18||d[1]!=1) {
+		fprintf(stderr,"device descriptor: %d\n",r);
+		return 1;
+	}
+	printf("device %04x:%04x\n",d[8]|d[9]<<8,d[10]|d[11]<<8);
+	r=control(0,9,1,0,0,0); // SET_CONFIGURATION(1)
+	if (r) {
+		fprintf(stderr,"set configuration: %d\n",r);
+		return 1;
+	}
+	ctl_writes();
+	printf("%-4s %10s %9s %8s %8s %8s %8s %8s\n","dir","bytes","ms","MB/s",
+		"min us","avg us","p99 us","max us");
+	stream(0);
+	stream(1);
+	r=control(0xc0,1,0,0,8,d);
+	got=d[0]|d[1]<<8|d[2]<<16|(unsigned long)d[3]<<24;
+	bad=d[4]|d[5]<<8|d[6]<<16|(unsigned long)d[7]<<24;
+	if (r!=8||got!=total||bad) {
+		fprintf(stderr,"device took %lu bytes, %lu wrong\n",got,bad);
+		++errors;
+	}
+	if (errors) {
+		printf("%lu errors\n",errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,182 @@
+/* port/usbip/test/main.c -- bulk source and sink served over USB/IP */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Endpoint 1 OUT is a sink which checks the data it receives against a 
+pattern; endpoint 1 IN is a source of the same pattern.  Vendor request 
+0x01 returns the number of bytes the sink has taken and the number which 
+were wrong, as two little-endian u32s.  Both streams start again at each 
+SET_CONFIGURATION.  Vendor request 0x02 is a chunked control write of the 
+pattern, of any length, and 0x03 returns the counts for the last one in 
+the same form.  See client.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "usb.h"
+
+#define BLOCK 16384
+
+static USB_BUF_STATIC(sinkbuf0,BLOCK);
+static USB_BUF_STATIC(sinkbuf1,BLOCK);
+static USB_BUF_STATIC(srcbuf0,BLOCK);
+static USB_BUF_STATIC(srcbuf1,BLOCK);
+
+static u32 sink_ofs, sink_errors, src_ofs;
+static u32 ctl_bytes, ctl_errors;
+
+/* byte i of the stream */
+static u8 pattern(u32 i)
+{
+	return (u8)(i*7+(i>>9));
+}
+
+/* ------ Control */
+
+static void read_counts(u32 bytes, u32 errors)
+{
+	static usb_data_t buf[8];
+	int i;
+
+	for (i=0;i<4;++i) {
+		buf[i]=(u8)(bytes>>(8*i));
+		buf[4+i]=(u8)(errors>>(8*i));
+	}
+	usb_ctl_read_end(usb_setup.len<8?usb_setup.len:8,buf);
+}
+
+int ctl_stats(void)
+{
+	read_counts(sink_ofs,sink_errors);
+	return 0;
+}
+
+/* called each time the write buffer fills, and once more with the rest */
+int ctl_write(void)
+{
+	u16 ofs=usb_ctl_write_ofs(),len=usb_ctl_write_len(),i;
+
+	if (!ofs) ctl_bytes=ctl_errors=0;
+	for (i=0;i<len;++i)
+		if (usb_ctl_write_data[i]!=pattern(ofs+i))
+			++ctl_errors;
+	ctl_bytes+=len;
+	if (ofs+len==usb_setup.len)
+		usb_ctl_write_end();
+	return 0;
+}
+
+int ctl_wstats(void)
+{
+	read_counts(ctl_bytes,ctl_errors);
+	return 0;
+}
+
+void usb_ctl(void)
+{
+	if (!usb_ctl_std())
+		usb_ctl_stall();
+}
+
+/* ------ Bulk */
+
+static void sink(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	u32 i;
+
+	switch (evt) {
+	case USB_EVT_CONFIGURED:
+		sink_ofs=sink_errors=0;
+		usb_rx(ep,usb_buf_data(sinkbuf0),BLOCK);
+		usb_rx(ep,usb_buf_data(sinkbuf1),BLOCK);
+		break;
+	case USB_EVT_READY:
+		for (i=0;i<len;++i)
+			if (data[i]!=pattern(sink_ofs+i))
+				++sink_errors;
+		sink_ofs+=len;
+		usb_rx(ep,data,BLOCK);
+		break;
+	}
+}
+
+static void fill(usb_data_t *data)
+{
+	u32 i;
+
+	for (i=0;i<BLOCK;++i)
+		data[i]=pattern(src_ofs+i);
+	src_ofs+=BLOCK;
+}
+
+static void source(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	switch (evt) {
+	case USB_EVT_CONFIGURED:
+		src_ofs=0;
+		fill(usb_buf_data(srcbuf0));
+		usb_tx(ep,usb_buf_data(srcbuf0),BLOCK);
+		fill(usb_buf_data(srcbuf1));
+		usb_tx(ep,usb_buf_data(srcbuf1),BLOCK);
+		break;
+	case USB_EVT_READY:
+		fill(data);
+		usb_tx(ep,data,BLOCK);
+		break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	usbip_params p;
+	int c;
+
+	memset(&p,0,sizeof(p));
+	p.addr="127.0.0.1";
+	while ((c=getopt(argc,argv,"a:p:b:"))!=-1)
+		switch (c) {
+		case 'a': p.addr=optarg; break;
+		case 'p': p.port=strtoul(optarg,0,0); break;
+		case 'b': p.busid=optarg; break;
+		default:
+			fprintf(stderr,"usage: %s [-a address] [-p port] [-b busid]\n",argv[0]);
+			return 2;
+		}
+	usb_init(&p);
+	usb_set_evt_cb(usb_get_ep(1,1),sink);
+	usb_set_evt_cb(usb_get_ep(1,17),source);
+	// the host may leave the endpoints idle between runs
+	usb_set_ep_timeout(usb_get_ep(1,1),0);
+	usb_set_ep_timeout(usb_get_ep(1,17),0);
+	usb_attach();
+	for (;;)
+		if (usbip_poll(-1)<0) {
+			perror("usbip_poll");
+			return 1;
+		}
+}
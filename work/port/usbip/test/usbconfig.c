@@ -0,0 +1,344 @@
+
+/*
+   *** DO NOT EDIT THIS FILE ***
+   This is an automatically generated file.
+   Any edits you make will be lost if the file is regenerated.
+   *** DO NOT EDIT THIS FILE ***
+*/
+
+/*
+   Generated by usbdescgen 0.1.0
+   from test.usbconfig on Sat Oct 17 19:29:34 2026
+*/
+
+#include "usbconfig.h"
+
+#define CONFIG_DESC_COUNT 1
+#define STRING_DESC_COUNT 2
+#define ONLY_LANG_ID 0x0409
+
+/* "PORUS USB/IP Test" */
+static const usb_data_t string1[38]={
+	0x00, 0x24, 0x24, 0x03, 0x50, 0x00, 0x4F, 0x00,
+	0x52, 0x00, 0x55, 0x00, 0x53, 0x00, 0x20, 0x00,
+	0x55, 0x00, 0x53, 0x00, 0x42, 0x00, 0x2F, 0x00,
+	0x49, 0x00, 0x50, 0x00, 0x20, 0x00, 0x54, 0x00,
+	0x65, 0x00, 0x73, 0x00, 0x74, 0x00
+};
+
+static const usb_data_t langtbl[6]={
+	0x00, 0x04, 0x03, 0x03, 0x09, 0x04
+};
+
+static const usb_data_t *string_descs[2]={
+	langtbl, string1
+};
+
+static const usb_data_t config1[34]={
+	0x00, 0x20, 0x09, 0x02, 0x20, 0x00, 0x01, 0x01,
+	0x00, 0xC0, 0x00, 0x09, 0x04, 0x00, 0x00, 0x02,
+	0xFF, 0xFF, 0xFF, 0x00, 0x07, 0x05, 0x81, 0x02,
+	0x40, 0x00, 0x01, 0x07, 0x05, 0x01, 0x02, 0x40,
+	0x00, 0x01
+};
+
+static const usb_data_t hsconfig1[34]={
+	0x00, 0x20, 0x09, 0x02, 0x20, 0x00, 0x01, 0x01,
+	0x00, 0xC0, 0x00, 0x09, 0x04, 0x00, 0x00, 0x02,
+	0xFF, 0xFF, 0xFF, 0x00, 0x07, 0x05, 0x81, 0x02,
+	0x00, 0x02, 0x00, 0x07, 0x05, 0x01, 0x02, 0x00,
+	0x02, 0x00
+};
+
+static const usb_data_t hsconfig1_other[34]={
+	0x00, 0x20, 0x09, 0x07, 0x20, 0x00, 0x01, 0x01,
+	0x00, 0xC0, 0x00, 0x09, 0x04, 0x00, 0x00, 0x02,
+	0xFF, 0xFF, 0xFF, 0x00, 0x07, 0x05, 0x81, 0x02,
+	0x00, 0x02, 0x00, 0x07, 0x05, 0x01, 0x02, 0x00,
+	0x02, 0x00
+};
+
+static const usb_data_t config1_other[34]={
+	0x00, 0x20, 0x09, 0x07, 0x20, 0x00, 0x01, 0x01,
+	0x00, 0xC0, 0x00, 0x09, 0x04, 0x00, 0x00, 0x02,
+	0xFF, 0xFF, 0xFF, 0x00, 0x07, 0x05, 0x81, 0x02,
+	0x40, 0x00, 0x01, 0x07, 0x05, 0x01, 0x02, 0x40,
+	0x00, 0x01
+};
+
+static const usb_data_t qualifier_desc[12]={
+	0x00, 0x0A, 0x0A, 0x06, 0x00, 0x02, 0x00, 0x00,
+	0x00, 0x40, 0x01, 0x00
+};
+
+static const usb_data_t *config_descs[1]={
+	config1
+};
+
+static const usb_data_t *hs_config_descs[1]={
+	hsconfig1
+};
+
+static const usb_data_t *other_fs_descs[1]={
+	hsconfig1_other
+};
+
+static const usb_data_t *other_hs_descs[1]={
+	config1_other
+};
+
+/* descriptors for the current speed, set by usb_select_speed() */
+static const usb_data_t **cur_config_descs=(const usb_data_t **)config_descs;
+static const usb_data_t **other_config_descs=(const usb_data_t **)other_fs_descs;
+
+static const unsigned int iface_counts[1]={
+	1
+};
+
+static const unsigned int config_features[1]={
+	1
+};
+
+static const u8 alt_counts1[1]={
+	1
+};
+
+static const u8 *alt_counts[1]={
+	alt_counts1
+};
+
+u8 usb_iface_alt[USB_MAX_IFACES];
+
+static const usb_data_t device_desc[20]={
+	0x00, 0x12, 0x12, 0x01, 0x00, 0x02, 0x00, 0x00,
+	0x00, 0x40, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x00, 0x01
+};
+
+usb_endpoint_data_t epout1_data;
+
+static usb_req_t epout1_queue[2];
+
+static const u16 epout1_hsalts[1]={0x0200};
+
+static const usb_endpoint_t epout1={
+	1,
+	USB_EPTYPE_BULK,
+	64,
+	&epout1_data,
+	0,
+	(usb_endpoint_t *)(0),
+	epout1_queue,
+	2,
+	0,
+	0,
+	0,
+	512,
+	0,
+	epout1_hsalts
+};
+
+usb_endpoint_data_t epin1_data;
+
+static usb_req_t epin1_queue[2];
+
+static const u16 epin1_hsalts[1]={0x0200};
+
+static const usb_endpoint_t epin1={
+	17,
+	USB_EPTYPE_BULK,
+	64,
+	&epin1_data,
+	0,
+	(usb_endpoint_t *)(&epout1),
+	epin1_queue,
+	2,
+	0,
+	0,
+	0,
+	512,
+	0,
+	epin1_hsalts
+};
+
+static const usb_endpoint_t *endpoints1[32]={
+	0, &epout1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, &epin1, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const usb_endpoint_t *no_endpoints[32]={
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const usb_endpoint_t **ep_tables[2]={
+	no_endpoints, endpoints1
+};
+
+const usb_endpoint_t **usb_ep_table=no_endpoints;
+
+static const usb_endpoint_t *first_endpoints[2]={
+	0, &epin1
+};
+
+int ctl_stats(void);
+int ctl_write(void);
+int ctl_wstats(void);
+
+usb_ctl_stat_t usb_ctl_stat[USB_CTL_HANDLERS];
+
+static const usb_ctl_entry_t ctl_entries0[3]={
+	{ctl_stats,usb_ctl_stat+0,0},
+	{ctl_write,usb_ctl_stat+1,1},
+	{ctl_wstats,usb_ctl_stat+2,0}
+};
+
+static const usb_ctl_table_t ctl_tables[1]={
+	{1,3,ctl_entries0}
+};
+
+/* 0 for none, else 1 + index into ctl_tables */
+static const u8 ctl_slots[2][34]={
+	{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
+};
+
+const usb_ctl_entry_t *usb_ctl_find(unsigned int type, unsigned int recipient, unsigned int index, unsigned int request)
+{
+	const usb_ctl_table_t *t;
+	unsigned int n;
+
+	if (type<1||type>2) return 0;
+	switch (recipient) {
+	case 0:
+		n=0;
+		break;
+	case 1:
+		n=index&0xff;
+		if (n>=USB_MAX_IFACES) return 0;
+		n+=1;
+		break;
+	case 2:
+		n=1+USB_MAX_IFACES+(index&0x0f)+((index&0x80)>>3);
+		break;
+	default:
+		return 0;
+	}
+	n=ctl_slots[type-1][n];
+	if (!n) return 0;
+	t=ctl_tables+n-1;
+	request-=t->first;
+	if (request>=t->count||!t->entries[request].handler) return 0;
+	return t->entries+request;
+}
+
+usb_data_t usb_ctl_write_data[64];
+
+static int get_len(usb_data_t *bytes)
+{
+	return (int)((bytes[0]<<8)|bytes[1]);
+}
+
+void usb_get_device_desc(usb_data_t **bytes, int *len)
+{
+	*bytes=(usb_data_t *)(device_desc+2);
+	*len=get_len((usb_data_t *)device_desc);
+}
+
+int usb_get_config_desc(unsigned int index, usb_data_t **bytes, int *len)
+{
+	usb_data_t *data;
+
+	if (index>=CONFIG_DESC_COUNT) return -1;
+	data=(usb_data_t *)cur_config_descs[index];
+	*len=get_len(data);
+	*bytes=data+2;
+	return 0;
+}
+
+int usb_get_other_speed_desc(unsigned int index, usb_data_t **bytes, int *len)
+{
+	usb_data_t *data;
+
+	if (index>=CONFIG_DESC_COUNT) return -1;
+	data=(usb_data_t *)other_config_descs[index];
+	*len=get_len(data);
+	*bytes=data+2;
+	return 0;
+}
+
+int usb_get_qualifier_desc(usb_data_t **bytes, int *len)
+{
+	*bytes=(usb_data_t *)(qualifier_desc+2);
+	*len=get_len((usb_data_t *)qualifier_desc);
+	return 0;
+}
+
+void usb_select_speed(int high)
+{
+	if (high) {
+		cur_config_descs=(const usb_data_t **)hs_config_descs;
+		other_config_descs=(const usb_data_t **)other_hs_descs;
+	} else {
+		cur_config_descs=(const usb_data_t **)config_descs;
+		other_config_descs=(const usb_data_t **)other_fs_descs;
+	}
+}
+
+usb_endpoint_t *usb_get_ep(unsigned int config, unsigned int ep)
+{
+	if (config>CONFIG_DESC_COUNT) return 0;
+	if (ep>31) return 0;
+	return (usb_endpoint_t *)(ep_tables[config][ep]);
+}
+
+void usb_select_ep_table(unsigned int config)
+{
+	usb_ep_table=usb_have_config(config)?ep_tables[config]:no_endpoints;
+}
+
+usb_endpoint_t *usb_get_first_ep(unsigned int config)
+{
+	if (config>CONFIG_DESC_COUNT) return 0;
+	return (usb_endpoint_t *)first_endpoints[config];
+}
+
+int usb_have_config(unsigned int config)
+{
+	if (!config||config>CONFIG_DESC_COUNT) return 0;
+	return 1;
+}
+
+int usb_config_features(unsigned int config)
+{
+	if (!usb_have_config(config)) return 0;
+	return config_features[config-1];
+}
+
+int usb_have_iface(unsigned int config, unsigned int iface)
+{
+	if (!usb_have_config(config)) return 0;
+	return (iface>=iface_counts[config-1])?0:1;
+}
+
+int usb_alt_count(unsigned int config, unsigned int iface)
+{
+	if (!usb_have_iface(config,iface)) return 0;
+	return alt_counts[config-1][iface];
+}
+
+int usb_get_string_desc(unsigned int index, unsigned short langid, usb_data_t **bytes, int *len)
+{
+	usb_data_t *data;
+
+	if (!index) {
+		data=(usb_data_t *)langtbl; 
+	} else {
+		if (index>=STRING_DESC_COUNT) return -1;
+		if (langid!=ONLY_LANG_ID) return -1;
+		data=(usb_data_t *)string_descs[index];
+	}
+	*len=get_len((usb_data_t *)data);
+	*bytes=(usb_data_t *)(data+2);
+	return 0;
+}
@@ -0,0 +1,1170 @@
+/* port/usbip/usbhw.c -- USB/IP port */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#include "usbhw.h"
+#include "usbip.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#if usb_mem_len(2)!=2
+#error "the USB/IP port needs dataFormat=u8"
+#endif
+
+struct usbip_params params;
+
+/* Longest URB accepted from the host */
+#define MAX_URB (16ul<<20)
+
+/* The device number we take when imported, and report */
+#define DEVNUM 1
+
+/* urbs ------------------------ */
+
+/* A URB from the host.  Once complete, the same structure holds the reply 
+until it has been sent: hdr, then n bytes at buf. */
+typedef struct urb_t {
+	struct urb_t *next;
+	u32 seqnum, len, ct;
+	u8 id; // endpoint id: 0 for control, 1-15 OUT, 17-31 IN
+	u8 zlp; // OUT: a zero-length packet may still be due
+	u8 own; // buf was allocated for the URB, rather than pointing into rx
+	u8 internal; // made by the port; no reply
+	u8 setup[8];
+	u8 *buf;
+	u8 hdr[USBIP_CMD_LEN];
+	u32 hlen, n, sent;
+} urb_t;
+
+/* queued URBs by endpoint id; 0 is the control endpoint, both directions */
+static urb_t *uhead[32], *utail[32];
+
+/* replies waiting to be sent, oldest first */
+static urb_t *rhead, *rtail;
+
+/* a request from the core */
+typedef struct req_t {
+	usb_data_t *data; // as handed to us
+	u32 len, ct;
+	u8 chain, zlp;
+} req_t;
+
+static req_t reqs[32][USBHW_MAX_REQS];
+static u8 nreqs[32], stalled[32];
+
+/* a cancelled request, reported at the next pump */
+static req_t creq[32];
+static u8 cevt[32];
+
+/* endpoints to pump, by id */
+static u32 dirty;
+static int pumping;
+
+#define CTL_RX 1
+#define CTL_TX 2
+
+/* the control transfer in progress */
+static struct {
+	urb_t *urb; // taken off uhead[0], or 0
+	u32 ofs; // control write: bytes handed to the core
+	u8 evt; // CTL_RX or CTL_TX, still to be reported
+	u8 stalled;
+	u8 abort; // the host unlinked the transfer before the core had finished
+} ctl;
+
+static u8 sof_en, presof_en, address;
+
+static void free_urb(urb_t *u)
+{
+	if (u->own) free(u->buf);
+	free(u);
+}
+
+static void enqueue(urb_t **head, urb_t **tail, urb_t *u)
+{
+	u->next=0;
+	if (*head)
+		(*tail)->next=u;
+	else
+		*head=u;
+	*tail=u;
+}
+
+static urb_t *pop(int id)
+{
+	urb_t *u=uhead[id];
+
+	if (u) uhead[id]=u->next;
+	return u;
+}
+
+/* queues the reply for a URB taken off its queue */
+static void urb_done(urb_t *u, int status)
+{
+	usbip_cmd c;
+	int in=u->id?u->id&16:u->setup[0]&0x80;
+
+	if (u->internal) {
+		free_urb(u);
+		return;
+	}
+	memset(&c,0,sizeof(c));
+	c.base.command=USBIP_RET_SUBMIT;
+	c.base.seqnum=u->seqnum;
+	c.u.ret.status=status;
+	c.u.ret.actual_length=u->ct;
+	usbip_pack_cmd(u->hdr,&c);
+	u->hlen=USBIP_CMD_LEN;
+	u->n=in?u->ct:0;
+	u->sent=0;
+	enqueue(&rhead,&rtail,u);
+}
+
+/* sockets --------------------- */
+
+static int epfd=-1, lfd=-1, cfd=-1, tfd=-1;
+static u8 imported, closing, want_out;
+
+/* received bytes: rxlen in rx, of which the first rxofs are handled */
+static u8 *rx;
+static size_t rxsize, rxlen, rxofs;
+
+static void set_events(int fd, u32 events)
+{
+	struct epoll_event ev;
+
+	ev.events=events;
+	ev.data.fd=fd;
+	epoll_ctl(epfd,EPOLL_CTL_MOD,fd,&ev);
+}
+
+static int add_fd(int fd)
+{
+	struct epoll_event ev;
+
+	ev.events=EPOLLIN;
+	ev.data.fd=fd;
+	return epoll_ctl(epfd,EPOLL_CTL_ADD,fd,&ev);
+}
+
+static void drop_queue(urb_t **head)
+{
+	urb_t *u;
+
+	while ((u=*head)) {
+		*head=u->next;
+		free_urb(u);
+	}
+}
+
+/* the host has gone: the device is unplugged */
+static void hangup(void)
+{
+	int id;
+
+	close(cfd);
+	cfd=-1;
+	for (id=0;id<32;++id)
+		drop_queue(uhead+id);
+	drop_queue(&rhead);
+	if (ctl.urb) free_urb(ctl.urb);
+	ctl.urb=0;
+	ctl.evt=0;
+	ctl.abort=0;
+	rxlen=rxofs=0;
+	closing=want_out=0;
+	if (imported) {
+		imported=0;
+		usb_evt_reset();
+	}
+}
+
+/* writes as many replies as the socket takes, with one writev() per 
+batch of up to 64 */
+static void flush(void)
+{
+	struct iovec iov[64];
+	urb_t *u;
+	ssize_t r;
+	u32 left;
+	int n;
+
+	while (rhead) {
+		n=0;
+		for (u=rhead;u&&n<63;u=u->next) {
+			if (u->sent<u->hlen) {
+				iov[n].iov_base=u->hdr+u->sent;
+				iov[n++].iov_len=u->hlen-u->sent;
+			}
+			if (u->n) {
+				left=u->sent>u->hlen?u->sent-u->hlen:0;
+				iov[n].iov_base=u->buf+left;
+				iov[n++].iov_len=u->n-left;
+			}
+		}
+		r=writev(cfd,iov,n);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			if (errno==EAGAIN||errno==EWOULDBLOCK) {
+				if (!want_out) set_events(cfd,EPOLLIN|EPOLLOUT);
+				want_out=1;
+				return;
+			}
+			hangup();
+			return;
+		}
+		while (r&&rhead) {
+			u=rhead;
+			left=u->hlen+u->n-u->sent;
+			if ((size_t)r<left) {
+				u->sent+=r;
+				break;
+			}
+			r-=left;
+			rhead=u->next;
+			free_urb(u);
+		}
+	}
+	if (want_out) set_events(cfd,EPOLLIN);
+	want_out=0;
+	if (closing) hangup();
+}
+
+/* queues a reply which is not a URB's */
+static u8 *reply(u32 len)
+{
+	urb_t *u=calloc(1,sizeof(urb_t));
+
+	if (!u) return 0;
+	u->buf=calloc(1,len);
+	if (!u->buf) {
+		free(u);
+		return 0;
+	}
+	u->own=1;
+	u->n=len;
+	enqueue(&rhead,&rtail,u);
+	return u->buf;
+}
+
+static int keep(urb_t *u)
+{
+	u8 *p;
+
+	if (u->own||!u->len) return 0;
+	p=malloc(u->len);
+	if (!p) return -1;
+	memcpy(p,u->buf,u->len);
+	u->buf=p;
+	u->own=1;
+	return 0;
+}
+
+/* OUT URBs still queued point into rx, which is about to be reused: 
+give them their own copy */
+static int keep_urbs(void)
+{
+	urb_t *u;
+	int id;
+
+	if (ctl.urb&&keep(ctl.urb)) return -1;
+	for (id=0;id<16;++id)
+		for (u=uhead[id];u;u=u->next)
+			if (keep(u)) return -1;
+	return 0;
+}
+
+/* devices --------------------- */
+
+static const char *busid(void)
+{
+	return params.busid?params.busid:"1-1";
+}
+
+/* fills d from the device descriptor and the first configuration's */
+static void describe(usbip_device *d)
+{
+	usb_data_t *dev,*cnf;
+	int len;
+
+	memset(d,0,sizeof(*d));
+	strcpy(d->path,"/sys/devices/porus/");
+	strncat(d->path,busid(),sizeof(d->path)-strlen(d->path)-1);
+	strncpy(d->busid,busid(),sizeof(d->busid)-1);
+	d->busnum=1;
+	d->devnum=DEVNUM;
+#ifdef USB_HIGH_SPEED
+	d->speed=3;
+#else
+	d->speed=2;
+#endif
+	usb_get_device_desc(&dev,&len);
+	d->bDeviceClass=dev[4];
+	d->bDeviceSubClass=dev[5];
+	d->bDeviceProtocol=dev[6];
+	d->idVendor=dev[8]|dev[9]<<8;
+	d->idProduct=dev[10]|dev[11]<<8;
+	d->bcdDevice=dev[12]|dev[13]<<8;
+	d->bNumConfigurations=dev[17];
+	d->bConfigurationValue=usb_get_config();
+	if (!usb_get_config_desc(0,&cnf,&len))
+		d->bNumInterfaces=cnf[4];
+}
+
+static void devlist(void)
+{
+	usbip_op_header h;
+	usbip_device d;
+	usb_data_t *cnf;
+	int len,i,k;
+	u8 *p;
+
+	describe(&d);
+	p=reply(USBIP_OP_LEN+4+USBIP_DEVICE_LEN+4*d.bNumInterfaces);
+	if (!p) return;
+	h.version=USBIP_VERSION;
+	h.code=USBIP_OP_REP_DEVLIST;
+	h.status=0;
+	usbip_pack_op(p,&h);
+	usbip_put32(p+USBIP_OP_LEN,1);
+	usbip_pack_device(p+USBIP_OP_LEN+4,&d);
+	p+=USBIP_OP_LEN+4+USBIP_DEVICE_LEN;
+	// class triples of alternate setting 0 of each interface
+	if (!usb_get_config_desc(0,&cnf,&len))
+		for (i=0,k=0;i+1<len&&cnf[i]&&k<d.bNumInterfaces;i+=cnf[i])
+			if (cnf[i+1]==4&&!cnf[i+3]) {
+				p[4*k]=cnf[i+5];
+				p[4*k+1]=cnf[i+6];
+				p[4*k+2]=cnf[i+7];
+				++k;
+			}
+	closing=1;
+}
+
+static void import(const char *id)
+{
+	usbip_op_header h;
+	usbip_device d;
+	urb_t *u;
+	u8 *p;
+	int ok=!imported&&!strncmp(id,busid(),USBIP_BUSID_LEN);
+
+	p=reply(USBIP_OP_LEN+(ok?USBIP_DEVICE_LEN:0));
+	if (!p) return;
+	h.version=USBIP_VERSION;
+	h.code=USBIP_OP_REP_IMPORT;
+	h.status=!ok;
+	usbip_pack_op(p,&h);
+	if (!ok) {
+		closing=1;
+		return;
+	}
+	describe(&d);
+	usbip_pack_device(p+USBIP_OP_LEN,&d);
+	imported=1;
+	usb_evt_reset();
+#ifdef USB_HIGH_SPEED
+	usb_evt_speed(USB_SPEED_HIGH);
+#endif
+	// the host driver keeps SET_ADDRESS to itself, so we send our own
+	u=calloc(1,sizeof(urb_t));
+	if (!u) return;
+	u->setup[1]=5;
+	u->setup[2]=DEVNUM;
+	u->internal=1;
+	u->next=uhead[0];
+	if (!uhead[0]) utail[0]=u;
+	uhead[0]=u;
+	dirty|=1;
+}
+
+/* commands -------------------- */
+
+static void submit(const usbip_cmd *c, u8 *data)
+{
+	const usbip_cmd_submit *s=&c->u.submit;
+	usb_endpoint_t *ep;
+	urb_t *u;
+	int id=c->base.ep&15,in=c->base.direction==USBIP_DIR_IN;
+
+	u=calloc(1,sizeof(urb_t));
+	if (!u) return;
+	u->seqnum=c->base.seqnum;
+	u->len=s->transfer_buffer_length;
+	memcpy(u->setup,s->setup,8);
+	if (id) {
+		if (in) id|=16;
+	} else
+		in=u->setup[0]&0x80;
+	u->id=id;
+	u->zlp=!u->len||(s->transfer_flags&USBIP_URB_ZERO_PACKET);
+	if (in) {
+		u->buf=malloc(u->len?u->len:1);
+		u->own=1;
+		if (!u->buf) {
+			free(u);
+			return;
+		}
+	} else if (u->len)
+		u->buf=data;
+	ep=usb_cur_ep(id);
+	if (c->base.ep>15||s->number_of_packets>0||
+		(ep&&ep->type==USB_EPTYPE_ISOCHRONOUS)) {
+		urb_done(u,USBIP_EINVAL);
+		return;
+	}
+	enqueue(uhead+id,utail+id,u);
+	dirty|=1u<<id;
+}
+
+/* removes the URB with the given sequence number, if it has not completed */
+static urb_t *unqueue(u32 seqnum)
+{
+	urb_t *u,*prev;
+	int id;
+
+	if (ctl.urb&&ctl.urb->seqnum==seqnum&&!ctl.urb->internal) {
+		u=ctl.urb;
+		ctl.urb=0;
+		ctl.evt=0;
+		ctl.abort=1;
+		return u;
+	}
+	for (id=0;id<32;++id)
+		for (prev=0,u=uhead[id];u;prev=u,u=u->next)
+			if (u->seqnum==seqnum&&!u->internal) {
+				if (prev)
+					prev->next=u->next;
+				else
+					uhead[id]=u->next;
+				if (utail[id]==u) utail[id]=prev;
+				return u;
+			}
+	return 0;
+}
+
+static void unlink_urb(const usbip_cmd *c)
+{
+	usbip_cmd r;
+	urb_t *u=unqueue(c->u.unlink.seqnum);
+	u8 *p;
+
+	if (u) free_urb(u);
+	p=reply(USBIP_CMD_LEN);
+	if (!p) return;
+	memset(&r,0,sizeof(r));
+	r.base.command=USBIP_RET_UNLINK;
+	r.base.seqnum=c->base.seqnum;
+	r.u.ret_unlink.status=u?USBIP_ECONNRESET:0;
+	usbip_pack_cmd(p,&r);
+}
+
+/* handles the complete commands in rx; returns the number handled, or -1 
+if the host broke the protocol */
+static int parse(void)
+{
+	usbip_op_header h;
+	usbip_cmd c;
+	size_t left,need;
+	u8 *p;
+	int n=0;
+
+	while (!closing) {
+		p=rx+rxofs;
+		left=rxlen-rxofs;
+		if (!imported) {
+			if (left<USBIP_OP_LEN) break;
+			usbip_unpack_op(p,&h);
+			if (h.code==USBIP_OP_REQ_DEVLIST) {
+				rxofs+=USBIP_OP_LEN;
+				devlist();
+			} else if (h.code==USBIP_OP_REQ_IMPORT) {
+				if (left<USBIP_OP_LEN+USBIP_BUSID_LEN) break;
+				rxofs+=USBIP_OP_LEN+USBIP_BUSID_LEN;
+				import((const char *)p+USBIP_OP_LEN);
+			} else
+				return -1;
+			++n;
+			continue;
+		}
+		if (left<USBIP_CMD_LEN) break;
+		usbip_unpack_cmd(p,&c);
+		need=USBIP_CMD_LEN;
+		if (c.base.command==USBIP_CMD_SUBMIT) {
+			if ((u32)c.u.submit.transfer_buffer_length>MAX_URB||
+				c.u.submit.number_of_packets>1024)
+				return -1;
+			if (c.base.direction==USBIP_DIR_OUT)
+				need+=c.u.submit.transfer_buffer_length;
+			if (c.u.submit.number_of_packets>0) // iso descriptors
+				need+=16*c.u.submit.number_of_packets;
+			if (left<need) break;
+			submit(&c,p+USBIP_CMD_LEN);
+		} else if (c.base.command==USBIP_CMD_UNLINK)
+			unlink_urb(&c);
+		else
+			return -1;
+		rxofs+=need;
+		++n;
+	}
+	return n;
+}
+
+/* reads everything the socket holds; returns -1 if the connection has 
+closed */
+static int receive(void)
+{
+	size_t size;
+	ssize_t r;
+	u8 *p;
+
+	if (keep_urbs()) return -1;
+	memmove(rx,rx+rxofs,rxlen-rxofs);
+	rxlen-=rxofs;
+	rxofs=0;
+	for (;;) {
+		if (rxsize-rxlen<16384) {
+			size=rxsize?rxsize*2:65536;
+			p=realloc(rx,size);
+			if (!p) return -1;
+			rx=p;
+			rxsize=size;
+		}
+		r=read(cfd,rx+rxlen,rxsize-rxlen);
+		if (r>0)
+			rxlen+=r;
+		else if (!r)
+			return -1;
+		else if (errno==EAGAIN||errno==EWOULDBLOCK)
+			return 0;
+		else if (errno!=EINTR)
+			return -1;
+	}
+}
+
+/* transfers ------------------- */
+
+/* the oldest request on an endpoint is complete */
+static void req_done(usb_endpoint_t *ep, int id)
+{
+	req_t r=reqs[id][0];
+	int i;
+
+	for (i=1;i<nreqs[id];++i)
+		reqs[id][i-1]=reqs[id][i];
+	--nreqs[id];
+	usb_evt_done(ep,r.data,r.ct,USB_EVT_READY);
+}
+
+/* Moves packets between the endpoint's URBs and requests until one side 
+runs out.  A URB with no request to meet it is NAKed: it waits. */
+static void pump_ep(int id)
+{
+	usb_endpoint_t *ep=usb_cur_ep(id);
+	urb_t *u;
+	req_t *r;
+	u32 mp,n,m;
+	int moved=0;
+
+	if (cevt[id]) {
+		r=creq+id;
+		n=cevt[id];
+		cevt[id]=0;
+		if (ep) usb_evt_done(ep,r->data,r->ct,n);
+	}
+	while ((u=uhead[id])) {
+		if (!ep||!ep->data->maxpkt) {
+			urb_done(pop(id),USBIP_EPROTO);
+			continue;
+		}
+		if (stalled[id]) {
+			urb_done(pop(id),USBIP_EPIPE);
+			continue;
+		}
+		mp=ep->data->maxpkt;
+		if (!(id&16)&&u->ct==u->len&&!(u->zlp&&!(u->len%mp))) {
+			urb_done(pop(id),0);
+			continue;
+		}
+		if (!nreqs[id]) break;
+		r=reqs[id];
+		moved=1;
+		if (id&16) {
+			n=r->len-r->ct;
+			if (n>mp) n=mp;
+			if (n>u->len-u->ct) { // babble: the rest of the packet is lost
+				memcpy(u->buf+u->ct,r->data+r->ct,u->len-u->ct);
+				u->ct=u->len;
+				r->ct+=n;
+				urb_done(pop(id),USBIP_EOVERFLOW);
+			} else {
+				memcpy(u->buf+u->ct,r->data+r->ct,n);
+				u->ct+=n;
+				r->ct+=n;
+				if (!n) r->zlp=0;
+				if (n<mp||u->ct==u->len)
+					urb_done(pop(id),0);
+			}
+			if (r->ct==r->len&&!r->zlp)
+				req_done(ep,id);
+		} else {
+			n=u->len-u->ct;
+			if (n>mp) n=mp;
+			m=r->len-r->ct;
+			if (m>n) m=n; // overflow: the rest of the packet is lost
+			memcpy(r->data+USB_BUF_LEN_SIZE+r->ct,u->buf+u->ct,m);
+			u->ct+=n;
+			r->ct+=m;
+			if (!n) u->zlp=0;
+			if (r->ct>=r->len||(r->chain&&n<mp))
+				req_done(ep,id);
+		}
+	}
+	if (moved&&ep->data->armed)
+		usb_timer_arm(ep);
+}
+
+/* Starts the next control transfer, and reports what the core is owed: 
+each packet it put is taken by the host at once, and each packet of a 
+control write is offered when the last has been taken. */
+static void pump_ctl(void)
+{
+	urb_t *u;
+
+	for (;;) {
+		if (ctl.evt) {
+			u8 e=ctl.evt;
+
+			ctl.evt=0;
+			if (e==CTL_RX)
+				usb_evt_ctl_rx();
+			else
+				usb_evt_ctl_tx();
+			continue;
+		}
+		if (ctl.urb||!uhead[0]) return;
+		if (ctl.abort) {
+			// a SETUP with nothing behind it returns the core to idle
+			ctl.abort=0;
+			usb_evt_setup();
+			continue;
+		}
+		u=ctl.urb=pop(0);
+		ctl.ofs=0;
+		ctl.stalled=0;
+		usb_evt_setup();
+		if (ctl.urb==u&&!(u->setup[0]&0x80)&&u->len)
+			ctl.evt=CTL_RX;
+	}
+}
+
+static void pump(void)
+{
+	u32 d;
+	int id;
+
+	if (pumping) return;
+	pumping=1;
+	while ((d=dirty)) {
+		dirty=0;
+		for (id=0;id<32;++id)
+			if (d&(1u<<id)) {
+				if (id)
+					pump_ep(id);
+				else
+					pump_ctl();
+			}
+	}
+	pumping=0;
+}
+
+static int rxtx(usb_endpoint_t *ep, usb_data_t *data, u16 len, int chain)
+{
+	int id=ep->id;
+	req_t *r;
+
+	if (nreqs[id]>=USBHW_MAX_REQS)
+		return -1;
+	r=reqs[id]+nreqs[id]++;
+	r->data=data;
+	r->len=len;
+	r->ct=0;
+	r->chain=chain;
+	// an IN transfer may end with a zero-length packet
+	r->zlp=(id&16)&&(!len||(chain&&ep->data->maxpkt&&!(len%ep->data->maxpkt)));
+	dirty|=1u<<id;
+	return 0;
+}
+
+int usbhw_tx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,0);
+}
+
+int usbhw_rx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,0);
+}
+
+int usbhw_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,1);
+}
+
+int usbhw_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+{
+	return rxtx(ep,data,len,1);
+}
+
+/* the oldest request is reported at the next pump, as a DMA interrupt 
+would report it */
+void usbhw_cancel(usb_endpoint_t *ep)
+{
+	int id=ep->id;
+
+	if (!nreqs[id]) return;
+	creq[id]=reqs[id][0];
+	cevt[id]=ep->data->stat==USB_EPSTAT_TIMING_OUT?USB_EVT_TIMEOUT:USB_EVT_CANCELLED;
+	nreqs[id]=0;
+	dirty|=1u<<id;
+}
+
+/* control --------------------- */
+
+int usbhw_get_setup(usb_setup_t *s)
+{
+	u8 *b;
+
+	if (!ctl.urb) return -1;
+	b=ctl.urb->setup;
+	s->dataDir=b[0]&0x80?1:0;
+	s->type=(b[0]>>5)&3;
+	s->recipient=b[0]&31;
+	s->request=b[1];
+	s->value=b[3]<<8|b[2];
+	s->index=b[5]<<8|b[4];
+	s->len=b[7]<<8|b[6];
+	return 0;
+}
+
+void usbhw_put_ctl_read_data(u8 len, usb_data_t *d)
+{
+	urb_t *u=ctl.urb;
+
+	if (!u) return;
+	if (len>u->len-u->ct) len=u->len-u->ct;
+	memcpy(u->buf+u->ct,d,len);
+	u->ct+=len;
+	ctl.evt=CTL_TX;
+	dirty|=1;
+}
+
+int usbhw_get_ctl_write_data(u8 *len, usb_data_t *d, int last)
+{
+	urb_t *u=ctl.urb;
+	u32 n;
+
+	if (!u) return -1;
+	if (!*len) return 0;
+	n=u->len-ctl.ofs;
+	if (n>USB_CTL_PACKET_SIZE) n=USB_CTL_PACKET_SIZE;
+	if (n>*len) return -1;
+	memcpy(d,u->buf+ctl.ofs,n);
+	ctl.ofs+=n;
+	*len=n;
+	if (!last) {
+		ctl.evt=CTL_RX;
+		dirty|=1;
+	}
+	return 0;
+}
+
+static void ctl_done(int status)
+{
+	urb_t *u=ctl.urb;
+
+	if (!u) return;
+	ctl.urb=0;
+	ctl.evt=0;
+	urb_done(u,status);
+	dirty|=1;
+}
+
+void usbhw_ctl_write_handshake(void)
+{
+	if (ctl.urb) ctl.urb->ct=ctl.ofs;
+	ctl_done(0);
+}
+
+void usbhw_ctl_read_handshake(void)
+{
+	ctl_done(0);
+}
+
+void usbhw_ctl_stall(void)
+{
+	ctl.stalled=1;
+	ctl_done(USBIP_EPIPE);
+}
+
+int usbhw_ctl_is_stalled(void)
+{
+	return ctl.stalled;
+}
+
+void usbhw_stall(int epn)
+{
+	stalled[epn]=1;
+	dirty|=1u<<epn;
+}
+
+void usbhw_unstall(int epn)
+{
+	stalled[epn]=0;
+	dirty|=1u<<epn;
+}
+
+int usbhw_is_stalled(int epn)
+{
+	return stalled[epn];
+}
+
+void usbhw_set_address(u8 adr)
+{
+	address=adr;
+}
+
+/* endpoints ------------------- */
+
+static void reset_ep(int id)
+{
+	nreqs[id]=0;
+	stalled[id]=0;
+	cevt[id]=0;
+	dirty|=1u<<id;
+}
+
+int usbhw_activate_eps(int cnf)
+{
+	usb_endpoint_t *ep;
+
+	for (ep=usb_get_first_ep(cnf);ep;ep=ep->next)
+		reset_ep(ep->id);
+	return 0;
+}
+
+void usbhw_deactivate_eps(int cnf)
+{
+	usb_endpoint_t *ep;
+
+	for (ep=usb_get_first_ep(cnf);ep;ep=ep->next)
+		reset_ep(ep->id);
+}
+
+int usbhw_set_ep_alt(usb_endpoint_t *ep)
+{
+	reset_ep(ep->id);
+	return 0;
+}
+
+/* interrupts ------------------ */
+
+/* Everything runs in usbip_poll(), so there is nothing to lock out. */
+
+void usbhw_int_dis(void)
+{
+}
+
+void usbhw_int_en(void)
+{
+}
+
+void usbhw_int_en_sof(void)
+{
+	sof_en=1;
+}
+
+void usbhw_int_dis_sof(void)
+{
+	sof_en=0;
+}
+
+void usbhw_int_en_presof(void)
+{
+	presof_en=1;
+}
+
+void usbhw_int_dis_presof(void)
+{
+	presof_en=0;
+}
+
+void usbhw_int_en_txdone(int epn)
+{
+}
+
+void usbhw_int_dis_txdone(int epn)
+{
+}
+
+void usbhw_int_en_rxdone(int epn)
+{
+}
+
+void usbhw_int_dis_rxdone(int epn)
+{
+}
+
+void usbhw_int_en_setup(void)
+{
+}
+
+void usbhw_int_dis_setup(void)
+{
+}
+
+void usbhw_int_en_ctlin(void)
+{
+}
+
+void usbhw_int_dis_ctlin(void)
+{
+}
+
+void usbhw_int_en_ctlout(void)
+{
+}
+
+void usbhw_int_dis_ctlout(void)
+{
+}
+
+/* alarm clock ----------------- */
+
+struct usb_alarm_t {
+	int set;
+};
+
+static long now_ms(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec*1000+t.tv_nsec/1000000;
+}
+
+u32 usbhw_clock(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return (u32)(t.tv_sec*1000000+t.tv_nsec/1000);
+}
+
+u32 usbhw_clock_khz(void)
+{
+	return 1000;
+}
+
+usb_alarm_t *usbhw_mkalarm(void)
+{
+	return calloc(1,sizeof(usb_alarm_t));
+}
+
+void usbhw_rmalarm(usb_alarm_t *alarm)
+{
+	free(alarm);
+}
+
+/* runs the event loop until woken */
+int usbhw_sleep(usb_alarm_t *alarm, int timeout_ms)
+{
+	long end=now_ms()+timeout_ms,left=-1;
+
+	while (!alarm->set) {
+		if (timeout_ms) {
+			left=end-now_ms();
+			if (left<=0) return -1;
+		}
+		if (usbip_poll(left)<0) return -1;
+	}
+	alarm->set=0;
+	return 0;
+}
+
+void usbhw_wake(usb_alarm_t *alarm)
+{
+	alarm->set=1;
+}
+
+/* event loop ------------------ */
+
+/* the 1 ms timer: frames and the timeout clock */
+static void tick(void)
+{
+	unsigned long long k;
+	u32 i;
+
+	if (read(tfd,&k,sizeof(k))!=sizeof(k)) return;
+	if (imported)
+		for (i=0;i<k&&i<8;++i) {
+			if (presof_en) usb_evt_presof();
+			if (sof_en) usb_evt_sof();
+		}
+#ifndef USB_TIMEOUT_SOF
+	usb_evt_tick(k>0xffff?0xffff:k);
+#endif
+}
+
+static void accept_conn(void)
+{
+	int fd=accept(lfd,0,0),one=1;
+
+	if (fd<0) return;
+	if (cfd>=0) { // one host at a time
+		close(fd);
+		return;
+	}
+	fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)|O_NONBLOCK);
+	setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+	if (add_fd(fd)) {
+		close(fd);
+		return;
+	}
+	cfd=fd;
+}
+
+int usbip_poll(int timeout_ms)
+{
+	struct epoll_event ev[4];
+	int i,n,r,handled=0;
+
+	if (lfd<0) return -1;
+	pump();
+	if (cfd>=0) flush();
+	n=epoll_wait(epfd,ev,4,dirty?0:timeout_ms);
+	if (n<0) return errno==EINTR?0:-1;
+	for (i=0;i<n;++i) {
+		if (ev[i].data.fd==tfd)
+			tick();
+		else if (ev[i].data.fd==lfd)
+			accept_conn();
+		else if (ev[i].data.fd==cfd) {
+			if (ev[i].events&EPOLLOUT)
+				flush();
+			if (cfd<0||!(ev[i].events&(EPOLLIN|EPOLLHUP|EPOLLERR)))
+				continue;
+			r=receive();
+			n=parse();
+			if (r<0||n<0) {
+				hangup();
+				continue;
+			}
+			handled+=n;
+		}
+	}
+	pump();
+	if (cfd>=0) flush();
+	return handled;
+}
+
+int usbip_fd(void)
+{
+	return epfd;
+}
+
+/* setup ----------------------- */
+
+void usbhw_reset(void)
+{
+	int id;
+
+	for (id=1;id<32;++id)
+		reset_ep(id);
+	ctl.stalled=0;
+	sof_en=presof_en=0;
+	address=0;
+}
+
+void usbhw_attach(void)
+{
+	struct sockaddr_in sa;
+	struct itimerspec its;
+	int one=1;
+
+	if (lfd>=0) return;
+	lfd=socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0);
+	if (lfd<0) return;
+	setsockopt(lfd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+	memset(&sa,0,sizeof(sa));
+	sa.sin_family=AF_INET;
+	sa.sin_port=htons(params.port?params.port:USBIP_PORT);
+	sa.sin_addr.s_addr=htonl(INADDR_ANY);
+	if ((params.addr&&!inet_aton(params.addr,&sa.sin_addr))||
+		bind(lfd,(struct sockaddr *)&sa,sizeof(sa))||listen(lfd,4)||
+		add_fd(lfd)) {
+		close(lfd);
+		lfd=-1;
+		return;
+	}
+	its.it_interval.tv_sec=its.it_value.tv_sec=0;
+	its.it_interval.tv_nsec=its.it_value.tv_nsec=1000000;
+	timerfd_settime(tfd,0,&its,0);
+}
+
+void usbhw_detach(void)
+{
+	struct itimerspec its;
+
+	if (cfd>=0) hangup();
+	if (lfd>=0) close(lfd);
+	lfd=-1;
+	memset(&its,0,sizeof(its));
+	timerfd_settime(tfd,0,&its,0);
+}
+
+int usbhw_init(void *param)
+{
+	if (!param) return -1;
+	params=*(struct usbip_params *)param;
+	epfd=epoll_create1(0);
+	tfd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK);
+	if (epfd<0||tfd<0||add_fd(tfd))
+		return -1;
+	return 0;
+}
@@ -0,0 +1,289 @@
+// :wrap=soft:
+
+/* port/usbip/usbip.h -- USB/IP protocol definitions */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_usbip_h
+#define GUARD_usbip_h
+
+/* The USB/IP wire format, as spoken by the Linux usbip tools and the 
+vhci-hcd driver.  Every field is big-endian.  The port and the test 
+client both use these. */
+
+//! Standard USB/IP TCP port
+#define USBIP_PORT 3240
+
+//! Protocol version, in the operation header
+#define USBIP_VERSION 0x0111
+
+/*! \name Operations
+
+Sent before a device is imported.  A request is answered by the reply 
+with the same code less 0x8000. */
+//@{
+#define USBIP_OP_REQ_DEVLIST 0x8005
+#define USBIP_OP_REP_DEVLIST 0x0005
+#define USBIP_OP_REQ_IMPORT 0x8003
+#define USBIP_OP_REP_IMPORT 0x0003
+//@}
+
+/*! \name Commands
+
+Sent once a device has been imported. */
+//@{
+#define USBIP_CMD_SUBMIT 1
+#define USBIP_CMD_UNLINK 2
+#define USBIP_RET_SUBMIT 3
+#define USBIP_RET_UNLINK 4
+//@}
+
+//! Direction field of a command: host to device
+#define USBIP_DIR_OUT 0
+//! Direction field of a command: device to host
+#define USBIP_DIR_IN 1
+
+//! Transfer flag: end an OUT transfer which fills its last packet with a zero-length packet
+#define USBIP_URB_ZERO_PACKET 0x40
+
+/*! \name URB status codes
+
+Linux errno values, negated, as carried in usbip_ret_submit#status. */
+//@{
+#define USBIP_EPIPE (-32)
+#define USBIP_EOVERFLOW (-75)
+#define USBIP_EPROTO (-71)
+#define USBIP_ECONNRESET (-104)
+#define USBIP_ESHUTDOWN (-108)
+#define USBIP_EINVAL (-22)
+//@}
+
+//! Length of usbip_op_header
+#define USBIP_OP_LEN 8
+//! Length of usbip_device
+#define USBIP_DEVICE_LEN 312
+//! Length of every command header
+#define USBIP_CMD_LEN 48
+//! Length of the bus id field
+#define USBIP_BUSID_LEN 32
+
+//! Operation header
+typedef struct usbip_op_header {
+	unsigned short version;
+	unsigned short code;
+	unsigned int status;
+} usbip_op_header;
+
+//! Device, as listed and imported
+/*! Followed, in a device list only, by bNumInterfaces records of class, subclass, protocol and a pad byte. */
+typedef struct usbip_device {
+	char path[256];
+	char busid[USBIP_BUSID_LEN];
+	unsigned int busnum, devnum, speed;
+	unsigned short idVendor, idProduct, bcdDevice;
+	unsigned char bDeviceClass, bDeviceSubClass, bDeviceProtocol,
+		bConfigurationValue, bNumConfigurations, bNumInterfaces;
+} usbip_device;
+
+//! Command header common part
+/*! \c ep is the endpoint number, 0-15, and \c direction one of USBIP_DIR_OUT and USBIP_DIR_IN. */
+typedef struct usbip_header_basic {
+	unsigned int command, seqnum, devid, direction, ep;
+} usbip_header_basic;
+
+//! USBIP_CMD_SUBMIT
+/*! Followed by \c transfer_buffer_length bytes of data for an OUT transfer. */
+typedef struct usbip_cmd_submit {
+	unsigned int transfer_flags;
+	int transfer_buffer_length, start_frame, number_of_packets, interval;
+	unsigned char setup[8];
+} usbip_cmd_submit;
+
+//! USBIP_RET_SUBMIT
+/*! Followed by \c actual_length bytes of data for an IN transfer. */
+typedef struct usbip_ret_submit {
+	int status, actual_length, start_frame, number_of_packets, error_count;
+} usbip_ret_submit;
+
+//! USBIP_CMD_UNLINK
+typedef struct usbip_cmd_unlink {
+	unsigned int seqnum;
+} usbip_cmd_unlink;
+
+//! USBIP_RET_UNLINK
+/*! \c status is USBIP_ECONNRESET if the URB was unlinked, or 0 if it had already completed. */
+typedef struct usbip_ret_unlink {
+	int status;
+} usbip_ret_unlink;
+
+//! A command, in host order
+typedef struct usbip_cmd {
+	usbip_header_basic base;
+	union {
+		usbip_cmd_submit submit;
+		usbip_ret_submit ret;
+		usbip_cmd_unlink unlink;
+		usbip_ret_unlink ret_unlink;
+	} u;
+} usbip_cmd;
+
+/*! \name Packing
+
+These convert between the wire format and the structures above.  The 
+buffers are USBIP_CMD_LEN, USBIP_OP_LEN or USBIP_DEVICE_LEN bytes long. */
+//@{
+
+static inline unsigned int usbip_get32(const unsigned char *p)
+{
+	return (unsigned int)p[0]<<24|(unsigned int)p[1]<<16|p[2]<<8|p[3];
+}
+
+static inline void usbip_put32(unsigned char *p, unsigned int v)
+{
+	p[0]=v>>24;
+	p[1]=v>>16;
+	p[2]=v>>8;
+	p[3]=v;
+}
+
+static inline void usbip_put16(unsigned char *p, unsigned short v)
+{
+	p[0]=v>>8;
+	p[1]=v;
+}
+
+static inline void usbip_unpack_cmd(const unsigned char *p, usbip_cmd *c)
+{
+	int i;
+
+	c->base.command=usbip_get32(p);
+	c->base.seqnum=usbip_get32(p+4);
+	c->base.devid=usbip_get32(p+8);
+	c->base.direction=usbip_get32(p+12);
+	c->base.ep=usbip_get32(p+16);
+	switch (c->base.command) {
+	case USBIP_CMD_SUBMIT:
+		c->u.submit.transfer_flags=usbip_get32(p+20);
+		c->u.submit.transfer_buffer_length=usbip_get32(p+24);
+		c->u.submit.start_frame=usbip_get32(p+28);
+		c->u.submit.number_of_packets=usbip_get32(p+32);
+		c->u.submit.interval=usbip_get32(p+36);
+		for (i=0;i<8;++i)
+			c->u.submit.setup[i]=p[40+i];
+		break;
+	case USBIP_RET_SUBMIT:
+		c->u.ret.status=usbip_get32(p+20);
+		c->u.ret.actual_length=usbip_get32(p+24);
+		c->u.ret.start_frame=usbip_get32(p+28);
+		c->u.ret.number_of_packets=usbip_get32(p+32);
+		c->u.ret.error_count=usbip_get32(p+36);
+		break;
+	case USBIP_CMD_UNLINK:
+		c->u.unlink.seqnum=usbip_get32(p+20);
+		break;
+	case USBIP_RET_UNLINK:
+		c->u.ret_unlink.status=usbip_get32(p+20);
+		break;
+	}
+}
+
+static inline void usbip_pack_cmd(unsigned char *p, const usbip_cmd *c)
+{
+	int i;
+
+	for (i=0;i<USBIP_CMD_LEN;++i)
+		p[i]=0;
+	usbip_put32(p,c->base.command);
+	usbip_put32(p+4,c->base.seqnum);
+	usbip_put32(p+8,c->base.devid);
+	usbip_put32(p+12,c->base.direction);
+	usbip_put32(p+16,c->base.ep);
+	switch (c->base.command) {
+	case USBIP_CMD_SUBMIT:
+		usbip_put32(p+20,c->u.submit.transfer_flags);
+		usbip_put32(p+24,c->u.submit.transfer_buffer_length);
+		usbip_put32(p+28,c->u.submit.start_frame);
+		usbip_put32(p+32,c->u.submit.number_of_packets);
+		usbip_put32(p+36,c->u.submit.interval);
+		for (i=0;i<8;++i)
+			p[40+i]=c->u.submit.setup[i];
+		break;
+	case USBIP_RET_SUBMIT:
+		usbip_put32(p+20,c->u.ret.status);
+		usbip_put32(p+24,c->u.ret.actual_length);
+		usbip_put32(p+28,c->u.ret.start_frame);
+		usbip_put32(p+32,c->u.ret.number_of_packets);
+		usbip_put32(p+36,c->u.ret.error_count);
+		break;
+	case USBIP_CMD_UNLINK:
+		usbip_put32(p+20,c->u.unlink.seqnum);
+		break;
+	case USBIP_RET_UNLINK:
+		usbip_put32(p+20,c->u.ret_unlink.status);
+		break;
+	}
+}
+
+static inline void usbip_pack_op(unsigned char *p, const usbip_op_header *h)
+{
+	usbip_put16(p,h->version);
+	usbip_put16(p+2,h->code);
+	usbip_put32(p+4,h->status);
+}
+
+static inline void usbip_unpack_op(const unsigned char *p, usbip_op_header *h)
+{
+	h->version=p[0]<<8|p[1];
+	h->code=p[2]<<8|p[3];
+	h->status=usbip_get32(p+4);
+}
+
+static inline void usbip_pack_device(unsigned char *p, const usbip_device *d)
+{
+	int i;
+
+	for (i=0;i<256;++i)
+		p[i]=d->path[i];
+	for (i=0;i<USBIP_BUSID_LEN;++i)
+		p[256+i]=d->busid[i];
+	usbip_put32(p+288,d->busnum);
+	usbip_put32(p+292,d->devnum);
+	usbip_put32(p+296,d->speed);
+	usbip_put16(p+300,d->idVendor);
+	usbip_put16(p+302,d->idProduct);
+	usbip_put16(p+304,d->bcdDevice);
+	p[306]=d->bDeviceClass;
+	p[307]=d->bDeviceSubClass;
+	p[308]=d->bDeviceProtocol;
+	p[309]=d->bConfigurationValue;
+	p[310]=d->bNumConfigurations;
+	p[311]=d->bNumInterfaces;
+}
+
+//@}
+
+#endif
@@ -31,19 +31,256 @@
 
 static volatile struct {
 	unsigned int suspended:1,
-		state:3;
+		state:3,
+		hs:1;	// high speed
 	u8 address;
 	u8 config;
 } flags;
 
 static usb_cb_sof sofCB, preSOFCB;
+#ifdef USB_TIMEOUT_SOF
+static u8 uframes; // SOFs since the last tick, at high speed
+#endif
+static usb_iso_t *isolist;
 static usb_cb_state stateChangeCallback;
 
+/* request queue ---------------- */
+
+static usb_req_t *qentry(usb_endpoint_t *ep, u8 n)
+{
+	n+=ep->data->qhead;
+	if (n>=ep->queueDepth) n-=ep->queueDepth;
+	return ep->queue+n;
+}
+
+/* Size of one usb_data_t, in bytes */
+#define DATA_UNIT (2/usb_mem_len(2))
+
+/* Length of the next segment of a request with \p left bytes to go in 
+the current element.  Segments are a whole number of packets, so that 
+no short packet is sent or expected between them. */
+static u32 seglen(usb_endpoint_t *ep, u32 left)
+{
+	u32 max=USBHW_MAX_SEG;
+
+	if (ep->data->maxpkt) max-=max%ep->data->maxpkt;
+	return left>max?max:left;
+}
+
+/* Steps over used-up and empty vector elements.  The last element is 
+never stepped over, so that a zero-length request still makes its 
+zero-length packet. */
+static void skipempty(usb_req_t *r, u8 *i, u32 *ofs)
+{
+	while (*ofs>=r->iov[*i].len&&*i+1<r->iovcnt) {
+		++*i;
+		*ofs=0;
+	}
+}
+
+/* Copies the next packet of a vectored IN request, which straddles 
+two or more elements, into the endpoint's bounce buffer.  Returns the 
+length of the packet. */
+static u16 gather(usb_endpoint_t *ep, usb_req_t *r)
+{
+	const usb_iovec_t *e;
+	u32 k;
+	u16 n=0,i;
+
+	for (;;) {
+		e=r->iov+r->ii;
+		k=e->len-r->iofs;
+		if (k>ep->data->maxpkt-n) k=ep->data->maxpkt-n;
+		for (i=0;i<usb_mem_len(k);++i)
+			ep->bounce[usb_mem_len(n)+i]=e->data[usb_mem_len(r->iofs)+i];
+		n+=k;
+		r->iofs+=k;
+		if (n>=ep->data->maxpkt||r->ii+1>=r->iovcnt) break;
+		skipempty(r,&r->ii,&r->iofs);
+	}
+	return n;
+}
+
+/* Hands queued requests to the port, oldest first, until the port 
+has as many segments as it can take.  IN segments are pipelined, even 
+within one request, except behind a bounced packet.  An OUT request 
+has only one segment at the port at a time, since a short packet may 
+end it early.  Must be called with interrupts disabled. */
+static void qpump(usb_endpoint_t *ep)
+{
+	usb_endpoint_data_t *d=ep->data;
+	usb_req_t *r;
+	usb_data_t *data;
+	u32 len,left,ofs;
+	u8 n,i,last;
+	int err;
+
+	for (n=0;n<d->qcount&&d->qactive<USBHW_MAX_REQS&&!d->qbounce;) {
+		r=qentry(ep,n);
+		if (r->flags&USB_REQF_ISSUED) {
+			++n;
+			continue;
+		}
+		if (!(ep->id&16)&&r->issued>r->done)
+			break;
+		skipempty(r,&r->ii,&r->iofs);
+		left=r->iov[r->ii].len-r->iofs;
+		len=seglen(ep,left);
+		data=r->iov[r->ii].data+usb_mem_len(r->iofs);
+		if (!(ep->id&16))
+			data-=USB_BUF_LEN_SIZE;
+		last=r->issued+len>=r->len;
+		if (ep->id&16) {
+			if (len==left&&!last&&ep->data->maxpkt)
+				len-=len%ep->data->maxpkt;
+			if (!len) {
+				// the element ends inside this packet
+				i=r->ii;
+				ofs=r->iofs;
+				len=gather(ep,r);
+				last=r->issued+len>=r->len;
+				if ((r->flags&USB_REQF_CHAIN)&&last)
+					err=usbhw_tx_chain(ep,ep->bounce,len);
+				else
+					err=usbhw_tx(ep,ep->bounce,len);
+				if (err) {
+					r->ii=i;
+					r->iofs=ofs;
+					break;
+				}
+				d->qbounce=1;
+			} else {
+				if ((r->flags&USB_REQF_CHAIN)&&last)
+					err=usbhw_tx_chain(ep,data,len);
+				else
+					err=usbhw_tx(ep,data,len);
+				if (err) break;
+				r->iofs+=len;
+			}
+		} else {
+#if USB_BUF_LEN_SIZE
+			// the port writes the length word in front of the 
+			// segment: in the buffer's headroom for the first, and 
+			// on the last word of the one before for the others
+			if (r->iofs) r->saved=*data;
+#endif
+			if (r->flags&USB_REQF_CHAIN)
+				err=usbhw_rx_chain(ep,data,len);
+			else
+				err=usbhw_rx(ep,data,len);
+			if (err) break;
+			r->iofs+=len;
+		}
+		r->issued+=len;
+		if (last)
+			r->flags|=USB_REQF_ISSUED;
+		++d->qactive;
+	}
+}
+
+/* Accounts for the oldest segment at the port, which always belongs 
+to the oldest request.  Returns nonzero once the request is finished, 
+either because all of it has been moved or because an OUT segment 
+came up short. */
+static int segdone(usb_endpoint_t *ep, usb_req_t *r, u16 len)
+{
+	const usb_iovec_t *e;
+	u32 want;
+
+	r->done+=len;
+	if (ep->id&16)
+		return r->done>=r->len;
+	skipempty(r,&r->di,&r->dofs);
+	e=r->iov+r->di;
+	want=seglen(ep,e->len-r->dofs);
+#if USB_BUF_LEN_SIZE
+	if (r->dofs)
+		e->data[usb_mem_len(r->dofs)-USB_BUF_LEN_SIZE]=r->saved;
+#endif
+	r->dofs+=len;
+	return len<want||r->done>=r->len;
+}
+
+/* Removes the oldest request from the queue. */
+static void qpop(usb_endpoint_t *ep)
+{
+	usb_endpoint_data_t *d=ep->data;
+
+	if (!d->qcount) return;
+	if (++d->qhead>=ep->queueDepth) d->qhead=0;
+	--d->qcount;
+}
+
+static void qclear(usb_endpoint_t *ep)
+{
+	usb_timer_disarm(ep);
+	ep->data->qhead=0;
+	ep->data->qcount=0;
+	ep->data->qactive=0;
+	ep->data->qbounce=0;
+}
+
+static int submit(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n, u8 flags)
+{
+	usb_endpoint_data_t *d;
+	usb_req_t *r;
+	u32 len=0;
+	u8 i;
+
+	if (!ep) return -2;
+	if (!iov||!n) return -3;
+	for (i=0;i<n;++i) {
+		if (i+1<n) {
+			if (iov[i].len%DATA_UNIT) return -3;
+			if (ep->data->maxpkt&&iov[i].len%ep->data->maxpkt&&
+				(!(ep->id&16)||!ep->bounce)) return -3;
+		}
+		len+=iov[i].len;
+	}
+	d=ep->data;
+	usbhw_int_dis();
+	if ((d->stat!=USB_EPSTAT_IDLE&&d->stat!=USB_EPSTAT_XFER)||
+		d->qcount>=ep->queueDepth) {
+		usbhw_int_en();
+		return -1;
+	}
+	r=qentry(ep,d->qcount);
+	if (n==1) {
+		r->one=*iov;
+		r->iov=&r->one;
+	} else {
+		r->iov=iov;
+	}
+	r->iovcnt=n;
+	r->len=len;
+	r->issued=0;
+	r->done=0;
+	r->ii=0;
+	r->iofs=0;
+	r->di=0;
+	r->dofs=0;
+	r->flags=flags;
+	// the timeout runs from the moment an idle endpoint is given work
+	if (!d->qcount++) usb_timer_arm(ep);
+	usb_set_epstat(ep,USB_EPSTAT_XFER);
+	qpump(ep);
+	usbhw_int_en();
+	return 0;
+}
+
 void usb_cancel(usb_endpoint_t *ep)
 {
 	if (!ep) return;
-	usb_set_epstat(ep,USB_EPSTAT_CANCELLING);
-	usbhw_cancel(ep);
+	usbhw_int_dis();
+	if (ep->data->qcount&&ep->data->stat!=USB_EPSTAT_CANCELLING&&
+		ep->data->stat!=USB_EPSTAT_TIMING_OUT) {
+		usb_set_epstat(ep,USB_EPSTAT_CANCELLING);
+		if (ep->data->qactive)
+			usbhw_cancel(ep);
+		else
+			usb_do_done(ep,qentry(ep,0)->iov->data,0,USB_EVT_CANCELLED);
+	}
+	usbhw_int_en();
 }
 
 #if 0
@@ -143,36 +380,452 @@ void usb_evt_cpdone(usb_endpoint_t *ep)
 }
 #endif
 
-void usb_evt_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt)
+/* streaming ------------------- */
+
+/* Ends a flushed IN stream's transfer.  A zero-length packet is needed 
+only if the last block did not already end in a short packet.  The 
+ZLP is queued as a request with no data, which the stream skips when 
+it comes back. */
+static void stream_end(usb_endpoint_t *ep)
 {
-	//usb_set_epstat(ep,USB_EPSTAT_IDLE);
-	if (ep->data->evt_cb) ep->data->evt_cb(ep,data,len,evt);
+	usb_stream_t *s=ep->data->stream;
+	usb_iovec_t v;
+
+	if (s->open) {
+		v.data=0;
+		v.len=0;
+		if (submit(ep,&v,1,USB_REQF_CHAIN))
+			return;
+	}
+	s->open=0;
+	s->flushing=0;
+}
+
+/* Keeps the endpoint's queue full of blocks from the stream.  When the 
+stream has no block and nothing is armed, the endpoint NAKs until 
+usb_stream_kick() is called.  OUT blocks are chained, so that a short 
+packet ends a block early; IN blocks are not, so that the host sees 
+one continuous transfer until the producer flushes. */
+static void stream_fill(usb_endpoint_t *ep)
+{
+	usb_stream_t *s=ep->data->stream;
+	usb_iovec_t v;
+	int err;
+
+	while (ep->data->qcount<ep->queueDepth) {
+		v.len=s->blocklen;
+		v.data=s->get(s,&v.len);
+		if (!v.data) {
+			if (s->flushing)
+				stream_end(ep);
+			if (!ep->data->qcount&&!s->starved) {
+				s->starved=1;
+				// an idle IN stream is not an underrun
+				if (!(ep->id&16)||s->open) ++s->full;
+			}
+			return;
+		}
+		if (ep->id&16) {
+			err=submit(ep,&v,1,0);
+			s->open=ep->data->maxpkt&&!(v.len%ep->data->maxpkt);
+		} else
+			err=submit(ep,&v,1,USB_REQF_CHAIN);
+		if (err) {
+			// can't happen, but don't lose the block
+			s->put(s,v.data,0);
+			return;
+		}
+		s->starved=0;
+	}
+}
+
+/* Records the ring's level, and calls the mark callback if it is past 
+a watermark and the callback has not been called since the last kick. */
+static void stream_level(usb_stream_t *s, u32 level)
+{
+	if (level>s->maxlevel) s->maxlevel=level;
+	if (!s->mark||s->marked) return;
+	if (level<=s->lowat||(s->hiwat&&level>=s->hiwat)) {
+		s->marked=1;
+		s->mark(s,level);
+	}
+}
+
+/* Stands in for the event callback on a streaming endpoint. */
+static void stream_evt(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
+{
+	usb_stream_t *s=ep->data->stream;
+
+	// a request with no data is the ZLP ending an IN stream
+	if (data) stream_level(s,s->put(s,data,len));
+	if (evt==USB_EVT_READY) {
+		if (data) ++s->blocks;
+		stream_fill(ep);
+	} else if (!ep->data->qcount) {
+		// cancelled or timed out; the stream is over
+		ep->data->stream=0;
+	}
+}
+
+/* Hands every armed block back to the stream, empty, and detaches it.  
+Used when the endpoint goes away under the stream. */
+static void stream_drop(usb_endpoint_t *ep)
+{
+	usb_stream_t *s=ep->data->stream;
+
+	if (!s) return;
+	while (ep->data->qcount) {
+		if (qentry(ep,0)->iov->data)
+			s->put(s,qentry(ep,0)->iov->data,0);
+		qpop(ep);
+	}
+	ep->data->stream=0;
+}
+
+/* isochronous engine ----------- */
+
+#ifdef USBHW_HAVE_PRESOF
+#define iso_int_en() usbhw_int_en_presof()
+#define iso_int_dis() if (!preSOFCB) usbhw_int_dis_presof()
+#else
+#define iso_int_en() usbhw_int_en_sof()
+#ifdef USB_TIMEOUT_SOF
+#define iso_int_dis()
+#else
+#define iso_int_dis() if (!sofCB) usbhw_int_dis_sof()
+#endif
+#endif
+
+/* Stages the coming frame's packet on each running isochronous 
+endpoint.  A packet still at the port from the last frame was not moved 
+in its frame; it is left to go in this one. */
+static void iso_frame(void)
+{
+	usb_iso_t *s;
+	usb_endpoint_t *ep;
+	usb_iovec_t v;
+	u16 len,max;
+
+	for (s=isolist;s;s=s->next) {
+		ep=s->ep;
+		++s->frames;
+		// at high speed, this is called every microframe
+		if (flags.hs&&ep->hsInterval>1&&(s->frames&(ep->hsInterval-1)))
+			continue;
+		if (ep->data->qcount) {
+			++s->missed;
+			continue;
+		}
+		max=ep->data->maxpkt*ep->data->mult;
+		len=max;
+		v.data=s->get(s,&len);
+		if (!v.data) {
+			if (ep->id&16)
+				++s->underruns;
+			else
+				++s->overruns;
+			continue;
+		}
+		if (len>max) len=max;
+		v.len=(ep->id&16)?len:max;
+		// a chained IN request of 0 bytes is a zero-length packet
+		if (submit(ep,&v,1,(ep->id&16)&&len?0:USB_REQF_CHAIN)) {
+			++s->missed;
+			s->put(s,v.data,0);
+		}
+	}
 }
 
-int usb_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+static void iso_unlink(usb_iso_t *s)
 {
-	return usbhw_rx_chain(ep,data,len);
+	usb_iso_t **p;
+
+	for (p=&isolist;*p;p=&(*p)->next)
+		if (*p==s) {
+			*p=s->next;
+			break;
+		}
+	s->running=0;
+	if (!isolist) iso_int_dis();
 }
 
-int usb_rx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+/* Stands in for the event callback on an isochronous endpoint.  A 
+cancellation or timeout does not stop the engine unless usb_iso_stop() 
+asked for it. */
+static void iso_evt(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
 {
-	return usbhw_rx(ep,data,len);
+	usb_iso_t *s=ep->data->iso;
+
+	if (evt==USB_EVT_READY) {
+		++s->packets;
+		s->put(s,data,len);
+	} else
+		s->put(s,data,0);
+	if (!s->running&&!ep->data->qcount)
+		ep->data->iso=0;
 }
 
-int usb_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+/* Hands back the staged packet, if any, and detaches the ring.  Used 
+when the endpoint goes away under the engine. */
+static void iso_drop(usb_endpoint_t *ep)
 {
-	return usbhw_tx_chain(ep,data,len);
+	usb_iso_t *s=ep->data->iso;
+
+	if (!s) return;
+	iso_unlink(s);
+	while (ep->data->qcount) {
+		s->put(s,qentry(ep,0)->iov->data,0);
+		qpop(ep);
+	}
+	ep->data->iso=0;
 }
 
-int usb_tx(usb_endpoint_t *ep, usb_data_t *data, u16 len)
+static void notify(usb_endpoint_t *ep, usb_data_t *data, u32 len, u8 evt)
 {
-	return usbhw_tx(ep,data,len);
+	if (ep->data->stream)
+		stream_evt(ep,data,len,evt);
+	else if (ep->data->iso)
+		iso_evt(ep,data,len,evt);
+	else if (ep->data->evt_cb)
+		ep->data->evt_cb(ep,data,len,evt);
+}
+
+void usb_do_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt)
+{
+	usb_endpoint_data_t *d=ep->data;
+	usb_req_t *r;
+	u32 total=len;
+	u8 n;
+
+	if (evt==USB_EVT_READY) {
+		if (!d->qactive) return;
+		if (!--d->qactive)
+			d->qbounce=0;
+		r=qentry(ep,0);
+		if (!segdone(ep,r,len)) {
+			// more segments to go
+			usb_timer_arm(ep);
+			qpump(ep);
+			return;
+		}
+		data=r->iov->data;
+		total=r->done;
+		qpop(ep);
+		// keep the port busy before the user gets control
+		qpump(ep);
+		if (d->qcount)
+			usb_timer_arm(ep);
+		else
+			usb_timer_disarm(ep);
+		if (!d->qcount&&d->stat==USB_EPSTAT_XFER)
+			usb_set_epstat(ep,USB_EPSTAT_IDLE);
+	} else if (evt==USB_EVT_CANCELLED||evt==USB_EVT_TIMEOUT) {
+		if (!d->qcount) return;
+		// the port has stopped everything it had; the requests 
+		// behind the one it reported are retired here
+		r=qentry(ep,0);
+		if (r->issued>r->done)
+			segdone(ep,r,len);
+		data=r->iov->data;
+		total=r->done;
+		d->qactive=0;
+		d->qbounce=0;
+		n=d->qcount;
+		for (;;) {
+			qpop(ep);
+			if (n<=1) {
+				qclear(ep);
+				usb_set_epstat(ep,USB_EPSTAT_IDLE);
+			}
+			notify(ep,data,total,evt);
+			if (n<=1) return;
+			--n;
+			data=qentry(ep,0)->iov->data;
+			total=0;
+			evt=USB_EVT_CANCELLED;
+		}
+	}
+	notify(ep,data,total,evt);
+}
+
+int usb_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u32 len)
+{
+	usb_iovec_t v;
+
+	v.data=data;
+	v.len=len;
+	return submit(ep,&v,1,USB_REQF_CHAIN);
+}
+
+int usb_rx(usb_endpoint_t *ep, usb_data_t *data, u32 len)
+{
+	usb_iovec_t v;
+
+	v.data=data;
+	v.len=len;
+	return submit(ep,&v,1,0);
+}
+
+int usb_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u32 len)
+{
+	usb_iovec_t v;
+
+	v.data=data;
+	v.len=len;
+	return submit(ep,&v,1,USB_REQF_CHAIN);
+}
+
+int usb_tx(usb_endpoint_t *ep, usb_data_t *data, u32 len)
+{
+	usb_iovec_t v;
+
+	v.data=data;
+	v.len=len;
+	return submit(ep,&v,1,0);
+}
+
+int usb_txv(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n)
+{
+	return submit(ep,iov,n,0);
+}
+
+int usb_txv_chain(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n)
+{
+	return submit(ep,iov,n,USB_REQF_CHAIN);
+}
+
+int usb_rxv(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n)
+{
+	return submit(ep,iov,n,0);
+}
+
+int usb_rxv_chain(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n)
+{
+	return submit(ep,iov,n,USB_REQF_CHAIN);
+}
+
+static int stream_start(usb_endpoint_t *ep, usb_stream_t *s)
+{
+	if (!s||!s->get||!s->put||!s->blocklen) return -2;
+	usbhw_int_dis();
+	if (ep->data->stat!=USB_EPSTAT_IDLE||ep->data->qcount||ep->data->stream) {
+		usbhw_int_en();
+		return -1;
+	}
+	s->blocks=0;
+	s->full=0;
+	s->maxlevel=0;
+	s->marked=0;
+	s->starved=0;
+	s->flushing=0;
+	s->open=0;
+	ep->data->stream=s;
+	stream_fill(ep);
+	usbhw_int_en();
+	return 0;
+}
+
+int usb_rx_stream(usb_endpoint_t *ep, usb_stream_t *s)
+{
+	if (!ep||ep->id&16) return -2;
+	return stream_start(ep,s);
+}
+
+int usb_tx_stream(usb_endpoint_t *ep, usb_stream_t *s)
+{
+	if (!ep||!(ep->id&16)) return -2;
+	return stream_start(ep,s);
+}
+
+void usb_stream_kick(usb_endpoint_t *ep)
+{
+	if (!ep) return;
+	usbhw_int_dis();
+	if (ep->data->stream&&ep->data->stat!=USB_EPSTAT_CANCELLING&&
+		ep->data->stat!=USB_EPSTAT_TIMING_OUT) {
+		ep->data->stream->marked=0;
+		stream_fill(ep);
+	}
+	usbhw_int_en();
+}
+
+void usb_stream_flush(usb_endpoint_t *ep)
+{
+	if (!ep||!(ep->id&16)) return;
+	usbhw_int_dis();
+	if (ep->data->stream&&ep->data->stat!=USB_EPSTAT_CANCELLING&&
+		ep->data->stat!=USB_EPSTAT_TIMING_OUT) {
+		ep->data->stream->flushing=1;
+		stream_fill(ep);
+	}
+	usbhw_int_en();
+}
+
+int usb_iso_start(usb_endpoint_t *ep, usb_iso_t *s)
+{
+	if (!ep||ep->type!=USB_EPTYPE_ISOCHRONOUS) return -2;
+	if (!s||!s->get||!s->put) return -2;
+	usbhw_int_dis();
+	if (ep->data->stat!=USB_EPSTAT_IDLE||ep->data->qcount||
+		ep->data->stream||ep->data->iso) {
+		usbhw_int_en();
+		return -1;
+	}
+	s->frames=0;
+	s->packets=0;
+	s->underruns=0;
+	s->overruns=0;
+	s->missed=0;
+	s->running=1;
+	s->ep=ep;
+	s->next=isolist;
+	isolist=s;
+	ep->data->iso=s;
+	iso_int_en();
+	usbhw_int_en();
+	return 0;
+}
+
+void usb_iso_stop(usb_endpoint_t *ep)
+{
+	u8 n;
+
+	if (!ep) return;
+	usbhw_int_dis();
+	if (!ep->data->iso||!ep->data->iso->running) {
+		usbhw_int_en();
+		return;
+	}
+	iso_unlink(ep->data->iso);
+	n=ep->data->qcount;
+	if (!n) ep->data->iso=0;
+	usbhw_int_en();
+	// the ring detaches itself when the staged packet comes back
+	if (n) usb_cancel(ep);
+}
+
+void usb_stream_stop(usb_endpoint_t *ep)
+{
+	u8 n;
+
+	if (!ep) return;
+	usbhw_int_dis();
+	n=ep->data->qcount;
+	if (!n) ep->data->stream=0;
+	usbhw_int_en();
+	// the stream detaches itself when the last block comes back
+	if (n) usb_cancel(ep);
 }
 
 void usb_set_sof_cb(usb_cb_sof cb)
 {
 	if (!cb) {
+#ifndef USB_TIMEOUT_SOF
+#ifndef USBHW_HAVE_PRESOF
+		if (!isolist)
+#endif
 		usbhw_int_dis_sof();
+#endif
 		sofCB=cb;
 	} else {
 		sofCB=cb;
@@ -183,6 +836,9 @@ void usb_set_sof_cb(usb_cb_sof cb)
 void usb_set_presof_cb(usb_cb_sof cb)
 {
 	if (!cb) {
+#ifdef USBHW_HAVE_PRESOF
+		if (!isolist)
+#endif
 		usbhw_int_dis_presof();
 		preSOFCB=cb;
 	} else {
@@ -214,10 +870,12 @@ int usb_stall(usb_endpoint_t *ep)
 int usb_unstall(usb_endpoint_t *ep)
 {
 	if (!ep) return -1;
-	if (usb_get_epstat(ep)==USB_EPSTAT_XFER)
+	// a cancellation returns the endpoint to IDLE when it completes
+	if (ep->data->qcount)
 		usb_cancel(ep);
 	usbhw_unstall(ep->id);
-	usb_set_epstat(ep,USB_EPSTAT_IDLE);
+	if (!ep->data->qcount)
+		usb_set_epstat(ep,USB_EPSTAT_IDLE);
 	return 0;
 }
 
@@ -239,20 +897,52 @@ static void sendepevt(int e, int stat)
 	}
 }
 
+static void set_ep_alt(usb_endpoint_t *ep, int alt)
+{
+	u16 w;
+
+	ep->data->mult=1;
+	if (flags.hs&&ep->hsAltPacketSize) {
+		w=ep->hsAltPacketSize[alt];
+		ep->data->maxpkt=w&0x7ff;
+		ep->data->mult+=(w>>11)&3;
+	} else
+		ep->data->maxpkt=ep->altPacketSize?ep->altPacketSize[alt]:ep->packetSize;
+}
+
+static void ep_up(usb_endpoint_t *ep)
+{
+	if (usb_get_epstat(ep)==USB_EPSTAT_INACTIVE&&ep->data->maxpkt) {
+		usb_set_epstat(ep,USB_EPSTAT_IDLE);
+		if (ep->data->evt_cb) ep->data->evt_cb(ep,0,0,USB_EVT_CONFIGURED);
+	}
+}
+
+static void ep_down(usb_endpoint_t *ep)
+{
+	usb_set_epstat(ep,USB_EPSTAT_INACTIVE);
+	stream_drop(ep);
+	iso_drop(ep);
+	qclear(ep);
+	if (ep->data->evt_cb) ep->data->evt_cb(ep,0,0,USB_EVT_DECONFIGURED);
+}
+
 static int activate_endpoints(int config)
 {
 	usb_endpoint_t *ep;
+	unsigned int i;
 
+	for (i=0;i<USB_MAX_IFACES;++i)
+		usb_iface_alt[i]=0;
+	for (ep=usb_get_first_ep(config);ep;ep=ep->next)
+		set_ep_alt(ep,0);
 	if (usbhw_activate_eps(config)) {
 		usbhw_deactivate_eps(config);
 		return -1;
 	}
 	ep=usb_get_first_ep(config);
 	while(ep) {
-		if (usb_get_epstat(ep)==USB_EPSTAT_INACTIVE) {
-			usb_set_epstat(ep,USB_EPSTAT_IDLE);
-			if (ep->data->evt_cb) ep->data->evt_cb(ep,0,0,USB_EVT_CONFIGURED);
-		}
+		ep_up(ep);
 		ep=ep->next;
 	}
 	return 0;
@@ -267,29 +957,64 @@ static void deactivate_endpoints(void)
 	usbhw_deactivate_eps(config);
 	ep=usb_get_first_ep(config);
 	while(ep) {
-		usb_set_epstat(ep,USB_EPSTAT_INACTIVE);
-		if (ep->data->evt_cb) ep->data->evt_cb(ep,0,0,USB_EVT_DECONFIGURED);
+		ep_down(ep);
 		ep=ep->next;
 	}
 }
 
+int usb_set_interface(int iface, int alt)
+{
+	usb_endpoint_t *ep;
+	int err=0;
+
+	if (usb_get_state()!=USB_STATE_CONFIGURED) return -1;
+	if (iface<0||alt<0||alt>=usb_alt_count(flags.config,iface)) return -1;
+	usb_iface_alt[iface]=alt;
+	// the endpoints are reset even if the setting is unchanged, which 
+	// resets their data toggles
+	for (ep=usb_get_first_ep(flags.config);ep;ep=ep->next) {
+		if (ep->iface!=iface) continue;
+		if (ep->data->maxpkt) ep_down(ep);
+		set_ep_alt(ep,alt);
+		if (usbhw_set_ep_alt(ep)) {
+			ep->data->maxpkt=0;
+			err=-1;
+		}
+		ep_up(ep);
+	}
+	return err;
+}
+
+int usb_get_interface(int iface)
+{
+	if (usb_get_state()!=USB_STATE_CONFIGURED) return -1;
+	if (iface<0||!usb_alt_count(flags.config,iface)) return -1;
+	return usb_iface_alt[iface];
+}
+
 int usb_set_config(int cfn)
 {
 	if (usb_get_state()!=USB_STATE_ADDRESS&&usb_get_state()!=USB_STATE_CONFIGURED)
 		return -1;
+	if (cfn&&!usb_have_config(cfn)) return -1;
+	if (usb_get_state()==USB_STATE_CONFIGURED) {
+		if (flags.config==cfn)
+			return 0;
+		deactivate_endpoints();
+	}
+	flags.config=cfn;
+	usb_select_ep_table(cfn);
 	if (!cfn) {
+		usb_set_state(USB_STATE_ADDRESS);
+		return 0;
+	}
+	if (activate_endpoints(cfn)) {
 		flags.config=0;
+		usb_select_ep_table(0);
 		usb_set_state(USB_STATE_ADDRESS);
-	} else {
-		if (usb_get_state()==USB_STATE_CONFIGURED) {
-			if (flags.config==cfn)
-				return 0;
-		}
-		if (!usb_have_config(cfn)) return -1;
-		flags.config=cfn;
-		if (activate_endpoints(cfn)) return -1;
-		usb_set_state(USB_STATE_CONFIGURED);
+		return -1;
 	}
+	usb_set_state(USB_STATE_CONFIGURED);
 	return 0;
 }
 
@@ -298,6 +1023,17 @@ int usb_get_config(void)
 	return flags.config;
 }
 
+void usb_evt_speed(int speed)
+{
+	flags.hs=(speed==USB_SPEED_HIGH);
+	usb_select_speed(flags.hs);
+}
+
+int usb_get_speed(void)
+{
+	return flags.hs?USB_SPEED_HIGH:USB_SPEED_FULL;
+}
+
 int usb_get_state(void)
 {
 	if (flags.suspended) return USB_STATE_SUSPENDED;
@@ -319,33 +1055,51 @@ void usb_set_state(int state)
 
 void usb_evt_sof(void)
 {
+#ifdef USB_TIMEOUT_SOF
+	// high-speed SOFs come every microframe
+	if (!flags.hs||!(++uframes&7))
+		usb_evt_tick(1);
+#endif
+#ifndef USBHW_HAVE_PRESOF
+	iso_frame();
+#endif
 	if (sofCB) sofCB();
 }
 
 void usb_evt_presof(void)
 {
+#ifdef USBHW_HAVE_PRESOF
+	iso_frame();
+#endif
 	if (preSOFCB) preSOFCB();
 }
 
-void usb_evt_reset(void)
+void usb_do_reset(void)
 {
 	deactivate_endpoints();
+	flags.config=0;
+	usb_select_ep_table(0);
 
 	flags.suspended=0;
 	usb_set_state(USB_STATE_DEFAULT);
 	usbhw_reset();
-	// sof & presof interrupts only set if we have callbacks
+	// sof & presof interrupts only set if we have callbacks, or if 
+	// SOF is the timeout clock
+#ifdef USB_TIMEOUT_SOF
+	usbhw_int_en_sof();
+#else
 	if (sofCB) usbhw_int_en_sof();
+#endif
 	if (preSOFCB) usbhw_int_en_presof();
 }
 
-void usb_evt_suspend(void)
+void usb_do_suspend(void)
 {
 	usb_set_state(USB_STATE_SUSPENDED);
 	sendepevt(USB_EVT_SUSPENDED,-1);
 }
                                                
-void usb_evt_resume(void)
+void usb_do_resume(void)
 {
 	if (!flags.suspended) return;
 	flags.suspended=0;
@@ -398,9 +1152,15 @@ void usb_set_ep_timeout(usb_endpoint_t *ep, u16 ms)
 void usb_evt_timeout(usb_endpoint_t *ep)
 {
 	//usbhw_dmalog_write(USBHW_DMALOG_TIMEOUT,ep->id);
-	if (usb_get_epstat(ep)!=USB_EPSTAT_XFER) return;
-	usb_set_epstat(ep,USB_EPSTAT_TIMING_OUT);
-	usbhw_cancel(ep);
+	usbhw_int_dis();
+	if (usb_get_epstat(ep)==USB_EPSTAT_XFER) {
+		usb_set_epstat(ep,USB_EPSTAT_TIMING_OUT);
+		if (ep->data->qactive)
+			usbhw_cancel(ep);
+		else
+			usb_do_done(ep,qentry(ep,0)->iov->data,0,USB_EVT_TIMEOUT);
+	}
+	usbhw_int_en();
 }
 
 int usb_is_attached(void)
@@ -426,36 +1186,46 @@ void usb_detach(void)
 #ifdef USBHW_HAVE_ATTACH
 	if (!usb_is_attached()) return;
 	usb_set_state(USB_STATE_DETACHED);
+	usbhw_detach();
 #endif
 }
 
 void usb_init(void *param)
 {
 	usb_endpoint_t *ep;
+	int cfn;
 
 	flags.state=USB_STATE_DETACHED;
 	flags.config=0;
+	usb_select_ep_table(0);
 	flags.suspended=0;
 	flags.address=0;
+	flags.hs=0;
+	usb_select_speed(0);
 	usb_ctl_init();
 	sofCB=preSOFCB=0;
+	isolist=0;
+	usb_timer_init();
 	stateChangeCallback=0;
 
-	// ### TODO: need to do this for all configurations
-	ep=usb_get_first_ep(1);
-	while (ep) {
-		if (!ep) continue;
-		ep->data->stat=USB_EPSTAT_INACTIVE;
-		ep->data->timed_out=0;
-		ep->data->timeout=3000;
-		//ep->data->epstat_cb=0;
-		ep->data->evt_cb=0;
-		//ep->data->cp_ptr=0;
-		ep->data->buf=0;
-		ep->data->reqlen=0;
-		ep->data->actlen=0;
-		ep->data->hwdata=0;
-		ep=ep->next;
+	for (cfn=1;usb_have_config(cfn);++cfn) {
+		for (ep=usb_get_first_ep(cfn);ep;ep=ep->next) {
+			ep->data->stat=USB_EPSTAT_INACTIVE;
+			ep->data->timed_out=0;
+			ep->data->timeout=3000;
+			//ep->data->epstat_cb=0;
+			ep->data->evt_cb=0;
+			//ep->data->cp_ptr=0;
+			ep->data->buf=0;
+			ep->data->reqlen=0;
+			ep->data->actlen=0;
+			ep->data->hwdata=0;
+			ep->data->stream=0;
+			ep->data->iso=0;
+			ep->data->armed=0;
+			set_ep_alt(ep,0);
+			qclear(ep);
+		}
 	}
 	usbhw_init(param);
 	usbhw_int_en();
@@ -107,6 +107,17 @@ configured.
 */
 int usb_get_config(void);
 
+//! Get an interface's alternate setting
+/*! Returns the alternate setting the host has selected for interface 
+\p iface of the current configuration, or -1 if the node is not 
+configured or there is no such interface.  Endpoints which are not part 
+of the current setting are inactive; each endpoint receives 
+USB_EVT_DECONFIGURED and USB_EVT_CONFIGURED as the host switches.
+
+\ingroup grp_public_support
+*/
+int usb_get_interface(int iface);
+
 //! Attach the node
 /*! Causes the USB hardware to attach to the bus, on systems that 
 support this.  On systems without this capability, nothing happens.
@@ -165,6 +176,44 @@ void usb_remote_wakeup(void);
 */
 void usb_set_state_cb(usb_cb_state cb);
 
+//! Get bus speed
+/*! Returns USB_SPEED_HIGH if the port has reported a high-speed connection since the last reset, otherwise USB_SPEED_FULL.  At high speed, the SOF and pre-SOF callbacks are called every microframe (125 us).
+
+\sa grp_speeds
+
+\ingroup grp_public_support
+*/
+int usb_get_speed(void);
+
+//! Dispatch deferred events
+/*! If the configuration sets \c eventMode=deferred, the port's interrupt service routine does no more than acknowledge the hardware and record each event in a ring; this function hands the recorded events to the core, oldest first, and returns how many it handled.  Request callbacks, stream and control callbacks (including usb_ctl()) then run in the caller's context instead of under interrupt.
+
+Call it from a single thread, for example a SWI posted by the callback set with usb_set_dispatch_cb(), or from a polling loop.  Each event is handled with USB interrupts disabled, so other interrupts are not held off, and the interrupt service routine is held off for one event at most.  The callbacks may submit and cancel requests; usbhw_int_dis() nests, so the interrupt stays disabled until the event is finished.
+
+SOF and pre-SOF callbacks, the isochronous engine, and timeouts are never deferred.
+
+Without deferred events, events are handled under interrupt as they occur and this function returns 0.
+
+\ingroup grp_public_io
+*/
+int usb_dispatch(void);
+
+//! Set event callback
+/*! Sets a callback which is called under interrupt each time an event is recorded for usb_dispatch().  Pass 0 to unset it.  It is never called without deferred events.
+
+\sa usb_cb_dispatch
+
+\ingroup grp_public_io
+*/
+void usb_set_dispatch_cb(usb_cb_dispatch cb);
+
+//! Number of lost events
+/*! Returns the number of events that were dropped because the event ring was full.  Any lost event leaves the core out of step with the hardware, so this should stay 0.  Unless \c eventQueueLen is set, usbgen sizes the ring for the worst case, so a lost event points to a port which posts more events than it should.
+
+\ingroup grp_public_io
+*/
+u16 usb_dispatch_lost(void);
+
 //! Get endpoint status
 /*! Returns the status of the given endpoint.  See grp_epstat for a list of possible states.
 
@@ -179,6 +228,17 @@ This cannot be used for control endpoints.  If it is, -1 is returned.
 //int usb_get_epstat(usb_endpoint_t *ep);
 #define usb_get_epstat(EP) ((EP)?((EP)->data->stat):(-1))
 
+//! Get number of queued requests
+/*! Returns the number of transfer requests outstanding on the given endpoint, including the one in progress.  This is never more than the endpoint's queue depth, which is set by the \c queueDepth option in the configuration file.
+
+\param[in] ep Endpoint
+\retval >=0 Number of outstanding requests
+\retval -1 Invalid endpoint
+
+\ingroup grp_public_io
+*/
+#define usb_get_ep_queued(EP) ((EP)?((int)((EP)->data->qcount)):(-1))
+
 int usb_set_evt_cb(usb_endpoint_t *ep, usb_evt_cb cb);
 
 //! Stall an endpoint
@@ -288,7 +348,11 @@ int usb_move_wait(usb_endpoint_t *ep, usb_data_t *data, u32 len);
 
 The event callback is called if a timeout or cancellation occurs; see usb_evt_cb for details.
 
-If the endpoint is busy, i.e. an unfinished reception request is in progress, this function returns -1.  Some ports may support multiple requests.
+Requests are queued.  If a request is already in progress, this one is started as soon as the ones before it have completed, without waiting for the event callback.
+
+\p len is not limited by the hardware.  Long requests are moved in several DMA (or other) transactions, but the event callback is called only once, with the total.  If the endpoint's queue is full, or the endpoint is stalled, inactive, or being cancelled, this function returns -1.
+
+\p data must have headroom in front of it for the port (see usb_buf_data()); buffers from usb_pool_alloc() do.  The data is received at \p data itself, whatever the port does with the headroom.
 
 This function cannot be used for the control endpoint.
 
@@ -301,14 +365,14 @@ This function cannot be used for the control endpoint.
 
 \sa usb_evt_cb, usb_get_epstat()
 */
-int usb_rx(usb_endpoint_t *ep, usb_data_t *data, u16 len);
+int usb_rx(usb_endpoint_t *ep, usb_data_t *data, u32 len);
 
 //! Make an endpoint ready for chained reception
 /*! Makes an endpoint ready for chained reception.  Packets are accepted and copied to \p data until either \p len bytes are received or a short packet is received.  After a short packet is received, the endpoint's status is updated (usb_get_epstat()), and the endpoint's event callback, if any, is called (usb_evt_cb).
 
 The event callback is also called if a timeout or cancellation occurs; see usb_evt_cb for details.
 
-If the endpoint is busy, i.e. an unfinished reception request is in progress, this function returns -1.  Some ports may support multiple requests.
+Requests are queued as for usb_rx().  If the endpoint's queue is full, or the endpoint is stalled, inactive, or being cancelled, this function returns -1.
 
 This function cannot be used for the control endpoint.
 
@@ -321,7 +385,7 @@ This function cannot be used for the control endpoint.
 
 \sa usb_evt_cb, usb_get_epstat()
 */
-int usb_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len);
+int usb_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u32 len);
 
 //! Request a transmission
 /*! Causes the hardware to prepare to transmit the \p len bytes at \p data packet by packet.  A short packet is not appended.  The packet size is the endpoint's maximum.
@@ -330,7 +394,7 @@ Since all data transfer is controlled by the host, there is no guarantee that th
 
 The callback is also called if a timeout or cancellation occurs; see usb_evt_cb for details.
 
-If the transmission request cannot be accepted, -1 is returned.
+Requests are queued as for usb_rx().  If the transmission request cannot be accepted, -1 is returned.
 
 This function cannot be used for the control endpoint.
 
@@ -344,7 +408,7 @@ This function cannot be used for the control endpoint.
 
 \sa usb_evt_cb, usb_get_epstat()
 */
-int usbhw_tx(usb_endpoint_t *ep, usb_data_t *data, u16 len);
+int usb_tx(usb_endpoint_t *ep, usb_data_t *data, u32 len);
 
 //! Request a chained transmission
 /*! Causes the hardware to prepare to transmit the \p len bytes at \p data packet by packet, ending with a short packet.  The packet size is the endpoint's maximum.
@@ -353,7 +417,7 @@ Since all data transfer is controlled by the host, there is no guarantee that th
 
 The callback is also called if a timeout or cancellation occurs; see usb_evt_cb for details.
 
-If the transmission request cannot be accepted, -1 is returned.
+Requests are queued as for usb_rx().  If the transmission request cannot be accepted, -1 is returned.
 
 This function cannot be used for the control endpoint.
 
@@ -367,14 +431,90 @@ This function cannot be used for the control endpoint.
 
 \sa usb_evt_cb, usb_get_epstat()
 */
-int usbhw_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len);
+int usb_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u32 len);
+
+//! Request a vectored transmission
+/*! Same as usb_tx(), but the data is gathered from the \p n buffers in \p iov, in order, and sent as one transfer.  The event callback is called once for the whole vector, with the first buffer's data pointer and the total length.
+
+The \p iov array is not copied, and must not be changed until the request has finished.
+
+Every buffer but the last must be a whole number of usb_data_t.  If a buffer other than the last ends in the middle of a packet, that packet is copied into the endpoint's bounce buffer and sent from there; the endpoint must then have one (see the \c gatherBuffer option in the configuration file).  Otherwise, every buffer but the last must be a whole number of packets.
+
+\param[in] ep Endpoint for transmission
+\param[in] iov Buffers to transmit
+\param[in] n Number of buffers in \p iov
+\return Status code
+\retval 0 Success
+\retval -1 Request could not be accepted
+\retval -2 Invalid endpoint
+\retval -3 Invalid vector
+
+\sa usb_txv_chain(), usb_rxv()
+\ingroup grp_public_io
+*/
+int usb_txv(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n);
+
+//! Request a vectored chained transmission
+/*! Same as usb_txv(), but the transfer ends with a short packet, as for usb_tx_chain().  The short packet rule applies to the vector as a whole; the buffer boundaries inside it do not produce short packets.
+
+\param[in] ep Endpoint for transmission
+\param[in] iov Buffers to transmit
+\param[in] n Number of buffers in \p iov
+\return Status code
+\retval 0 Success
+\retval -1 Request could not be accepted
+\retval -2 Invalid endpoint
+\retval -3 Invalid vector
+
+\sa usb_txv()
+\ingroup grp_public_io
+*/
+int usb_txv_chain(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n);
+
+//! Make an endpoint ready for vectored reception
+/*! Same as usb_rx(), but the data is scattered over the \p n buffers in \p iov, in order.  The event callback is called once for the whole vector, with the first buffer's data pointer and the total length.
+
+The \p iov array is not copied, and must not be changed until the request has finished.
+
+Every buffer but the last must be a whole number of packets.  Each buffer needs its own headroom (see usb_buf_data()), which the \c len field does not include.
+
+\param[in] ep Endpoint for reception
+\param[in] iov Buffers to receive into
+\param[in] n Number of buffers in \p iov
+\return Status code
+\retval 0 Success
+\retval -1 Request could not be accepted
+\retval -2 Invalid endpoint
+\retval -3 Invalid vector
+
+\sa usb_rxv_chain(), usb_txv()
+\ingroup grp_public_io
+*/
+int usb_rxv(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n);
+
+//! Make an endpoint ready for vectored chained reception
+/*! Same as usb_rxv(), but reception ends early if a short packet is received, as for usb_rx_chain().
+
+\param[in] ep Endpoint for reception
+\param[in] iov Buffers to receive into
+\param[in] n Number of buffers in \p iov
+\return Status code
+\retval 0 Success
+\retval -1 Request could not be accepted
+\retval -2 Invalid endpoint
+\retval -3 Invalid vector
+
+\sa usb_rxv()
+\ingroup grp_public_io
+*/
+int usb_rxv_chain(usb_endpoint_t *ep, const usb_iovec_t *iov, u8 n);
 
 //! Cancel transfers
-/*! Cancels any transfer in progress on the endpoint.
+/*! Cancels the transfer in progress on the endpoint, and every request queued behind it.
 
 This may not take effect immediately.  USB packet transfer is usually hardware-controlled and cannot be cancelled.  However, the endpoint will NAK further IN or OUT requests from the host.
 
-This function causes the endpoint callback to be called with status of USB_EPSTAT_CANCELLED.  It does not change the endpoint's status.
+The endpoint callback is called with USB_EVT_CANCELLED once for each request that was outstanding, oldest first.  New requests are refused until the last of these has been reported.  If no requests are outstanding, nothing happens.
 
 \param[in] ep Endpoint
 
@@ -382,6 +522,164 @@ This function causes the endpoint callback to be called with status of USB_EPSTA
 */
 void usb_cancel(usb_endpoint_t *ep);
 
+//! Start streaming reception
+/*! Keeps the OUT endpoint \p ep receiving into blocks taken from \p s, with no per-block callback.  As each block is filled (or cut short by a short packet), it is handed back through the stream's \a put function and a new one is armed at once, so the hardware is idle only while the stream has no free blocks.  The host is then NAKed until usb_stream_kick() is called.
+
+The endpoint's event callback is not called while the stream runs.  Do not submit other requests on the endpoint.
+
+The stream ends with usb_stream_stop(), or when a cancellation, timeout or stall retires its blocks; every block it held is handed back first.  Streaming endpoints usually want their timeout disabled (usb_set_ep_timeout()).
+
+\param[in] ep OUT endpoint
+\param[in] s Stream; must stay put until the stream ends
+\retval 0 Success
+\retval -1 Endpoint is busy or already streaming
+\retval -2 Invalid endpoint or stream
+
+\ingroup grp_public_io
+*/
+int usb_rx_stream(usb_endpoint_t *ep, usb_stream_t *s);
+
+//! Start streaming transmission
+/*! Keeps the IN endpoint \p ep sending blocks taken from \p s, with no per-block callback.  The blocks are queued back to back as one transfer, with no short packets between them, and each is handed back through the stream's \a put function as soon as it has gone.  When the stream has no filled blocks, the host is NAKed until usb_stream_kick() is called.
+
+The producer is told when its ring runs low through the stream's \a mark callback (see usb_stream_t), rather than once per block.  usb_stream_flush() ends the transfer.
+
+The endpoint's event callback is not called while the stream runs.  Do not submit other requests on the endpoint.
+
+The stream ends with usb_stream_stop(), or when a cancellation, timeout or stall retires its blocks; every block it held is handed back first.
+
+\param[in] ep IN endpoint
+\param[in] s Stream; must stay put until the stream ends
+\retval 0 Success
+\retval -1 Endpoint is busy or already streaming
+\retval -2 Invalid endpoint or stream
+
+\ingroup grp_public_io
+*/
+int usb_tx_stream(usb_endpoint_t *ep, usb_stream_t *s);
+
+//! Resume a stalled stream
+/*! Arms as many blocks as the stream now has, and re-arms the stream's \a mark callback.  Call this from the producer or consumer after it fills or frees blocks.  It is cheap when there is nothing to do.
+
+\param[in] ep Streaming endpoint
+
+\ingroup grp_public_io
+*/
+void usb_stream_kick(usb_endpoint_t *ep);
+
+//! End a streamed transmission
+/*! Ends the IN transfer when the stream next runs out of filled blocks.  If the last block sent is a whole number of packets, a zero-length packet follows it, so the host sees the end of the transfer.  If the stream has already sent everything, this happens at once.
+
+The stream stays attached, and later blocks start a new transfer.
+
+\param[in] ep Streaming IN endpoint
+
+\ingroup grp_public_io
+*/
+void usb_stream_flush(usb_endpoint_t *ep);
+
+//! Stop streaming
+/*! Cancels the blocks armed on the endpoint.  Each is handed back to the stream, and the stream is detached when the last one returns.
+
+\param[in] ep Streaming endpoint
+
+\ingroup grp_public_io
+*/
+void usb_stream_stop(usb_endpoint_t *ep);
+
+//! Start the isochronous engine on an endpoint
+/*! Moves one packet per frame on the isochronous endpoint \p ep, taking packets (IN) or buffers (OUT) from \p s and handing them back after their frame, with no application code running per frame.  Each frame's packet is staged at the pre-SOF interrupt before it (usb_set_presof_time() sets how early), or at the SOF interrupt on hardware without pre-SOF, so data moves with a fixed latency of one frame.
+
+IN packets may have a different length in each frame.  A frame with nothing to stage counts as an underrun (IN) or overrun (OUT); a frame in which the host did not move the staged packet counts as missed, and the packet stays staged for the next frame.  See usb_iso_t for the statistics.
+
+The endpoint's event callback is not called while the engine runs.  Do not submit other requests on the endpoint.  Cancellations and timeouts hand the staged packet back unmoved, but do not stop the engine.
+
+\param[in] ep Isochronous endpoint
+\param[in] s Ring; must stay put until the engine stops
+\retval 0 Success
+\retval -1 Endpoint is busy or already running
+\retval -2 Invalid endpoint or ring
+
+\ingroup grp_public_io
+*/
+int usb_iso_start(usb_endpoint_t *ep, usb_iso_t *s);
+
+//! Stop the isochronous engine
+/*! Stops staging packets on \p ep, and cancels the packet now staged, if any.  It is handed back to the ring, which is detached once it returns.
+
+\param[in] ep Isochronous endpoint
+
+\ingroup grp_public_io
+*/
+void usb_iso_stop(usb_endpoint_t *ep);
+
+//! Initialise a buffer pool
+/*! Sets up \p pool to hand out \p n blocks from \p mem, each holding a USB buffer of \p len bytes.  \p mem must be at least \p n times usb_buf_sizeof(\p len) long, and \p freestack must have room for \p n entries.
+
+Pools declared with USB_POOL_STATIC() or generated by usbgen do not need this.
+
+\param[in] pool Pool
+\param[in] mem Storage for the blocks
+\param[in] freestack Storage for the free list
+\param[in] len Number of USB bytes per block
+\param[in] n Number of blocks
+\retval 0 Success
+\retval -1 Invalid argument
+
+\ingroup grp_public_io
+*/
+int usb_pool_init(usb_pool_t *pool, usb_data_t *mem, u16 *freestack, 
+	u32 len, u16 n);
+
+//! Take a buffer from a pool
+/*! Returns a free block from \p pool, or 0 if there is none.  This takes constant time, and may be called under interrupt, including from an endpoint event callback.
+
+The pointer returned is the block's data pointer, with the headroom the port needs for reception in front of it (see usb_buf_data()), so the block may be passed straight to usb_rx().
+
+\param[in] pool Pool
+\return Pointer to the buffer, or 0
+
+\ingroup grp_public_io
+*/
+usb_data_t *usb_pool_alloc(usb_pool_t *pool);
+
+//! Return a buffer to a pool
+/*! Returns \p buf, which must have come from usb_pool_alloc() on the same pool, to \p pool.  This takes constant time, and may be called under interrupt.  Passing 0 does nothing.
+
+\param[in] pool Pool
+\param[in] buf Buffer
+\retval 0 Success
+\retval -1 \p buf is not a block of this pool, or too many blocks were returned
+
+\ingroup grp_public_io
+*/
+int usb_pool_free(usb_pool_t *pool, usb_data_t *buf);
+
+//! Number of blocks in use
+/*! \ingroup grp_public_io */
+#define usb_pool_used(POOL) ((POOL)->used)
+
+//! Largest number of blocks in use at once
+/*! The high-water mark of usb_pool_used() since the pool was set up, or since usb_pool_clear_stats() was last called.
+
+\ingroup grp_public_io
+*/
+#define usb_pool_maxused(POOL) ((POOL)->maxused)
+
+//! Number of failed allocations
+/*! The number of times usb_pool_alloc() has returned 0 since the pool was set up, or since usb_pool_clear_stats() was last called.
+
+\ingroup grp_public_io
+*/
+#define usb_pool_failed(POOL) ((POOL)->failed)
+
+//! Reset pool statistics
+/*! Sets the high-water mark to the number of blocks now in use, and the failure count to zero.
+
+\ingroup grp_public_io
+*/
+#define usb_pool_clear_stats(POOL) {(POOL)->maxused=(POOL)->used;(POOL)->failed=0;}
+
 //! Callback for control transactions
 /*! This function is a required callback, and must be supplied by the user.
 
@@ -392,6 +690,8 @@ This call is generally made at interrupt time.  It should be handled as quickly
 If a new SETUP arrives before the old one has ended, PORUS stalls it 
 and ignores calls to usb_ctl_write_end() or usb_ctl_read_end() .
 
+Class and vendor requests which have a handler (see usb_ctl_handler) do not reach this function.
+
 \ingroup grp_public_control
 */
 void usb_ctl(void);
@@ -425,8 +725,43 @@ void usb_ctl_read_end(int len, usb_data_t *data);
 */
 void usb_ctl_write_end(void);
 
+//! Conclude a control read with generated data
+/*! Ends a control read like usb_ctl_read_end(), but instead of taking the data from a buffer, calls \p gen for each packet as the host asks for it.  Only one packet is held in RAM at a time.
+
+\param[in] len Length of the data in bytes.  \p gen may end it sooner.
+\param[in] gen Generator
+
+\sa usb_ctl_gen
+
+\ingroup grp_public_control
+*/
+void usb_ctl_read_gen(int len, usb_ctl_gen gen);
+
 void usb_ctl_stall(void);
 
+//! Offset of the control write data
+/*! Gives the offset in the data stage of the current control write of the first byte in \c usb_ctl_write_data.  It is 0 except in the later calls to a chunked handler (see usb_ctl_handler).
+
+\ingroup grp_public_control
+*/
+u16 usb_ctl_write_ofs(void);
+
+//! Length of the control write data
+/*! Gives the number of bytes of the current control write in \c usb_ctl_write_data.  Unless the handler is chunked, this is \c usb_setup.len.
+
+\ingroup grp_public_control
+*/
+u16 usb_ctl_write_len(void);
+
+//! Clear control request statistics
+/*! Zeroes the statistics the control dispatcher keeps for each handler.  The statistics are in the array \c usb_ctl_stat, declared in the generated header, which has one element for each \c request block of the configuration file, in order.  Without handlers, this does nothing.
+
+\sa usb_ctl_stat_t
+
+\ingroup grp_public_control
+*/
+void usb_ctl_clear_stats(void);
+
 //! Set endpoint timeout
 /*! Sets the timeout for the given endpoint in milliseconds.
 
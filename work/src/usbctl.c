@@ -34,16 +34,124 @@
 usb_setup_t usb_setup;
 
 static usb_data_t txbuf[4];
+// one packet, for generated control reads
+static usb_data_t genbuf[usb_mem_len(USB_CTL_PACKET_SIZE)];
 
 static volatile struct {
 	int state;
 	int ct; // number of bytes received / transmitted
+	// only used for write txns:
+	int chunk; // offset of usb_ctl_write_data[0] in the data
 	// these are only used for read txns:
 	int ofs; // offset into tx data
 	usb_data_t *txdata; // pointer to transmit data
 	int txlen; // number of bytes to transmit
+	usb_ctl_gen gen; // generator, if txdata is 0
+	int zlp; // nonzero once a zero-length packet has ended the data
+#ifdef USB_CTL_HANDLERS
+	// handler and statistics for the request in progress, if it has 
+	// a handler
+	const usb_ctl_entry_t *entry;
+	usb_ctl_stat_t *stat;
+	u32 t0;
+#endif
 } ctlflags;
 
+#ifdef USB_CTL_HANDLERS
+#ifdef USBHW_HAVE_CLOCK
+#define ctl_clock() usbhw_clock()
+#define ctl_clock_khz() usbhw_clock_khz()
+#else
+#define ctl_clock() usb_timer_now()
+#define ctl_clock_khz() 1
+#endif
+
+static void ctl_done(int stalled)
+{
+	usb_ctl_stat_t *st=ctlflags.stat;
+	u32 t,k=ctl_clock_khz(),us;
+
+	if (!st) return;
+	ctlflags.stat=0;
+	t=ctl_clock()-ctlflags.t0;
+	// in two parts, so that neither overflows
+	us=t/k*1000+t%k*1000/k;
+	if (stalled) st->stalls++;
+	if (us>st->maxus) st->maxus=us;
+	st->totalus+=us;
+}
+
+void usb_ctl_clear_stats(void)
+{
+	int i;
+
+	usbhw_int_dis();
+	for (i=0;i<USB_CTL_HANDLERS;++i) {
+		usb_ctl_stat[i].count=0;
+		usb_ctl_stat[i].stalls=0;
+		usb_ctl_stat[i].deferred=0;
+		usb_ctl_stat[i].maxus=0;
+		usb_ctl_stat[i].totalus=0;
+	}
+	usbhw_int_en();
+}
+
+static void ctl_start(void)
+{
+	const usb_ctl_entry_t *e=ctlflags.entry;
+
+	ctlflags.stat=e->stat;
+	ctlflags.t0=ctl_clock();
+	e->stat->count++;
+}
+#else
+#define ctl_done(S)
+
+void usb_ctl_clear_stats(void)
+{
+}
+#endif
+
+// hands a request to its handler, or to usb_ctl() if it has none
+static void dispatch(void)
+{
+#ifdef USB_CTL_HANDLERS
+	const usb_ctl_entry_t *e=ctlflags.entry;
+
+	if (e) {
+		// chunked writes are already under way
+		if (!ctlflags.stat) ctl_start();
+		if (e->handler()) {
+			if (ctlflags.state!=USB_CTL_STATE_IDLE)
+				usb_ctl_stall();
+		} else if (ctlflags.state==USB_CTL_STATE_RRS||ctlflags.state==USB_CTL_STATE_RWD)
+			e->stat->deferred++;
+		return;
+	}
+#endif
+	usb_ctl();
+}
+
+#ifdef USB_CTL_HANDLERS
+// hands a full usb_ctl_write_data to a chunked handler
+static void dispatch_chunk(void)
+{
+	if (!ctlflags.stat) ctl_start();
+	if (ctlflags.entry->handler())
+		usb_ctl_stall();
+}
+#endif
+
+u16 usb_ctl_write_ofs(void)
+{
+	return ctlflags.chunk;
+}
+
+u16 usb_ctl_write_len(void)
+{
+	return ctlflags.ct-ctlflags.chunk;
+}
+
 static void reply_u8(u8 data)
 {
 	txbuf[0]=data<<8;
@@ -92,7 +200,7 @@ static int usb_ctl_std_get_status(void)
 		break;
 	case USB_RCPT_IFACE:
 		if (usb_get_state()!=USB_STATE_CONFIGURED) return -1;
-		if (!usb_have_iface(1,usb_setup.index)) return -1;
+		if (!usb_have_iface(usb_get_config(),usb_setup.index)) return -1;
 		reply_u16(0);
 		break;
 	case USB_RCPT_EP:
@@ -110,6 +218,15 @@ static int usb_ctl_std_get_status(void)
 	return 0;
 }
 
+/* Remote wakeup is a property of the current configuration; before one 
+is selected, the first configuration's is used. */
+static int wakeup_capable(void)
+{
+	int cfn=usb_get_config();
+
+	return usb_config_features(cfn?cfn:1)&2;
+}
+
 static int usb_ctl_std_clear_feature(void)
 {
 	int epn;
@@ -123,7 +240,7 @@ static int usb_ctl_std_clear_feature(void)
 			return -1;
 		break;
 	case FEATURE_DEVICE_REMOTE_WAKEUP:
-		if (!(usb_config_features(1)&2)) return -1;
+		if (!wakeup_capable()) return -1;
 		if (usb_setup.recipient!=USB_RCPT_DEV) return -1;
 		//usb_enable_remote_wakeup(1);
 		break;
@@ -146,7 +263,7 @@ static int usb_ctl_std_set_feature(void)
 			return -1;
 		break;
 	case FEATURE_DEVICE_REMOTE_WAKEUP:
-		if (!(usb_config_features(1)&2)) return -1;
+		if (!wakeup_capable()) return -1;
 		if (usb_setup.recipient!=USB_RCPT_DEV) return -1;
 		//usb_enable_remote_wakeup(0);
 		break;
@@ -173,15 +290,25 @@ static int usb_ctl_std_set_address(void)
 
 static int usb_ctl_std_get_interface(void)
 {
+	int alt;
+
 	if (!usb_setup.dataDir) return -1;
 	if (usb_setup.value) return -1;
 	if (usb_setup.recipient!=USB_RCPT_IFACE) return -1;
 	if (usb_setup.len!=1) return -1;
-	if (usb_get_state()!=USB_STATE_CONFIGURED) return -1;
-	reply_u8(1); // ### NOTE: change this for alt setting support
+	alt=usb_get_interface(usb_setup.index);
+	if (alt<0) return -1;
+	reply_u8(alt);
 	return 0;
 }
 
+static int usb_ctl_std_set_interface(void)
+{
+	if (usb_setup.recipient!=USB_RCPT_IFACE) return -1;
+	if (usb_setup.len) return -1;
+	return usb_set_interface(usb_setup.index,usb_setup.value);
+}
+
 static int usb_ctl_std_get_descriptor(void)
 {
 	int desclen;
@@ -201,6 +328,14 @@ static int usb_ctl_std_get_descriptor(void)
 	case USB_DESC_STRING:
 		if (usb_get_string_desc(usb_setup.value&0xff,usb_setup.index,&buf,&desclen)) return -1;
 		break;
+	case USB_DESC_DEVICE_QUALIFIER:
+		if (usb_setup.index) return -1;
+		if (usb_get_qualifier_desc(&buf,&desclen)) return -1;
+		break;
+	case USB_DESC_OTHER_SPEED_CONFIGURATION:
+		if (usb_setup.index) return -1;
+		if (usb_get_other_speed_desc(usb_setup.value&0xff,&buf,&desclen)) return -1;
+		break;
 	default:
 		return -1;
 	}
@@ -251,7 +386,9 @@ static void usb_ctl_std_write(void)
 	case USB_REQ_SET_CONFIGURATION:
 		err=usb_ctl_std_set_configuration();
 		break;
-	//case USB_REQ_SET_INTERFACE:
+	case USB_REQ_SET_INTERFACE:
+		err=usb_ctl_std_set_interface();
+		break;
 	//case USB_REQ_SET_DESCRIPTOR:
 	default:
 		err=-1;
@@ -265,6 +402,7 @@ static void usb_ctl_std_write(void)
 
 void usb_ctl_stall(void)
 {
+	ctl_done(1);
 	ctlflags.state=USB_CTL_STATE_IDLE;
 	usbhw_ctl_stall();
 }
@@ -286,8 +424,9 @@ int usb_ctl_std(void)
 	}
 }
 
-void usb_evt_ctl_rx(void)
+void usb_do_ctl_rx(void)
 {
+	u16 left;
 	u8 l;
 	int last;
 
@@ -295,23 +434,31 @@ void usb_evt_ctl_rx(void)
 		usb_ctl_stall();
 		return;
 	}
-	l=usb_setup.len-ctlflags.ct;
-	if (l>USB_CTL_PACKET_SIZE) l=USB_CTL_PACKET_SIZE;
+	// clamped before it is narrowed to a packet length
+	left=usb_setup.len-ctlflags.ct;
+	l=left>USB_CTL_PACKET_SIZE?USB_CTL_PACKET_SIZE:left;
 	last=(ctlflags.ct+l)>=usb_setup.len;
-	if (usbhw_get_ctl_write_data(&l,usb_ctl_write_data+usb_mem_len(ctlflags.ct),last)) {
+	if (usbhw_get_ctl_write_data(&l,usb_ctl_write_data+usb_mem_len(ctlflags.ct-ctlflags.chunk),last)) {
 		usb_ctl_stall();
 		return;
 	}
 	ctlflags.ct+=l;
 	if (last) {
 		ctlflags.state=USB_CTL_STATE_RWD;
-		usb_ctl();
+		dispatch();
 	}
+#ifdef USB_CTL_HANDLERS
+	else if (ctlflags.entry&&ctlflags.entry->chunked&&
+		ctlflags.ct-ctlflags.chunk+USB_CTL_PACKET_SIZE>USB_CTL_WRITE_BUF_SIZE) {
+		dispatch_chunk();
+		ctlflags.chunk=ctlflags.ct;
+	}
+#endif
 }
 
-void usb_evt_ctl_tx(void)
+void usb_do_ctl_tx(void)
 {
-	int l;
+	int l,n;
 
 	if (ctlflags.state!=USB_CTL_STATE_SRD) {
 		usb_ctl_stall();
@@ -320,11 +467,32 @@ void usb_evt_ctl_tx(void)
 	l=ctlflags.txlen-ctlflags.ct;
 	if (l>USB_CTL_PACKET_SIZE) l=USB_CTL_PACKET_SIZE;
 	if (l<0) l=0;
+	if (l&&!ctlflags.txdata) {	// generated read
+		n=ctlflags.gen(ctlflags.ct,l,genbuf);
+		if (n<0) {
+			usb_ctl_stall();
+			return;
+		}
+		if (n<l) {	// short packet ends the data stage
+			l=n;
+			ctlflags.txlen=ctlflags.ct+n;
+		}
+	}
 	if (l) {
-		usbhw_put_ctl_read_data(l,ctlflags.txdata+usb_mem_len(ctlflags.ct+ctlflags.ofs));
+		if (ctlflags.txdata)
+			usbhw_put_ctl_read_data(l,ctlflags.txdata+usb_mem_len(ctlflags.ct+ctlflags.ofs));
+		else
+			usbhw_put_ctl_read_data(l,genbuf);
 		ctlflags.ct+=l;
 	}
-	else if (!l||(ctlflags.ct>=usb_setup.len)) {
+	else if (ctlflags.ct<usb_setup.len&&
+		!(ctlflags.ct%USB_CTL_PACKET_SIZE)&&!ctlflags.zlp) {
+		// the data ended on a packet boundary short of wLength, so 
+		// the host waits for a short packet
+		usbhw_put_ctl_read_data(0,genbuf);
+		ctlflags.zlp=1;
+	}
+	else {
 		usbhw_ctl_read_handshake();
 		ctlflags.state=USB_CTL_STATE_IDLE;
 	}
@@ -336,13 +504,34 @@ void usb_ctl_read_end(int len, usb_data_t *data)
 		usb_ctl_stall();
 		return;
 	}
+	ctl_done(0);
 	ctlflags.state=USB_CTL_STATE_SRD;
 	ctlflags.ct=0;
 	ctlflags.ofs=0;
 	ctlflags.txdata=data;
+	ctlflags.gen=0;
+	ctlflags.zlp=0;
+	if (len>usb_setup.len) len=usb_setup.len;
+	ctlflags.txlen=len;
+	usb_do_ctl_tx();
+}
+
+void usb_ctl_read_gen(int len, usb_ctl_gen gen)
+{
+	if (ctlflags.state!=USB_CTL_STATE_RRS||!len||!gen) {
+		usb_ctl_stall();
+		return;
+	}
+	ctl_done(0);
+	ctlflags.state=USB_CTL_STATE_SRD;
+	ctlflags.ct=0;
+	ctlflags.ofs=0;
+	ctlflags.txdata=0;
+	ctlflags.gen=gen;
+	ctlflags.zlp=0;
 	if (len>usb_setup.len) len=usb_setup.len;
 	ctlflags.txlen=len;
-	usb_evt_ctl_tx();
+	usb_do_ctl_tx();
 }
 
 void usb_ctl_write_end(void)
@@ -351,11 +540,12 @@ void usb_ctl_write_end(void)
 		usb_ctl_stall();
 		return;
 	}
+	ctl_done(0);
 	usbhw_ctl_write_handshake();
 	ctlflags.state=USB_CTL_STATE_IDLE;
 }
 
-void usb_evt_setup(void)
+void usb_do_setup(void)
 {
 	if (ctlflags.state!=USB_CTL_STATE_IDLE) {
 		usb_ctl_stall();
@@ -367,12 +557,21 @@ void usb_evt_setup(void)
 	}
 
 	ctlflags.ct=0;
+	ctlflags.chunk=0;
+#ifdef USB_CTL_HANDLERS
+	ctlflags.stat=0;
+	ctlflags.entry=usb_ctl_find(usb_setup.type,usb_setup.recipient,usb_setup.index,usb_setup.request);
+#endif
 
 	if (usb_setup.dataDir) { // read txn
 		ctlflags.state=USB_CTL_STATE_RRS;
-		usb_ctl();
+		dispatch();
 	} else {		// it's a write txn
-		if (usb_setup.len>USB_CTL_WRITE_BUF_SIZE) {
+		if (usb_setup.len>USB_CTL_WRITE_BUF_SIZE
+#ifdef USB_CTL_HANDLERS
+			&&!(ctlflags.entry&&ctlflags.entry->chunked)
+#endif
+			) {
 			usb_ctl_stall();
 			return;
 		}
@@ -381,7 +580,7 @@ void usb_evt_setup(void)
 			// no dispatch now, wait for OUTs
 		} else {		// not expecting data
 			ctlflags.state=USB_CTL_STATE_RWD;
-			usb_ctl();	// dispatch now
+			dispatch();	// dispatch now
 		}
 	}
 }
@@ -389,4 +588,8 @@ void usb_evt_setup(void)
 void usb_ctl_init(void)
 {
 	ctlflags.state=USB_CTL_STATE_IDLE;
+#ifdef USB_CTL_HANDLERS
+	ctlflags.entry=0;
+	ctlflags.stat=0;
+#endif
 }
@@ -0,0 +1,207 @@
+
+/* usbevt.c -- event entry points and deferred dispatch */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+
+#include "usbhw.h"
+
+/* These are the functions the port calls.  Normally they hand each 
+event straight to the core.  With USB_DEFERRED_EVENTS they record it in 
+a single-producer, single-consumer ring instead: the interrupt service 
+routine is the only writer of head, usb_dispatch() the only writer of 
+tail, so neither side needs a lock.  A record is filled in before head 
+moves past it, and is not reused until tail has moved past it. */
+
+static usb_cb_dispatch dispatchCB;
+
+#ifdef USB_DEFERRED_EVENTS
+
+#ifndef USB_EVTQ_LEN
+#define USB_EVTQ_LEN 32
+#endif
+
+#define EVT_DONE 0
+#define EVT_RESET 1
+#define EVT_SUSPEND 2
+#define EVT_RESUME 3
+#define EVT_SETUP 4
+#define EVT_CTL_RX 5
+#define EVT_CTL_TX 6
+
+typedef struct evtrec_t {
+	usb_endpoint_t *ep;
+	usb_data_t *data;
+	u16 len;
+	u8 type;
+	u8 evt;
+} evtrec_t;
+
+static evtrec_t ring[USB_EVTQ_LEN];
+static volatile u16 head, tail;
+static u16 lost;
+
+static void post(u8 type, usb_endpoint_t *ep, usb_data_t *data, u16 len, 
+	u8 evt)
+{
+	u16 h=head, n=h+1;
+	evtrec_t *r;
+
+	if (n==USB_EVTQ_LEN) n=0;
+	if (n==tail) {
+		++lost;
+		return;
+	}
+	r=ring+h;
+	r->type=type;
+	r->ep=ep;
+	r->data=data;
+	r->len=len;
+	r->evt=evt;
+	head=n;
+	if (dispatchCB) dispatchCB();
+}
+
+int usb_dispatch(void)
+{
+	evtrec_t *r;
+	u16 t;
+	int n=0;
+
+	while ((t=tail)!=head) {
+		r=ring+t;
+		// callbacks which submit or cancel nest inside this
+		usbhw_int_dis();
+		switch (r->type) {
+			case EVT_DONE: usb_do_done(r->ep,r->data,r->len,r->evt); break;
+			case EVT_RESET: usb_do_reset(); break;
+			case EVT_SUSPEND: usb_do_suspend(); break;
+			case EVT_RESUME: usb_do_resume(); break;
+			case EVT_SETUP: usb_do_setup(); break;
+			case EVT_CTL_RX: usb_do_ctl_rx(); break;
+			case EVT_CTL_TX: usb_do_ctl_tx(); break;
+		}
+		usbhw_int_en();
+		tail=(t+1==USB_EVTQ_LEN)?0:t+1;
+		++n;
+	}
+	return n;
+}
+
+u16 usb_dispatch_lost(void)
+{
+	return lost;
+}
+
+void usb_evt_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt)
+{
+	post(EVT_DONE,ep,data,len,evt);
+}
+
+void usb_evt_reset(void)
+{
+	post(EVT_RESET,0,0,0,0);
+}
+
+void usb_evt_suspend(void)
+{
+	post(EVT_SUSPEND,0,0,0,0);
+}
+
+void usb_evt_resume(void)
+{
+	post(EVT_RESUME,0,0,0,0);
+}
+
+void usb_evt_setup(void)
+{
+	post(EVT_SETUP,0,0,0,0);
+}
+
+void usb_evt_ctl_rx(void)
+{
+	post(EVT_CTL_RX,0,0,0,0);
+}
+
+void usb_evt_ctl_tx(void)
+{
+	post(EVT_CTL_TX,0,0,0,0);
+}
+
+#else
+
+int usb_dispatch(void)
+{
+	return 0;
+}
+
+u16 usb_dispatch_lost(void)
+{
+	return 0;
+}
+
+void usb_evt_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt)
+{
+	usb_do_done(ep,data,len,evt);
+}
+
+void usb_evt_reset(void)
+{
+	usb_do_reset();
+}
+
+void usb_evt_suspend(void)
+{
+	usb_do_suspend();
+}
+
+void usb_evt_resume(void)
+{
+	usb_do_resume();
+}
+
+void usb_evt_setup(void)
+{
+	usb_do_setup();
+}
+
+void usb_evt_ctl_rx(void)
+{
+	usb_do_ctl_rx();
+}
+
+void usb_evt_ctl_tx(void)
+{
+	usb_do_ctl_tx();
+}
+
+#endif
+
+void usb_set_dispatch_cb(usb_cb_dispatch cb)
+{
+	dispatchCB=cb;
+}
@@ -38,6 +38,24 @@
 @{
 */
 
+//! Number of requests the port can hold per endpoint
+/*! The core queues transfer requests for each endpoint and hands them to the port in order through usbhw_tx(), usbhw_rx(), usbhw_tx_chain() and usbhw_rx_chain().  It never hands the port more than this many requests on one endpoint at a time; when the port reports one complete through usb_evt_done(), the core immediately hands it the next.
+
+Ports that can set up the next transfer while the current one is still running should define this in portconf.h as 2 or more.
+*/
+#ifndef USBHW_MAX_REQS
+#define USBHW_MAX_REQS 1
+#endif
+
+//! Longest transfer the port can take in one request, in bytes
+/*! Requests submitted with usb_tx(), usb_rx() and friends may be up to 4 GB long.  The core hands longer ones to the port in segments of at most this many bytes, rounded down to a whole number of packets.  Only the last segment of a chained request is passed to usbhw_tx_chain(); OUT segments are all passed to usbhw_rx_chain() for chained requests, since a short packet ends the request wherever it falls.
+
+On ports where USB_BUF_LEN_SIZE is nonzero, the core hands usbhw_rx() and usbhw_rx_chain() a pointer USB_BUF_LEN_SIZE words before where the segment's data belongs, so the length word the port writes there falls in the buffer's headroom for the first segment, and on the last word of the segment before it for the others.  The core saves and restores that word.  The port reports the length through usb_evt_done() as usual, and the application never sees the length word.
+*/
+#ifndef USBHW_MAX_SEG
+#define USBHW_MAX_SEG 0xffff
+#endif
+
 #if 0
 //! Packet I/O request structure
 /*! This structure encapsulates a request to transmit or receive a USB packet.  It identifies the endpoint, data length, and certain other parameters, and contains the actual data for the packet.  The structure is set up by the PORUS core and passed to usbhw_rx and usbhw_tx for processing.
@@ -115,11 +133,11 @@ int usbhw_tx(usb_packet_req_t *pkt);
 //! Request a chained transmission
 /*! Causes the hardware to prepare to transmit the \p len bytes at \p data packet by packet, ending with a short packet.  The packet size is the endpoint's maximum.
 
-Since all data transfer is controlled by the host, there is no guarantee that the data will go out immediately; this function is therefore a request, and must not wait for the data to actually be transmitted.  When all of the data has been transmitted, the port must call usb_evt_done().
+Since all data transfer is controlled by the host, there is no guarantee that the data will go out immediately; this function is therefore a request, and must not wait for the data to actually be transmitted.  When all of the data has been transmitted, the port must call usb_evt_done() with USB_EVT_READY.
 
-If the transmission request cannot be accepted, -1 is returned.
+If the transmission request cannot be accepted, -1 is returned.  The core keeps the request queued and offers it again after the next completion.
 
-The port must set the endpoint status to USB_EPSTAT_XFER when it prepares the endpoint.  When the reception has finished, the port must set the endpoint status to USB_EPSTAT_IDLE, if no other transactions are pending.
+The endpoint status is managed by the core.  The port reads it to tell a completion from a cancellation or timeout, but does not change it.
 
 If a timeout occurs, the port must call usb_evt_done() with the proper status.
 
@@ -142,11 +160,11 @@ int usbhw_tx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len);
 //! Request a transmission
 /*! Causes the hardware to prepare to transmit the \p len bytes at \p data packet by packet.  A short packet is not appended.  The packet size is the endpoint's maximum.
 
-Since transmission is controlled by the host, there is no guarantee that the data will go out immediately; this function is therefore a request, and must not wait for the data to actually be transmitted.  When all of the data has been transmitted, the port must call usb_evt_done().
+Since all data transfer is controlled by the host, there is no guarantee that the data will go out immediately; this function is therefore a request, and must not wait for the data to actually be transmitted.  When all of the data has been transmitted, the port must call usb_evt_done() with USB_EVT_READY.
 
-If the transmission request cannot be accepted, -1 is returned.
+If the transmission request cannot be accepted, -1 is returned.  The core keeps the request queued and offers it again after the next completion.
 
-The port must set the endpoint status to USB_EPSTAT_XFER when it prepares the endpoint.  When the transmission has finished, the port must set the endpoint status to USB_EPSTAT_IDLE, if no other transactions are pending.
+The endpoint status is managed by the core.  The port reads it to tell a completion from a cancellation or timeout, but does not change it.
 
 If a timeout occurs, the port must call usb_evt_done() with the proper status.
 
@@ -167,15 +185,15 @@ This function is never called for the control endpoint.
 int usbhw_tx(usb_endpoint_t *ep, usb_data_t *data, u16 len);
 
 //! Make an endpoint ready for chained reception
-/*! Makes an endpoint ready for chained reception.  Packets are accepted and copied to \p data until either \p len bytes are received or a short packet is received.  The port then calls usb_evt_done().
+/*! Makes an endpoint ready for chained reception.  Packets are accepted and copied to \p data until either \p len bytes are received or a short packet is received.  The port then calls usb_evt_done() with USB_EVT_READY.
 
-The port must set the endpoint status to USB_EPSTAT_XFER when it prepares the endpoint.  When the reception has finished, the port must set the endpoint status to USB_EPSTAT_IDLE, if no other transactions are pending.
+The endpoint status is managed by the core; the port does not change it.
 
 If a timeout occurs, the port calls usb_evt_done().
 
 usb_evt_done() may be called under interrupt.
 
-If the endpoint is busy, i.e. an unfinished reception request is in progress, this function returns -1.  Some ports may support multiple requests.
+The core never calls this while the port holds USBHW_MAX_REQS requests on the endpoint.  If the request cannot be accepted anyway, this function returns -1.
 
 Hardware should configure the endpoint so that it returns NAKs when a receive request is not pending.
 
@@ -191,15 +209,15 @@ This function is never called for the control endpoint.
 int usbhw_rx_chain(usb_endpoint_t *ep, usb_data_t *data, u16 len);
 
 //! Make an endpoint ready for reception
-/*! Makes an endpoint ready for reception.  Packets are accepted and copied to \p data until at least \p len bytes are received.  When \p len or more bytes have been received, possibly in multiple packets, the port must call usb_evt_done().  If \p len bytes are not received in time, or if reception is interrupted for too long, a timeout occurs.
+/*! Makes an endpoint ready for reception.  Packets are accepted and copied to \p data until at least \p len bytes are received.  When \p len or more bytes have been received, possibly in multiple packets, the port must call usb_evt_done() with USB_EVT_READY.  If \p len bytes are not received in time, or if reception is interrupted for too long, a timeout occurs.
 
-The port must set the endpoint status to USB_EPSTAT_XFER when it prepares the endpoint.  When the reception has finished, the port must set the endpoint status to USB_EPSTAT_IDLE, if no other transactions are pending.
+The endpoint status is managed by the core; the port does not change it.
 
 If a timeout occurs, the port must call usb_evt_done().
 
 usb_evt_done() may be called under interrupt.
 
-If the endpoint is busy, i.e. a reception request or chained reception request is in progress, this function returns -1.  Some ports may support multiple requests.
+The core never calls this while the port holds USBHW_MAX_REQS requests on the endpoint.  If the request cannot be accepted anyway, this function returns -1.
 
 Hardware should configure the endpoint so that it returns NAKs when a receive request is not pending.
 
@@ -215,7 +233,7 @@ It is usually not possible to stop a packet transmission.  However, it should be
 
 This function is called either because the user explicitly requested a cancellation, or because a timeout occurred.  These may be distinguished by the endpoint's status at the time of the call.  If the user requests a cancellation, the endpoint will have status USB_EPSTAT_CANCELLING; if a timeout occurs, the endpoint will have status USB_EPSTAT_TIMEOUT.
 
-When all requests have been successfully cancelled, and the endpoint is ready for a new request, usb_evt_done() must be called with the proper event: USB_EVT_TIMEOUT or USB_EVT_CANCELLED.  (This may be done in a DMA interrupt service routine.)
+The port must stop every request it holds on the endpoint.  When it has done so, it must call usb_evt_done() once, for the oldest request, with the proper event: USB_EVT_TIMEOUT or USB_EVT_CANCELLED.  (This may be done in a DMA interrupt service routine.)  The core reports the remaining queued requests itself.
 
 \param ep Endpoint to cancel on
 */
@@ -235,6 +253,22 @@ The times are typically used for timeout calculations.
 u32 usbhw_time(void);
 #endif
 
+//! Read the fine clock
+/*! Returns a free-running count which wraps at 2^32, for measuring intervals too short for the core's millisecond clock, such as the latency of control requests.  It must be safe to call under interrupt.
+
+Only needed if the port defines USBHW_HAVE_CLOCK.
+
+\sa usbhw_clock_khz()
+*/
+u32 usbhw_clock(void);
+
+//! Rate of the fine clock
+/*! Returns the number of usbhw_clock() counts per millisecond.  It must not change while the port is running, and must be below 4294967.
+
+Only needed if the port defines USBHW_HAVE_CLOCK.
+*/
+u32 usbhw_clock_khz(void);
+
 //! Set up USB hardware
 /*! Performs any necessary initialisation on USB hardware.  Called at 
 system initialisation time.
@@ -259,6 +293,22 @@ called for that.
 */
 int usbhw_init(void *parms);
 
+#ifdef USBHW_HAVE_ATTACH
+//! Attach to the bus
+/*! Connects the device to the bus, so that the host sees it, and enables the interrupts the POWERED state needs: reset, suspend, resume and SETUP.  Called by usb_attach() when the device is detached.
+
+Only needed if the port defines USBHW_HAVE_ATTACH.
+*/
+void usbhw_attach(void);
+
+//! Detach from the bus
+/*! Disconnects the device from the bus and stops its interrupts, leaving the hardware as usbhw_init() left it.  Called by usb_detach() when the device is attached, after the core has moved to USB_STATE_DETACHED.
+
+Only needed if the port defines USBHW_HAVE_ATTACH.
+*/
+void usbhw_detach(void);
+#endif
+
 //! Respond to a bus reset
 /*! Do anything needed on the hardware in response to a bus reset.  This 
 function is always called in response to a USB bus reset.
@@ -346,7 +396,9 @@ int usbhw_ctl_is_stalled(void);
 //! Activate endpoints in the given configuration
 /*! Activates the endpoints in the given configuration, preparing the hardware for each endpoint as necessary.
 
-The routine should iterate through all possible endpoints, and activate those which usb_get_ep() reports as existing.
+The routine should iterate through all possible endpoints, and activate those which usb_get_ep() reports as existing.  Each interface starts in alternate setting 0: an endpoint whose \c data->maxpkt is 0 is not part of it, and should have its buffer memory reserved but be left disabled.
+
+On a high-speed port, the core has already set \c data->maxpkt and \c data->mult for the speed the port reported with usb_evt_speed().  Buffer memory should be reserved for \c ep->hsPacketSize, which covers every transaction of a high-bandwidth endpoint in a microframe, so that the configuration can be used at either speed.
 
 If any of the endpoints cannot be activated, this routine should return -1.  If this happens, it is not necessary to deactivate the activated endpoints, if any; the core will call usbhw_deactivate_eps() if needed.
 
@@ -368,6 +420,16 @@ This routine should also free any private memory allocated on hwdata for the end
 */
 void usbhw_deactivate_eps(int cnf);
 
+//! Switch an endpoint to a new alternate setting
+/*! Called by the core when SET_INTERFACE selects an alternate setting of the endpoint's interface, after it has set \c ep->data->maxpkt to the endpoint's packet size in the new setting.  The port must stop any transfer on the endpoint, and reset its data toggle.  If \a maxpkt is 0, the endpoint is not part of the new setting and must be left disabled.  Otherwise it must be enabled with the new packet size.
+
+Buffer memory reserved by usbhw_activate_eps() for \c ep->packetSize (\c ep->hsPacketSize on high-speed ports), which is the largest size in any setting, stays with the endpoint.  No usb_evt_done() is expected for the stopped transfer; the core retires it.
+
+\param[in] ep Endpoint
+\return 0 on success, or -1 on error
+*/
+int usbhw_set_ep_alt(usb_endpoint_t *ep);
+
 //! Set the node address in hardware
 /*! Called by the standard control layer when it receives a SET_ADDRESS request.  This should set the node's hardware address.  This should be done immediately, so that the next received packet is checked against the given address.
 
@@ -382,6 +444,8 @@ void usbhw_set_address(u8 adr);
 
 This function must re-enable the set of interrupts which were enabled before usbhw_int_dis() is called.  If usbhw_int_dis() has not been called, it should enable no interrupts except the main USB interrupt, if there is one; i.e., the default state is no interrupts enabled.
 
+Calls nest.  The core holds usbhw_int_dis() while it calls completion callbacks (from usb_dispatch(), usb_cancel() and timeouts), and those may call usb_tx(), usb_rx(), usb_cancel() and the like, which disable and enable again.  Only the usbhw_int_en() which matches the outermost usbhw_int_dis() may enable anything; the others must leave interrupts disabled.  A port whose lock is a single enable bit can count the depth, as the C55x port does.
+
 If the hardware does not have a main interrupt, it is the port's responsibility to keep a record of what interrupts are enabled.
 
 This function may be used for locks etc., and should if possible be a fast operation.
@@ -397,6 +461,8 @@ void usbhw_int_en_sof(void);
 /*! Enables the pre-SOF interrupt, if there is one.  Does nothing if the hardware lacks a pre-SOF mechanism.
 
 Pre-SOF is typically generated by a timer triggered by the previous SOF packet.  It provides a SOF interrupt ahead of time, so that software can prepare data for the next SOF.
+
+A port whose hardware has a pre-SOF interrupt defines USBHW_HAVE_PRESOF.  The isochronous engine (usb_iso_start()) then stages each frame's packets at pre-SOF; otherwise it uses the SOF interrupt.
 */
 void usbhw_int_en_presof(void);
 
@@ -446,7 +512,7 @@ void usbhw_int_en_ctlout(void);
 //! Disable all USB hardware interrupts
 /*! Disables all USB hardware interrupts, or disables the main hardware interrupt, if such exists.
 
-This function must remember which interrupts were enabled, so that usbhw_int_en() can restore them.
+This function must remember which interrupts were enabled, so that usbhw_int_en() can restore them.  It may be called again before the matching usbhw_int_en(); see usbhw_int_en().
 */
 void usbhw_int_dis(void);
 
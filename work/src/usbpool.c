@@ -0,0 +1,89 @@
+
+/* usbpool.c -- fixed-block buffer pools */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#include "usbhw.h"
+
+int usb_pool_init(usb_pool_t *pool, usb_data_t *mem, u16 *freestack, 
+	u32 len, u16 n)
+{
+	if (!pool||!mem||!freestack||!n) return -1;
+	pool->mem=mem;
+	pool->freestack=freestack;
+	pool->blocklen=usb_mem_len(len)+USB_BUF_LEN_SIZE;
+	pool->nblocks=n;
+	pool->nfree=0;
+	pool->fresh=0;
+	pool->used=0;
+	pool->maxused=0;
+	pool->failed=0;
+	return 0;
+}
+
+usb_data_t *usb_pool_alloc(usb_pool_t *pool)
+{
+	u16 i;
+
+	usbhw_int_dis();
+	if (pool->nfree) {
+		i=pool->freestack[--pool->nfree];
+	} else if (pool->fresh<pool->nblocks) {
+		// blocks are handed out in order the first time round, so 
+		// that a static pool needs no initialisation
+		i=pool->fresh++;
+	} else {
+		++pool->failed;
+		usbhw_int_en();
+		return 0;
+	}
+	if (++pool->used>pool->maxused)
+		pool->maxused=pool->used;
+	usbhw_int_en();
+	return pool->mem+(u32)i*pool->blocklen+USB_BUF_LEN_SIZE;
+}
+
+int usb_pool_free(usb_pool_t *pool, usb_data_t *buf)
+{
+	u32 ofs;
+
+	if (!buf) return 0;
+	if (buf<pool->mem+USB_BUF_LEN_SIZE) return -1;
+	ofs=buf-USB_BUF_LEN_SIZE-pool->mem;
+	if (ofs%pool->blocklen) return -1;
+	ofs/=pool->blocklen;
+	if (ofs>=pool->fresh) return -1;
+	usbhw_int_dis();
+	if (pool->nfree>=pool->fresh) {
+		usbhw_int_en();
+		return -1;
+	}
+	pool->freestack[pool->nfree++]=(u16)ofs;
+	--pool->used;
+	usbhw_int_en();
+	return 0;
+}
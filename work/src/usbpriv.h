@@ -53,11 +53,13 @@ The request in question is identified by the \p data pointer.  The number of byt
 
 This function may be called under interrupt.
 
+For USB_EVT_READY, the core retires the oldest segment it handed the port, and hands the port the next one before the user's callback is called.  The user's callback is called only once the whole request has finished; \p len there is the total for the request.  For USB_EVT_CANCELLED and USB_EVT_TIMEOUT, the core retires every queued request.
+
 The port must allow new requests to be submitted during this callback.
 
 \param ep Endpoint in question
-\param data Data buffer for the request
-\param len Number of bytes successfully transmitted or received
+\param data Data buffer for the segment
+\param len Number of bytes successfully transmitted or received in the segment
 \param evt Event code
 */
 void usb_evt_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt);
@@ -69,6 +71,41 @@ void usb_evt_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt);
 */
 void usb_evt_timeout(usb_endpoint_t *ep);
 
+//! Number of slots in the timeout wheel
+#ifndef USB_TIMER_SLOTS
+#define USB_TIMER_SLOTS 64
+#endif
+
+//! Milliseconds covered by each slot of the timeout wheel
+/*! Deadlines up to USB_TIMER_SLOTS times this far away cost nothing until they expire; later ones are looked at once per turn of the wheel. */
+#ifndef USB_TIMER_SLOT_MS
+#define USB_TIMER_SLOT_MS 64
+#endif
+
+//! Arm an endpoint's timeout
+/*! Sets the endpoint's deadline to its timeout from now, replacing any earlier deadline.  Does nothing if the endpoint's timeout is 0.  The core arms an endpoint when it hands the port a request, and the port should call this whenever the endpoint moves data, so that the timeout measures quiet time.  Takes constant time.
+
+Must be called with interrupts disabled.
+*/
+void usb_timer_arm(usb_endpoint_t *ep);
+
+//! Disarm an endpoint's timeout
+/*! Takes constant time.  Must be called with interrupts disabled. */
+void usb_timer_disarm(usb_endpoint_t *ep);
+
+//! Advance the timeout clock
+/*! Moves the core's millisecond clock on by \p ms, and calls usb_evt_timeout() for each endpoint whose deadline has passed.  The cost depends on the number of expired endpoints, not on the number of endpoints.
+
+If USB_TIMEOUT_SOF is defined (see the \c timeoutBase option in the configuration file), the core calls this once per SOF.  Otherwise the port calls it from a periodic timer, as accurately as it can.
+*/
+void usb_evt_tick(u16 ms);
+
+//! Read the timeout clock
+/*! Returns the core's millisecond clock, as advanced by usb_evt_tick(). */
+u32 usb_timer_now(void);
+
+void usb_timer_init(void);
+
 //! Called in response to a bus reset
 void usb_evt_reset(void);
 //! Called for a SOF
@@ -80,12 +117,33 @@ void usb_evt_suspend(void);
 //! Called for Resume
 void usb_evt_resume(void);
 
+//! Report the bus speed
+/*! A high-speed port calls this after each bus reset, once the chirp handshake has settled the speed, with USB_SPEED_FULL or USB_SPEED_HIGH.  The core selects the descriptors and endpoint packet sizes for that speed.  Full-speed ports need not call it.  When the speed is high, SOF and pre-SOF are expected every microframe.
+*/
+void usb_evt_speed(int speed);
+
 //! Called in response to a SETUP
 void usb_evt_setup(void);
 //! Called when a control OUT finishes
-void usb_evt_ctl_rxdone(void);
+void usb_evt_ctl_rx(void);
 //! Called when a control IN finishes
-void usb_evt_ctl_txdone(void);
+void usb_evt_ctl_tx(void);
+
+/*! \name Event handlers
+
+The usb_evt_ functions above are what the port calls.  Without USB_DEFERRED_EVENTS they call these directly.  With it, usb_evt_done(), usb_evt_reset(), usb_evt_suspend(), usb_evt_resume(), usb_evt_setup(), usb_evt_ctl_rx() and usb_evt_ctl_tx() only record the event, and usb_dispatch() calls these later, with interrupts disabled.  SOF, pre-SOF, timeouts and ticks are always handled at once.
+
+The core calls these directly for events it raises itself.
+*/
+//@{
+void usb_do_done(usb_endpoint_t *ep, usb_data_t *data, u16 len, u8 evt);
+void usb_do_reset(void);
+void usb_do_suspend(void);
+void usb_do_resume(void);
+void usb_do_setup(void);
+void usb_do_ctl_rx(void);
+void usb_do_ctl_tx(void);
+//@}
 
 //! Called to change an endpoint's state
 /*! Call this when an endpoint's status changes.  This calls the endpoint callbacks if necessary and updates the endpoint data structure.
@@ -102,6 +160,12 @@ int usb_get_state(void);
 void usb_set_address(u8 adr);
 int usb_set_config(int cfn);
 int usb_get_config(void);
+//! Select an alternate setting of an interface
+/*! Handles SET_INTERFACE.  The interface's endpoints are deactivated, switched to the packet sizes of setting \p alt with usbhw_set_ep_alt(), and those that are part of it are activated again.  Endpoints of other interfaces are not touched.
+
+\return 0 on success, or -1 if the device is not configured or there is no such setting
+*/
+int usb_set_interface(int iface, int alt);
 
 int usb_ctl_state(void);
 
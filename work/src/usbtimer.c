@@ -0,0 +1,104 @@
+
+/* usbtimer.c -- endpoint timeouts */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+#include "usbhw.h"
+
+/* Armed endpoints are kept on a timer wheel: each slot holds a list of 
+the endpoints whose deadlines fall in one USB_TIMER_SLOT_MS stretch of 
+time, modulo the length of the wheel.  Arming and disarming are O(1).  
+A tick scans only the slots the clock has passed through; an entry whose 
+deadline is a whole turn of the wheel or more away is passed over. */
+
+static usb_endpoint_t *wheel[USB_TIMER_SLOTS];
+static u32 now;
+
+#define slot_of(T) (((T)/USB_TIMER_SLOT_MS)%USB_TIMER_SLOTS)
+
+void usb_timer_disarm(usb_endpoint_t *ep)
+{
+	usb_endpoint_data_t *d=ep->data;
+
+	if (!d->armed) return;
+	if (d->tprev)
+		d->tprev->data->tnext=d->tnext;
+	else
+		wheel[slot_of(d->deadline)]=d->tnext;
+	if (d->tnext)
+		d->tnext->data->tprev=d->tprev;
+	d->armed=0;
+}
+
+void usb_timer_arm(usb_endpoint_t *ep)
+{
+	usb_endpoint_data_t *d=ep->data;
+	usb_endpoint_t **slot;
+
+	usb_timer_disarm(ep);
+	if (!d->timeout) return;
+	d->deadline=now+d->timeout;
+	slot=wheel+slot_of(d->deadline);
+	d->tprev=0;
+	d->tnext=*slot;
+	if (*slot) (*slot)->data->tprev=ep;
+	*slot=ep;
+	d->armed=1;
+}
+
+/* Takes the first endpoint in slot \p n whose deadline is \p t or 
+earlier off the wheel. */
+static usb_endpoint_t *expired(u16 n, u32 t)
+{
+	usb_endpoint_t *ep;
+
+	for (ep=wheel[n];ep;ep=ep->data->tnext)
+		if ((s32)(ep->data->deadline-t)<=0) {
+			usb_timer_disarm(ep);
+			return ep;
+		}
+	return 0;
+}
+
+void usb_evt_tick(u16 ms)
+{
+	usb_endpoint_t *ep;
+	u32 cur=now,t=now+ms;
+	u16 n,i;
+
+	now=t;
+	n=slot_of(cur);
+	for (i=0;i<USB_TIMER_SLOTS;++i) {
+		// the timeout may start new requests, so the slot is 
+		// searched afresh each time
+		for (;;) {
+			usbhw_int_dis();
+			ep=expired(n,t);
+			usbhw_int_en();
+			if (!ep) break;
+			usb_evt_timeout(ep);
+		}
+		if (n==slot_of(t)&&t-cur<USB_TIMER_SLOT_MS*USB_TIMER_SLOTS)
+			break;
+		cur+=USB_TIMER_SLOT_MS;
+		if (++n>=USB_TIMER_SLOTS) n=0;
+	}
+}
+
+u32 usb_timer_now(void)
+{
+	return now;
+}
+
+void usb_timer_init(void)
+{
+	u16 i;
+
+	for (i=0;i<USB_TIMER_SLOTS;++i)
+		wheel[i]=0;
+	now=0;
+}
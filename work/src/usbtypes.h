@@ -114,6 +114,19 @@ This state is assigned by usb_init() and usb_disconnect().
 @}
 */
 
+/*!
+\defgroup grp_speeds Bus speeds
+\ingroup grp_public
+
+Reported by usb_get_speed().
+@{
+*/
+//! Full speed, 12 Mbit/s
+#define USB_SPEED_FULL 0
+//! High speed, 480 Mbit/s
+#define USB_SPEED_HIGH 1
+//!@}
+
 /*!
 \defgroup grp_endpoint_types Endpoint types
 \ingroup grp_public
@@ -171,11 +184,11 @@ On some ports, a previous request may be in progress, but the endpoint can accep
 #define USB_EVT_READY 1
 
 //! Timed out
-/*! A timeout occurred on the endpoint.  The request which timed out has been cancelled.  The amount of data actually transferred is passed in \p len (see usb_evt_cb).  If there are queued requests, the next one has been made active.  The endpoint may be ready for new requests. */
+/*! A timeout occurred on the endpoint.  The request which timed out has been cancelled.  The amount of data actually transferred is passed in \p len (see usb_evt_cb).  Any requests queued behind it are cancelled too, and each is reported with USB_EVT_CANCELLED after this event.  The endpoint is ready for new requests. */
 #define USB_EVT_TIMEOUT 2
 
 //! Requests have been cancelled
-/*! All pending requests have been cancelled on the endpoint.  The endpoint is ready for new requests.  The \p data and \p len pointers are undefined. */
+/*! A pending request has been cancelled.  This event is sent once for each request that was queued on the endpoint, oldest first; \p data identifies the request, and \p len is the number of bytes moved before the cancellation took effect.  When the last one has been reported, the endpoint is ready for new requests. */
 #define USB_EVT_CANCELLED 3
 
 //! Endpoint is configured and ready
@@ -324,32 +337,9 @@ For a setup read transaction:
 - If #len is greater than <tt>USB_CTL_PACKET_SIZE</tt>, you must split 
   the transaction.
 
-There are two ways to run a split data read transaction.  The first method is to point #data at the beginning of your buffer and set #datalen to the total amount of data you want to return.  If #datalen is longer than \c USB_CTL_PACKET_SIZE, the stack will automatically split the packet by "walking" it.  If the host has requested \e less data than you have to send, only that amount of data will be sent.
-
-The second method requires a little more work, but is useful when you need
-more control, or if you are generating data on the fly or reading it from a
-special peripheral (to mention two examples). The trick is this: if #datalen 
-is equal to \c USB_CTL_PACKET_SIZE, \e and #len is 
-longer than #datalen, the stack will send #datalen bytes, and it will then 
-call you, asking for more data.  It will keep calling you until it has sent 
-#len bytes or until you set #datalen to something less than USB_CTL_PACKET_SIZE, 
-which causes the stack to send a short packet, which ends the transaction.
-
-Before the stack calls you, if fills out the setup structure with values it thinks are
-appropriate.  You are free to alter (some of) these values at
-that time, and the stack will honour your alterations (as long as they make
-sense)!  The values you can alter are #data, #dataofs, and #datalen. You should 
-\e never alter any of the standard USB fields, and you should <em>never, 
-ever alter the #bytect field;</em> doing the former will probably get you into
-serious trouble, and doing the latter will definitely get you into serious 
-trouble.
-
-The #dataofs field may seem a bit of a waste, but it's needed during read 
-transactions for systems 
-which use byte packing to store USB packet data, where it can save you a 
-lot of work.  If portability is a 
-concern, you should always favour it over merely altering #data.  
-See the documentation for #dataofs for details.
+There are two ways to run a split data read transaction.  The first is to pass usb_ctl_read_end() the whole of the data.  If it is longer than \c USB_CTL_PACKET_SIZE, the stack will automatically split it by "walking" it.  If the host has requested \e less data than you have to send, only that amount of data will be sent.
+
+The second is useful when the data is generated on the fly or read from a special peripheral, and would be expensive to build in RAM all at once.  Pass usb_ctl_read_gen() the length of the data and a usb_ctl_gen callback, and the stack will call you for each packet as the host asks for it.  Returning less than a full packet ends the transaction early.
 
 \ingroup grp_public_control
 */
@@ -381,9 +371,135 @@ typedef struct usb_setup_t {
 	u16 len;
 } usb_setup_t;
 
+//! Control request handler
+/*! A handler for one class or vendor control request, named in a \c request block of the configuration file.  It is called from the control dispatcher in place of usb_ctl(), in the same context, with the request in \c usb_setup and any write data in \c usb_ctl_write_data.
+
+If the request block sets \c chunked, a control write may be longer than \c USB_CTL_WRITE_BUF_SIZE.  The handler is then called each time \c usb_ctl_write_data fills, and once more with the rest; usb_ctl_write_ofs() and usb_ctl_write_len() say which part of the data it holds.  The handler must consume the data before it returns, and must not end the request until the last call, in which usb_ctl_write_ofs() plus usb_ctl_write_len() is \c usb_setup.len.
+
+The handler ends the request with usb_ctl_read_end() or usb_ctl_write_end() before it returns, or returns 0 and ends it later, from any context, for example once a task has the data.  The control endpoint NAKs the host until then.  A handler which returns nonzero has the request stalled.
+
+\return 0, or nonzero to stall the request
+
+\ingroup grp_public_control
+*/
+typedef int (*usb_ctl_handler)(void);
+
+//! Control read generator
+/*! Supplies one packet of a control read started with usb_ctl_read_gen().  The stack calls it for each packet, in order, in the context in which it handles control events, so it should be quick.
+
+\param ofs Offset of the packet in the data stage
+\param len Number of bytes wanted, at most \c USB_CTL_PACKET_SIZE
+\param buf Where to put them
+\return The number of bytes put in \p buf.  Fewer than \p len ends the data stage after this packet; a negative number stalls the request.
+
+\ingroup grp_public_control
+*/
+typedef int (*usb_ctl_gen)(u16 ofs, u16 len, usb_data_t *buf);
+
+//! Control request statistics
+/*! The control dispatcher keeps one of these for each handler.  Latencies run from the dispatch of the request to usb_ctl_read_end(), usb_ctl_write_end() or usb_ctl_stall().  They are measured with usbhw_clock() if the port defines USBHW_HAVE_CLOCK, and otherwise on the core's millisecond clock, so that their resolution is that of the timeouts.
+
+\sa usb_ctl_clear_stats()
+
+\ingroup grp_public_control
+*/
+typedef struct usb_ctl_stat_t {
+	//! Number of requests dispatched
+	u16 count;
+	//! Number of requests stalled
+	u16 stalls;
+	//! Number of requests the handler returned from without ending
+	u16 deferred;
+	//! Longest latency in microseconds
+	u32 maxus;
+	//! Sum of all latencies in microseconds
+	/*! Wraps after about 71 minutes in all. */
+	u32 totalus;
+} usb_ctl_stat_t;
+
+//! Control handler table entry
+/*! \internal */
+typedef struct usb_ctl_entry_t {
+	usb_ctl_handler handler;
+	usb_ctl_stat_t *stat;
+	//! Nonzero if the handler takes write data a chunk at a time
+	u8 chunked;
+} usb_ctl_entry_t;
+
+//! Control handler table
+/*! \internal Handlers for one request type and recipient, indexed by bRequest less \a first. */
+typedef struct usb_ctl_table_t {
+	u8 first;
+	u8 count;
+	const usb_ctl_entry_t *entries;
+} usb_ctl_table_t;
+
 typedef struct usb_endpoint_t usb_endpoint_t;
 typedef struct usb_alarm_t usb_alarm_t;
 
+//! Scatter-gather element
+/*! One element of a vectored transfer; see usb_txv() and usb_rxv().  The elements of a vector are moved as one transfer, in order.
+
+\ingroup grp_public_io
+*/
+typedef struct usb_iovec_t {
+	//! Data buffer
+	usb_data_t *data;
+	//! Length of the buffer in bytes
+	u32 len;
+} usb_iovec_t;
+
+/*!
+\defgroup grp_req_flags Request flags
+\ingroup grp_private
+
+Flags stored in usb_req_t#flags.
+@{
+*/
+//! Chained request; ends with a short packet
+#define USB_REQF_CHAIN 1
+//! The last segment of the request has been handed to the port
+#define USB_REQF_ISSUED 2
+//!@}
+
+//! Endpoint transfer request
+/*! One entry in an endpoint's request queue.  usb_tx(), usb_rx() and friends fill in one of these and append it to the queue; the core hands queued requests to the port in order, and retires them in order as the port reports completion through usb_evt_done().
+
+The queue itself is a static array generated by usbgen for each endpoint.  Its depth is set with the \c queueDepth endpoint option.
+
+A request is a vector of one or more buffers (usb_iovec_t).  Single-buffer requests keep their buffer in \a one; vectored requests point at the user's array, which must stay put until the request has finished.
+
+A request may be longer than the port can move in one go (USBHW_MAX_SEG), or span several buffers.  The core then hands it to the port in segments, keeping track of what has been handed over in \a issued (element \a ii, offset \a iofs) and of what has come back in \a done (element \a di, offset \a dofs).  No segment spans two buffers, except for a single IN packet copied into the endpoint's bounce buffer.
+
+Users of the external PORUS API never see this structure.
+
+\ingroup grp_private
+*/
+typedef struct usb_req_t {
+	//! Buffer vector
+	const usb_iovec_t *iov;
+	//! Buffer for single-buffer requests
+	usb_iovec_t one;
+	//! Number of elements in \a iov
+	u8 iovcnt;
+	//! Element and offset of the next segment to hand to the port
+	u8 ii;
+	u32 iofs;
+	//! Element and offset of the oldest segment at the port
+	u8 di;
+	u32 dofs;
+	//! Requested length in bytes, for the whole vector
+	u32 len;
+	//! Number of bytes handed to the port so far
+	u32 issued;
+	//! Number of bytes moved so far
+	u32 done;
+	//! Data word overwritten by the length word of the current OUT segment
+	usb_data_t saved;
+	//! Request flags; see grp_req_flags
+	u8 flags;
+} usb_req_t;
+
 //! Endpoint status notification callback
 /*! Optionally called when an endpoint event occurs.  Endpoint events are described in the documentation for the USB_EVT_* macros.
 
@@ -399,7 +515,7 @@ This function may be called under interrupt.  It should execute quickly.
 \ingroup grp_public_io
 */
 typedef void (*usb_evt_cb)(usb_endpoint_t *ep, 
-	usb_data_t *data, u16 len, u8 evt);
+	usb_data_t *data, u32 len, u8 evt);
 
 //! SOF callback
 /*! Called when a SOF (start-of-frame) token is received.  This is called at 
@@ -409,6 +525,15 @@ interrupt time.
 */
 typedef void (*usb_cb_sof)(void);
 
+//! Event callback
+/*! Called under interrupt each time the port records an event for usb_dispatch().  It should arrange for usb_dispatch() to run soon, for example by posting a SWI.
+
+\sa usb_set_dispatch_cb()
+
+\ingroup grp_public_io
+*/
+typedef void (*usb_cb_dispatch)(void);
+
 //! USB state change callback
 /*! USB state change notification callback.  Called whenever the USB state changes, and after the state change has actually occurred.
 
@@ -419,9 +544,26 @@ This is set with usb_set_state_cb().
 */
 typedef void (*usb_cb_state)(int state);
 
+/*! \name USB buffers
+
+On some targets (USB_BUF_LEN_SIZE nonzero), the port writes a length 
+word in front of the data it receives.  A USB buffer therefore has 
+USB_BUF_LEN_SIZE words of headroom in front of its data, which belong 
+to the port.  Buffers are always passed around by their data pointer: 
+usb_rx() and friends take it, completions and streams hand it back, 
+and received data starts there, so it never needs moving.  Only the 
+code which allocates a buffer deals with the headroom.
+
+Buffers from usb_pool_alloc() come with headroom.  For other buffers, 
+allocate usb_buf_sizeof() the length and use usb_buf_data() of the 
+storage as the buffer.  Buffers which are only transmitted need no 
+headroom.
+*/
+//@{
+
 //! Total space occupied by a USB buffer
 /*! This macro evaluates to the total amount of space occupied by a 
-USB buffer, including the length byte(s).  The length is a size_t, 
+USB buffer, including the headroom.  The length is a size_t, 
 and can be passed to malloc.
 
 \param len Number of USB bytes to make space for.  The actual size of the 
@@ -435,9 +577,8 @@ declared structure, in units of size_t, may be different.
 /*! This macro provides a convenient way to declare a static USB 
 packet buffer of a fixed size.
 
-The buffer is not initialised in any way.  This means that the length 
-will be incorrect; you should generally call usb_buf_set_len() on it 
-before using it.
+The buffer is not initialised in any way.  \p name is the storage, 
+headroom included; pass usb_buf_data(\p name) to usb_rx().
 
 \param name Buffer name, which becomes the name of the buffer structure.
 \param len Number of USB bytes to allocate for.  The actual size of the 
@@ -448,10 +589,154 @@ the actual size, use usb_buf_sizeof().
 */
 #define USB_BUF_STATIC(name,len) usb_data_t name[usb_mem_len(len)+USB_BUF_LEN_SIZE]
 
+//! Data pointer of a USB buffer
+/*! Gives the buffer whose storage, usb_buf_sizeof() long, starts at \p mem. */
+#define usb_buf_data(mem) ((mem)+USB_BUF_LEN_SIZE)
+
+//! Storage of a USB buffer
+/*! The inverse of usb_buf_data(): gives the start of the storage of buffer \p buf, for example to free it. */
+#define usb_buf_mem(buf) ((buf)-USB_BUF_LEN_SIZE)
+
+//@}
+
+//! Streaming receive
+/*! Describes a ring of blocks which an endpoint works through with no per-block callback: usb_rx_stream() fills free blocks from an OUT endpoint, and usb_tx_stream() sends filled blocks on an IN endpoint.
+
+For an OUT stream, \a get returns the next free block of \a blocklen bytes, with headroom (see usb_buf_data()), or 0 if there is none.  For an IN stream, it returns the next filled block, or 0 if there is none; \p len is \a blocklen on entry, and may be lowered for a partial block.  A partial IN block ends the transfer with a short packet.  Blocks should not be empty.
+
+The endpoint may hold several blocks at once, up to its queue depth; they are handed back through \a put in the order they were taken, with the number of bytes moved.  A block which is handed back unused has length 0, and should go back in the ring as it was.  An OUT block which a zero-length packet ended also has length 0; since blocks come back in order, a ring which hands them out in order should take such a block as filled, with no data, rather than return it.  \a put returns the ring's level: for an OUT stream, the number of filled blocks waiting to be consumed; for an IN stream, the number of filled blocks not yet taken.
+
+\a mark, if set, is called when \a put returns a level of \a lowat or below, or of \a hiwat or above (if \a hiwat is nonzero).  It is called only once until the stream is next kicked (usb_stream_kick()), so an IN producer can sleep until its ring runs low, and an OUT consumer can be woken only once there is a worthwhile amount of data; each refills or drains the ring and then kicks the stream.  An OUT stream normally leaves \a lowat at 0, which is reached only when blocks are handed back unused.
+
+All three are called under interrupt, and must be quick.
+
+The statistics are reset when the stream is started.
+
+\ingroup grp_public_io
+*/
+typedef struct usb_stream_t usb_stream_t;
+struct usb_stream_t {
+	//! Returns the next block, or 0
+	usb_data_t *(*get)(usb_stream_t *s, u32 *len);
+	//! Takes back a block; returns the ring's level
+	u32 (*put)(usb_stream_t *s, usb_data_t *block, u32 len);
+	//! Called when the level crosses a watermark; may be 0
+	void (*mark)(usb_stream_t *s, u32 level);
+	//! Block length in bytes
+	u32 blocklen;
+	//! Low watermark
+	u32 lowat;
+	//! High watermark, or 0 for none
+	u32 hiwat;
+	//! For the user's use
+	void *ptr;
+	//! Number of blocks moved
+	u32 blocks;
+	//! Highest level returned by \a put
+	u32 maxlevel;
+	//! Number of times the endpoint had to NAK for want of a block
+	u16 full;
+	//! Nonzero while the endpoint is NAKing for want of a block
+	u8 starved;
+	//! Nonzero once \a mark has been called, until the stream is kicked
+	u8 marked;
+	//! Set by usb_stream_flush() until the transfer has been ended
+	u8 flushing;
+	//! Nonzero if the IN transfer has data not yet ended by a short packet
+	u8 open;
+};
+
+//! Isochronous endpoint ring
+/*! Describes where an isochronous endpoint started with usb_iso_start() gets its packets.  Once a frame, the core takes one packet from \a get and stages it, so that it moves in the following frame with no application code running in between.
+
+For an IN endpoint, \a get returns the next frame's packet, or 0 if there is none.  \p len is the endpoint's packet size on entry, and is set to the length of the packet, which may differ from frame to frame, and may be 0.  For an OUT endpoint, \a get returns a free buffer with headroom for the packet size (see usb_buf_data()), or 0 if there is none; \p len is ignored.
+
+Each packet is handed back through \a put after its frame, with the number of bytes moved.  A packet which was not moved (because the endpoint was cancelled or timed out) is handed back with length 0.
+
+Both are called under interrupt, once per frame, and must be quick.
+
+At high speed, read "service interval" for "frame": the core stages a packet every \c hsInterval microframes (see usb_endpoint_t), and the packet may be up to the packet size times the number of transactions per microframe, which the port splits.  \a frames then counts microframes.
+
+The statistics are reset by usb_iso_start().
+
+\ingroup grp_public_io
+*/
+typedef struct usb_iso_t usb_iso_t;
+struct usb_iso_t {
+	//! Returns the next packet or buffer, or 0
+	usb_data_t *(*get)(usb_iso_t *s, u16 *len);
+	//! Takes back a packet after its frame
+	void (*put)(usb_iso_t *s, usb_data_t *pkt, u16 len);
+	//! For the user's use
+	void *ptr;
+	//! Number of frames seen
+	u32 frames;
+	//! Number of packets moved
+	u32 packets;
+	//! Number of IN frames with no packet ready
+	u16 underruns;
+	//! Number of OUT frames with no buffer ready
+	u16 overruns;
+	//! Number of frames in which the host did not move the staged packet
+	u16 missed;
+	//! Nonzero while the engine is staging packets
+	u8 running;
+	//! Endpoint (private)
+	usb_endpoint_t *ep;
+	//! Next running ring (private)
+	usb_iso_t *next;
+};
+
+//! Fixed-block buffer pool
+/*! A pool of equal-sized USB buffers, each usb_buf_sizeof() the block length.  usb_pool_alloc() hands out their data pointers, with the headroom in front.  Blocks are taken with usb_pool_alloc() and returned with usb_pool_free(), both in constant time and both safe to call from an endpoint event callback.
+
+Free blocks are kept as a stack of block indices in \a freestack.  Blocks which have never been handed out are not on the stack; they are the ones from \a fresh up, so a pool whose counters start at zero is ready to use.
+
+A pool may be declared with USB_POOL_STATIC(), set up at run time with usb_pool_init(), or generated by usbgen from a \c pool block in the configuration file.
+
+\ingroup grp_public_io
+*/
+typedef struct usb_pool_t {
+	//! Storage for all blocks
+	usb_data_t *mem;
+	//! Stack of free block indices, \a nblocks long
+	u16 *freestack;
+	//! Length of one block, in usb_data_t
+	u16 blocklen;
+	//! Number of blocks
+	u16 nblocks;
+	//! Number of indices on \a freestack
+	u16 nfree;
+	//! Index of the first block never handed out
+	u16 fresh;
+	//! Number of blocks in use
+	u16 used;
+	//! Largest number of blocks ever in use at once
+	u16 maxused;
+	//! Number of allocations which failed because the pool was empty
+	u16 failed;
+} usb_pool_t;
+
+//! Static buffer pool declarator
+/*! Declares a buffer pool called \p name, with \p n blocks which each hold a USB buffer of \p len bytes.  The pool needs no initialisation.
+
+\param name Pool name
+\param len Number of USB bytes per block
+\param n Number of blocks
+
+\ingroup grp_public_io
+*/
+#define USB_POOL_STATIC(name,len,n) \
+	static usb_data_t name##_mem[(usb_mem_len(len)+USB_BUF_LEN_SIZE)*(n)]; \
+	static u16 name##_free[n]; \
+	usb_pool_t name={name##_mem,name##_free,usb_mem_len(len)+USB_BUF_LEN_SIZE,n}
+
 //! Writable endpoint structure
 /*! This structure is pointed to by usb_endpoint_t, and is stored in RAM.  It contains primarily status information.
 
-As each endpoint can sustain only one complete transaction at a time, the information for it is kept here.  \a buf, \a reqlen, and \a actlen keep the necessary information.  Note that this is for the current \e transaction, and not for a single \e packet.  A transaction may be made of several packets.
+Requests are queued in the endpoint's usb_req_t array (usb_endpoint_t#queue), which is used as a ring.  \a qhead indexes the oldest request, \a qcount is the number of requests in the ring, and \a qactive is the number of segments (see usb_req_t) which the port is holding.  \a qbounce is set while the port is holding the endpoint's bounce buffer.  Requests are always handed to the port, and retired, oldest first.
+
+The port keeps the state of the transaction it is currently moving in \a buf, \a reqlen, and \a actlen.  Note that this is for the current \e transaction, and not for a single \e packet.  A transaction may be made of several packets.
 
 The \c hwdata field is useful for ports that need to store additional information for endpoints.  In particular, \c hwdata is often used for storing the active packet request, or a pointer to a queue of packet requests.
 
@@ -466,9 +751,13 @@ struct usb_endpoint_data_t {
 	//! Endpoint status
 	unsigned int stat:3,
 		//! Timeout status
-		timed_out:1;
-	//! Time of last transaction; units port-dependent
-	u32 check_time;
+		timed_out:1,
+		//! Set while the endpoint is on the timeout wheel
+		armed:1;
+	//! Time at which the endpoint times out, in ms; see usb_timer_arm()
+	u32 deadline;
+	//! Next and previous endpoints in the same timeout wheel slot
+	usb_endpoint_t *tnext, *tprev;
 	//! Timeout in milliseconds; 0 = no timeout
 	u16 timeout;
 	//! Endpoint event callback
@@ -483,6 +772,24 @@ struct usb_endpoint_data_t {
 	u32 actlen;
 	//! Generic pointer for port use
 	void *hwdata;
+	//! Index of oldest queued request
+	u8 qhead;
+	//! Number of queued requests
+	u8 qcount;
+	//! Number of segments handed to the port
+	u8 qactive;
+	//! Nonzero while the bounce buffer is at the port
+	u8 qbounce;
+	//! Stream feeding the endpoint, or 0; see usb_rx_stream(), usb_tx_stream()
+	usb_stream_t *stream;
+	//! Isochronous ring feeding the endpoint, or 0; see usb_iso_start()
+	usb_iso_t *iso;
+	//! Packet size in the interface's current alternate setting
+	/*! 0 if the endpoint is not part of the current setting.  Equal to usb_endpoint_t#packetSize for interfaces without alternate settings.  The core and the port use this, not \a packetSize, for everything but reserving buffer memory. */
+	u16 maxpkt;
+	//! Transactions per microframe
+	/*! 1, or for high-bandwidth interrupt and isochronous endpoints at high speed, up to 3.  Each transaction carries up to \a maxpkt bytes. */
+	u8 mult;
 };
 
 typedef struct usb_endpoint_data_t usb_endpoint_data_t;
@@ -513,9 +820,7 @@ struct usb_endpoint_t {
 		*/
 		type:2; // endpoint type
 	//! Maximum packet size
-	/*! The maximum allowable packet size for this endpoint, in bytes. 
-	
-	This is important for endpoint configuration, as this must usually be passed to the hardware.
+	/*! The maximum allowable packet size for this endpoint at full speed, in bytes.  If the endpoint's interface has alternate settings, this is the largest size in any of them, so that ports can reserve enough buffer memory once; the size in use is in usb_endpoint_data_t#maxpkt.  High-speed ports reserve \a hsPacketSize instead.
 	*/
 	unsigned short packetSize; // in bytes
 	//! Pointer to writable section
@@ -525,6 +830,36 @@ struct usb_endpoint_t {
 	int in_timeout; // in frames
 	//! Next endpoint structure, or 0
 	usb_endpoint_t *next;
+	//! Request queue
+	/*! Points to a writable array of \a queueDepth requests in RAM.
+	*/
+	usb_req_t *queue;
+	//! Request queue depth
+	/*! The maximum number of requests which may be outstanding on this endpoint at once.  Set by the \c queueDepth option in the configuration file.
+	*/
+	u8 queueDepth;
+	//! Bounce buffer
+	/*! One packet of RAM, used by vectored IN transfers to send a packet which straddles two buffers.  Generated when the \c gatherBuffer option is set in the configuration file; otherwise 0.
+	*/
+	usb_data_t *bounce;
+	//! Number of the interface the endpoint belongs to
+	u8 iface;
+	//! Packet size in each alternate setting
+	/*! Indexed by alternate setting; 0 where the endpoint is not part of the setting.  0 if the interface has no alternate settings.
+	*/
+	const u16 *altPacketSize;
+	//! High-speed buffer size
+	/*! The most bytes the endpoint moves in one microframe at high speed, in any alternate setting: the packet size times the number of transactions.  0 unless the configuration sets \c highSpeed.
+	*/
+	u16 hsPacketSize;
+	//! High-speed polling interval
+	/*! In microframes, a power of 2.  0 for bulk endpoints, and unless the configuration sets \c highSpeed.
+	*/
+	u16 hsInterval;
+	//! High-speed wMaxPacketSize in each alternate setting
+	/*! Indexed by alternate setting, as in the endpoint descriptor: the packet size in bits 0-10, and the number of extra transactions per microframe in bits 11 and 12.  0 where the endpoint is not part of the setting.  0 unless the configuration sets \c highSpeed.
+	*/
+	const u16 *hsAltPacketSize;
 };
 
 #endif
@@ -0,0 +1,97 @@
+// :wrap=soft:
+
+/* test/host/hostpriv.h -- back end interface of the host library */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_hostpriv_h
+#define GUARD_hostpriv_h
+
+#include "porushost.h"
+
+//! One request handed to a back end
+/*! A control transfer if \c control is set, with the data stage at \c buf; otherwise a bulk request on endpoint \c ep. */
+typedef struct porus_req_t {
+	int ep;
+	unsigned char *buf;
+	unsigned long len;
+	//! OUT: end with a zero-length packet if \c len is a whole number of packets
+	int zlp;
+	unsigned int timeout;
+	int control;
+	unsigned char setup[8];
+
+	//! Set by porus_req_done()
+	int done;
+	//! 0 or an error code
+	int status;
+	//! Bytes moved
+	unsigned long actual;
+	//! porus_now() at submission and completion
+	double t_submit, t_done;
+
+	//! For the back end
+	void *priv;
+	unsigned int seq;
+} porus_req_t;
+
+//! Back end operations
+typedef struct porus_backend_t {
+	//! Start a request
+	/*! Returns 0, or an error code if the request cannot be started; it then never completes.  The back end may hold new requests back and start them together at the next wait(). */
+	int (*submit)(porus_host_t *h, porus_req_t *r);
+	//! Cancel a request
+	/*! The request still completes, through wait(), with PORUS_ECANCELLED unless it had finished already. */
+	void (*cancel)(porus_host_t *h, porus_req_t *r);
+	//! Wait for completions
+	/*! Starts held requests, then waits until at least one request has completed, calling porus_req_done() for each which has.  Returns 0, or PORUS_EIO if the device has gone. */
+	int (*wait)(porus_host_t *h);
+	//! Packet size of an endpoint, or PORUS_EINVAL
+	int (*maxpkt)(porus_host_t *h, int ep);
+	//! Cancel everything, and free the device
+	void (*close)(porus_host_t *h);
+} porus_backend_t;
+
+//! Open device
+/*! A back end's device structure begins with this one. */
+struct porus_host_t {
+	const porus_backend_t *be;
+};
+
+//! Report a completed request
+/*! Called by the back ends, with \c status and \c actual set. */
+void porus_req_done(porus_req_t *r);
+
+//! Wait for a request
+/*! Calls the back end's wait() until \p r has completed.  Returns its status, or PORUS_EIO. */
+int porus_req_wait(porus_host_t *h, porus_req_t *r);
+
+//! Read the endpoint packet sizes from the active configuration
+/*! For back ends which cannot ask the system: reads the configuration descriptor of configuration \p cnf through \p h and fills \p maxpkt, indexed by endpoint number, plus 16 for IN.  Returns 0 or an error code. */
+int porus_read_maxpkt(porus_host_t *h, int cnf, unsigned short *maxpkt);
+
+#endif
@@ -0,0 +1,174 @@
+/* test/host/hostusb.c -- libusb back end of the host library */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Each request is a libusb_transfer, submitted at once, so libusb and 
+the kernel have as many in flight as the pipeline submits.  Completions 
+come from libusb_handle_events_timeout_completed(). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libusb.h>
+#include "hostpriv.h"
+
+typedef struct usb_host_t {
+	porus_host_t h;
+	libusb_context *ctx;
+	libusb_device_handle *dev;
+} usb_host_t;
+
+static void LIBUSB_CALL transfer_done(struct libusb_transfer *t)
+{
+	porus_req_t *r=t->user_data;
+
+	switch (t->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		r->status=0;
+		break;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		r->status=PORUS_ETIMEOUT;
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		r->status=PORUS_ECANCELLED;
+		break;
+	case LIBUSB_TRANSFER_STALL:
+		r->status=PORUS_ESTALL;
+		break;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		r->status=PORUS_EOVERFLOW;
+		break;
+	default:
+		r->status=PORUS_EIO;
+	}
+	r->actual=t->actual_length;
+	// the data stage of a control transfer follows the setup packet
+	if (r->control&&(r->ep&0x80)&&r->actual)
+		memcpy(r->buf,libusb_control_transfer_get_data(t),r->actual);
+	r->priv=0;
+	libusb_free_transfer(t);
+	porus_req_done(r);
+}
+
+static int usb_submit(porus_host_t *h, porus_req_t *r)
+{
+	usb_host_t *u=(usb_host_t *)h;
+	struct libusb_transfer *t;
+	unsigned char *buf;
+
+	t=libusb_alloc_transfer(0);
+	if (!t) return PORUS_ENOMEM;
+	if (r->control) {
+		buf=malloc(LIBUSB_CONTROL_SETUP_SIZE+r->len);
+		if (!buf) {
+			libusb_free_transfer(t);
+			return PORUS_ENOMEM;
+		}
+		memcpy(buf,r->setup,LIBUSB_CONTROL_SETUP_SIZE);
+		if (!(r->ep&0x80)&&r->len)
+			memcpy(buf+LIBUSB_CONTROL_SETUP_SIZE,r->buf,r->len);
+		libusb_fill_control_transfer(t,u->dev,buf,transfer_done,r,r->timeout);
+		t->flags=LIBUSB_TRANSFER_FREE_BUFFER;
+	} else {
+		libusb_fill_bulk_transfer(t,u->dev,r->ep,r->buf,r->len,transfer_done,r,r->timeout);
+		if (r->zlp) t->flags=LIBUSB_TRANSFER_ADD_ZERO_PACKET;
+	}
+	if (libusb_submit_transfer(t)) {
+		libusb_free_transfer(t);
+		return PORUS_EIO;
+	}
+	r->priv=t;
+	return 0;
+}
+
+static void usb_cancel(porus_host_t *h, porus_req_t *r)
+{
+	if (r->priv) libusb_cancel_transfer(r->priv);
+}
+
+static int usb_wait(porus_host_t *h)
+{
+	usb_host_t *u=(usb_host_t *)h;
+	struct timeval tv={1,0};
+	int err;
+
+	// returns on any event; the caller waits again if its request is not done
+	err=libusb_handle_events_timeout_completed(u->ctx,&tv,0);
+	return err&&err!=LIBUSB_ERROR_INTERRUPTED?PORUS_EIO:0;
+}
+
+static int usb_maxpkt(porus_host_t *h, int ep)
+{
+	usb_host_t *u=(usb_host_t *)h;
+	int mp=libusb_get_max_packet_size(libusb_get_device(u->dev),ep);
+
+	// the packet size, not the bytes per microframe of a high-bandwidth endpoint
+	return mp>0?mp&0x7ff:PORUS_EINVAL;
+}
+
+static void usb_close(porus_host_t *h)
+{
+	usb_host_t *u=(usb_host_t *)h;
+
+	if (u->dev) {
+		libusb_release_interface(u->dev,0);
+		libusb_close(u->dev);
+	}
+	libusb_exit(u->ctx);
+	free(u);
+}
+
+static const porus_backend_t usb_backend={
+	usb_submit,
+	usb_cancel,
+	usb_wait,
+	usb_maxpkt,
+	usb_close
+};
+
+porus_host_t *porus_open_usb(unsigned int vid, unsigned int pid)
+{
+	usb_host_t *u;
+
+	u=calloc(1,sizeof(*u));
+	if (!u) return 0;
+	u->h.be=&usb_backend;
+	if (libusb_init(&u->ctx)) {
+		free(u);
+		return 0;
+	}
+	u->dev=libusb_open_device_with_vid_pid(u->ctx,vid,pid);
+	if (!u->dev) {
+		usb_close(&u->h);
+		return 0;
+	}
+	libusb_set_auto_detach_kernel_driver(u->dev,1);
+	if (libusb_claim_interface(u->dev,0)) {
+		usb_close(&u->h);
+		return 0;
+	}
+	return &u->h;
+}
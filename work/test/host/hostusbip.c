@@ -0,0 +1,401 @@
+/* test/host/hostusbip.c -- USB/IP back end of the host library */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Imports a device over TCP, as vhci-hcd would, without the kernel.  
+Requests become CMD_SUBMITs, which are held until the next wait() and 
+then sent together with one writev().  Replies are matched to requests 
+by sequence number.  USB/IP has no timeouts, so they are kept here: a 
+request which runs over is unlinked, and completes with PORUS_ETIMEOUT 
+once the server has let it go. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hostpriv.h"
+#include "usbip.h"
+
+// requests in flight at once, in all
+#define MAX_INFLIGHT 256
+// requests held for one writev()
+#define MAX_BATCH 64
+// largest request; IN data must fit in rbuf
+#define MAX_LEN (1ul<<20)
+
+typedef struct slot_t {
+	porus_req_t *r;
+	double deadline;
+	// sequence number of the CMD_UNLINK sent for it, or 0
+	unsigned int unlink;
+	int timed_out;
+} slot_t;
+
+typedef struct usbip_host_t {
+	porus_host_t h;
+	int fd;
+	unsigned int devid, seqnum;
+	slot_t slot[MAX_INFLIGHT];
+	unsigned char hdr[MAX_BATCH][USBIP_CMD_LEN];
+	struct iovec iov[2*MAX_BATCH];
+	int nhdr, niov;
+	unsigned short maxpkt[32];
+	unsigned char rbuf[2*MAX_LEN];
+	size_t rlen, rofs;
+} usbip_host_t;
+
+/* ------ Socket */
+
+static int send_all(int fd, struct iovec *iov, int n)
+{
+	ssize_t r;
+
+	while (n) {
+		r=writev(fd,iov,n);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			return PORUS_EIO;
+		}
+		for (;n&&(size_t)r>=iov->iov_len;--n,++iov)
+			r-=iov->iov_len;
+		if (n) {
+			iov->iov_base=(char *)iov->iov_base+r;
+			iov->iov_len-=r;
+		}
+	}
+	return 0;
+}
+
+/* sends the held commands */
+static int flush(usbip_host_t *u)
+{
+	int err;
+
+	if (!u->niov) return 0;
+	err=send_all(u->fd,u->iov,u->niov);
+	u->nhdr=u->niov=0;
+	return err;
+}
+
+/* reads what the socket has, waiting for it up to timeout ms (forever 
+if negative); returns 0, or PORUS_EIO if the connection has gone */
+static int fill(usbip_host_t *u, int timeout)
+{
+	struct pollfd p;
+	ssize_t r;
+
+	if (u->rofs) {
+		memmove(u->rbuf,u->rbuf+u->rofs,u->rlen-u->rofs);
+		u->rlen-=u->rofs;
+		u->rofs=0;
+	}
+	p.fd=u->fd;
+	p.events=POLLIN;
+	r=poll(&p,1,timeout);
+	if (r<0) return errno==EINTR?0:PORUS_EIO;
+	if (!r) return 0;
+	r=read(u->fd,u->rbuf+u->rlen,sizeof(u->rbuf)-u->rlen);
+	if (r<0) return errno==EINTR||errno==EAGAIN?0:PORUS_EIO;
+	if (!r) return PORUS_EIO;
+	u->rlen+=r;
+	return 0;
+}
+
+/* blocks until n bytes are in rbuf; used only while importing */
+static unsigned char *take(usbip_host_t *u, size_t n)
+{
+	while (u->rlen-u->rofs<n)
+		if (fill(u,-1)) return 0;
+	u->rofs+=n;
+	return u->rbuf+u->rofs-n;
+}
+
+/* ------ Requests */
+
+static slot_t *find(usbip_host_t *u, unsigned int seq, int unlink)
+{
+	int i;
+
+	for (i=0;i<MAX_INFLIGHT;++i)
+		if (u->slot[i].r&&(unlink?u->slot[i].unlink:u->slot[i].r->seq)==seq)
+			return u->slot+i;
+	return 0;
+}
+
+static slot_t *slot_of(usbip_host_t *u, porus_req_t *r)
+{
+	int i;
+
+	for (i=0;i<MAX_INFLIGHT;++i)
+		if (u->slot[i].r==r)
+			return u->slot+i;
+	return 0;
+}
+
+static void complete(slot_t *s, int status, unsigned long actual)
+{
+	porus_req_t *r=s->r;
+
+	switch (status) {
+	case 0:
+		break;
+	case USBIP_EPIPE:
+		status=PORUS_ESTALL;
+		break;
+	case USBIP_EOVERFLOW:
+		status=PORUS_EOVERFLOW;
+		break;
+	case USBIP_ECONNRESET:
+	case USBIP_ESHUTDOWN:
+		status=s->timed_out?PORUS_ETIMEOUT:PORUS_ECANCELLED;
+		break;
+	default:
+		status=PORUS_EIO;
+	}
+	r->status=status;
+	r->actual=actual;
+	s->r=0;
+	porus_req_done(r);
+}
+
+/* holds a command, with its OUT data, for the next flush */
+static int hold(usbip_host_t *u, usbip_cmd *c, void *data, size_t len)
+{
+	int err;
+
+	if (u->nhdr==MAX_BATCH&&(err=flush(u))) return err;
+	usbip_pack_cmd(u->hdr[u->nhdr],c);
+	u->iov[u->niov].iov_base=u->hdr[u->nhdr++];
+	u->iov[u->niov++].iov_len=USBIP_CMD_LEN;
+	if (len) {
+		u->iov[u->niov].iov_base=data;
+		u->iov[u->niov++].iov_len=len;
+	}
+	return 0;
+}
+
+static int ip_submit(porus_host_t *h, porus_req_t *r)
+{
+	usbip_host_t *u=(usbip_host_t *)h;
+	int in=r->ep&0x80;
+	usbip_cmd c;
+	slot_t *s;
+
+	if (r->len>MAX_LEN) return PORUS_EINVAL;
+	s=slot_of(u,0);
+	if (!s) return PORUS_ENOMEM;
+	memset(&c,0,sizeof(c));
+	c.base.command=USBIP_CMD_SUBMIT;
+	c.base.seqnum=r->seq=++u->seqnum;
+	c.base.devid=u->devid;
+	c.base.direction=in?USBIP_DIR_IN:USBIP_DIR_OUT;
+	c.base.ep=r->control?0:r->ep&15;
+	c.u.submit.transfer_buffer_length=r->len;
+	if (r->zlp) c.u.submit.transfer_flags=USBIP_URB_ZERO_PACKET;
+	if (r->control) memcpy(c.u.submit.setup,r->setup,8);
+	s->r=r;
+	s->unlink=0;
+	s->timed_out=0;
+	s->deadline=r->timeout?r->t_submit+r->timeout*1e3:0;
+	return hold(u,&c,r->buf,in?0:r->len);
+}
+
+static void ip_cancel(porus_host_t *h, porus_req_t *r)
+{
+	usbip_host_t *u=(usbip_host_t *)h;
+	slot_t *s=slot_of(u,r);
+	usbip_cmd c;
+
+	if (!s||s->unlink) return;
+	memset(&c,0,sizeof(c));
+	c.base.command=USBIP_CMD_UNLINK;
+	c.base.seqnum=s->unlink=++u->seqnum;
+	c.base.devid=u->devid;
+	c.u.unlink.seqnum=r->seq;
+	hold(u,&c,0,0);
+}
+
+/* handles every complete reply in rbuf; returns the number handled, or 
+PORUS_EIO if the server has broken the protocol */
+static int parse(usbip_host_t *u)
+{
+	unsigned char *p;
+	usbip_cmd c;
+	slot_t *s;
+	size_t len;
+	int n=0;
+
+	while (u->rlen-u->rofs>=USBIP_CMD_LEN) {
+		p=u->rbuf+u->rofs;
+		usbip_unpack_cmd(p,&c);
+		if (c.base.command==USBIP_RET_SUBMIT) {
+			s=find(u,c.base.seqnum,0);
+			if (!s||c.u.ret.actual_length<0||
+				(unsigned long)c.u.ret.actual_length>s->r->len)
+				return PORUS_EIO;
+			len=s->r->ep&0x80?c.u.ret.actual_length:0;
+			if (u->rlen-u->rofs<USBIP_CMD_LEN+len) break;
+			memcpy(s->r->buf,p+USBIP_CMD_LEN,len);
+			u->rofs+=USBIP_CMD_LEN+len;
+			complete(s,c.u.ret.status,c.u.ret.actual_length);
+			++n;
+		} else if (c.base.command==USBIP_RET_UNLINK) {
+			u->rofs+=USBIP_CMD_LEN;
+			// status 0: the RET_SUBMIT came first
+			s=find(u,c.base.seqnum,1);
+			if (s&&c.u.ret_unlink.status) {
+				complete(s,USBIP_ECONNRESET,0);
+				++n;
+			}
+		} else
+			return PORUS_EIO;
+	}
+	return n;
+}
+
+/* unlinks the requests which have run over; returns the time to the 
+next deadline in ms, or -1 if there is none */
+static int expire(usbip_host_t *u)
+{
+	double now=porus_now(),next=0;
+	slot_t *s;
+	int i;
+
+	for (i=0;i<MAX_INFLIGHT;++i) {
+		s=u->slot+i;
+		if (!s->r||!s->deadline||s->unlink) continue;
+		if (s->deadline<=now) {
+			s->timed_out=1;
+			ip_cancel(&u->h,s->r);
+		} else if (!next||s->deadline<next)
+			next=s->deadline;
+	}
+	return next?(int)((next-now)/1e3)+1:-1;
+}
+
+static int ip_wait(porus_host_t *h)
+{
+	usbip_host_t *u=(usbip_host_t *)h;
+	int n,timeout;
+
+	for (;;) {
+		timeout=expire(u);
+		if (flush(u)) return PORUS_EIO;
+		n=parse(u);
+		if (n) return n<0?n:0;
+		if (fill(u,timeout)) return PORUS_EIO;
+	}
+}
+
+static int ip_maxpkt(porus_host_t *h, int ep)
+{
+	usbip_host_t *u=(usbip_host_t *)h;
+	int mp=u->maxpkt[(ep&15)|(ep&0x80?16:0)];
+
+	return mp?mp:PORUS_EINVAL;
+}
+
+static void ip_close(porus_host_t *h)
+{
+	usbip_host_t *u=(usbip_host_t *)h;
+
+	// closing the connection makes the server drop every URB
+	close(u->fd);
+	free(u);
+}
+
+static const porus_backend_t usbip_backend={
+	ip_submit,
+	ip_cancel,
+	ip_wait,
+	ip_maxpkt,
+	ip_close
+};
+
+/* ------ Import */
+
+static int import(usbip_host_t *u, const char *busid)
+{
+	unsigned char req[USBIP_OP_LEN+USBIP_BUSID_LEN],*p;
+	usbip_op_header op;
+	struct iovec iov;
+
+	memset(req,0,sizeof(req));
+	op.version=USBIP_VERSION;
+	op.code=USBIP_OP_REQ_IMPORT;
+	op.status=0;
+	usbip_pack_op(req,&op);
+	strncpy((char *)req+USBIP_OP_LEN,busid,USBIP_BUSID_LEN-1);
+	iov.iov_base=req;
+	iov.iov_len=sizeof(req);
+	if (send_all(u->fd,&iov,1)) return PORUS_EIO;
+	p=take(u,USBIP_OP_LEN);
+	if (!p) return PORUS_EIO;
+	usbip_unpack_op(p,&op);
+	if (op.code!=USBIP_OP_REP_IMPORT||op.status) return PORUS_EIO;
+	p=take(u,USBIP_DEVICE_LEN);
+	if (!p) return PORUS_EIO;
+	// busnum and devnum
+	u->devid=usbip_get32(p+288)<<16|(usbip_get32(p+292)&0xffff);
+	return 0;
+}
+
+porus_host_t *porus_open_usbip(const char *addr, int port, const char *busid)
+{
+	struct sockaddr_in sa;
+	usbip_host_t *u;
+	int one=1;
+
+	u=calloc(1,sizeof(*u));
+	if (!u) return 0;
+	u->h.be=&usbip_backend;
+	memset(&sa,0,sizeof(sa));
+	sa.sin_family=AF_INET;
+	sa.sin_port=htons(port?port:USBIP_PORT);
+	u->fd=socket(AF_INET,SOCK_STREAM,0);
+	if (u->fd<0) {
+		free(u);
+		return 0;
+	}
+	setsockopt(u->fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+	if (!inet_aton(addr,&sa.sin_addr)||
+		connect(u->fd,(struct sockaddr *)&sa,sizeof(sa))||
+		import(u,busid)||
+		// SET_CONFIGURATION(1), which vhci-hcd leaves to the host's drivers
+		porus_control(&u->h,0,9,1,0,0,0,1000)<0||
+		porus_read_maxpkt(&u->h,1,u->maxpkt)) {
+		ip_close(&u->h);
+		return 0;
+	}
+	return &u->h;
+}
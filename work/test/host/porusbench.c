@@ -0,0 +1,311 @@
+/* test/host/porusbench.c -- PORUS test protocol benchmark */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+/* Runs the PORUS bulk tests through libporus-host, with several requests 
+in flight, and reports MB/s and the time each request took.  Data is 
+checked against the device's CRC by the CRC worker, off the timed path: 
+the clock runs from the first request's submission to the last one's 
+completion, and the device's CRC is read after it stops.  STAT is used 
+to time control round trips, and TMOI to time the device's endpoint 
+timeout.  The exit status is 1 if any test fails. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "porushost.h"
+
+#define MAX_LAT (1<<16)
+
+static porus_host_t *h;
+static unsigned long len=65535, size=16384;
+static int depth=4, reps=20;
+static unsigned long errors;
+static unsigned char *buf;
+
+static double lat[MAX_LAT], secs[1024];
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x=*(const double *)a,y=*(const double *)b;
+
+	return x<y?-1:x>y;
+}
+
+/* prints one line: MB/s over all runs, the slowest and fastest run (or 
+dashes if bytes is 0), and the spread of request times */
+static void report(const char *name, unsigned long bytes, int runs, unsigned long nlat)
+{
+	double sum=0,mb=bytes/1e6;
+	int i;
+
+	if (!runs||!nlat) {
+		printf("%-5s no runs completed\n",name);
+		return;
+	}
+	for (i=0;i<runs;++i)
+		sum+=secs[i];
+	qsort(secs,runs,sizeof(*secs),cmp_double);
+	qsort(lat,nlat,sizeof(*lat),cmp_double);
+	printf("%-5s %8lu %5d ",name,bytes,runs);
+	if (bytes)
+		printf("%8.2f %8.2f %8.2f",mb*runs/sum,mb/secs[runs-1],mb/secs[0]);
+	else
+		printf("%8s %8s %8s","-","-","-");
+	printf(" %9.1f %9.1f %9.1f\n",lat[nlat/2],lat[nlat*99/100],lat[nlat-1]);
+}
+
+static void fail(const char *test, const char *what, int err)
+{
+	if (err)
+		fprintf(stderr,"%s: %s: error %d\n",test,what,err);
+	else
+		fprintf(stderr,"%s: %s\n",test,what);
+	++errors;
+}
+
+static porus_pipe_t pipe_for(porus_crc_t *crc)
+{
+	porus_pipe_t p;
+
+	memset(&p,0,sizeof(p));
+	p.depth=depth;
+	p.size=size;
+	p.timeout=3000;
+	p.crc=crc;
+	p.lat=lat;
+	p.maxlat=MAX_LAT;
+	return p;
+}
+
+static void test_blko(void)
+{
+	porus_pipe_t p=pipe_for(0);
+	unsigned long crc,dcrc,i;
+	porus_crc_t *c;
+	double t;
+	long n;
+	int err,runs=0;
+
+	for (i=0;i<len;++i)
+		buf[i]=rand();
+	for (i=0;i<(unsigned long)reps;++i) {
+		if ((err=porus_blko(h,len))) {
+			fail("blko","BLKO",err);
+			break;
+		}
+		c=porus_crc_start();
+		if (!c) {
+			fail("blko","cannot start the CRC worker",0);
+			break;
+		}
+		p.crc=c;
+		t=porus_now();
+		n=porus_bulk_out(h,0x01,buf,len,1,&p);
+		t=porus_now()-t;
+		crc=porus_crc_end(c);
+		if (n!=(long)len) {
+			fail("blko","sending",n<0?n:0);
+			break;
+		}
+		if ((err=porus_poll_stat(h,1<<PORUS_STAT_BORX|1<<PORUS_STAT_BOCC,3000))!=PORUS_STAT_IDLE) {
+			fail("blko","device not idle after the data: STAT",err);
+			break;
+		}
+		if ((err=porus_rcrc(h,&dcrc))) {
+			fail("blko","RCRC",err);
+			break;
+		}
+		if (crc!=dcrc)
+			fail("blko","CRC mismatch",0);
+		secs[runs++]=t/1e6;
+	}
+	report("blko",len,runs,p.nlat);
+}
+
+static void test_blki(void)
+{
+	porus_pipe_t p=pipe_for(0);
+	unsigned long crc,dcrc,i;
+	porus_crc_t *c;
+	double t;
+	long n;
+	int err,runs=0;
+
+	for (i=0;i<(unsigned long)reps;++i) {
+		if ((err=porus_blki(h,len))) {
+			fail("blki","BLKI",err);
+			break;
+		}
+		// the device makes the data and its CRC first
+		if ((err=porus_poll_stat(h,1<<PORUS_STAT_BICC,3000))!=PORUS_STAT_BITX) {
+			fail("blki","device not sending: STAT",err);
+			break;
+		}
+		c=porus_crc_start();
+		if (!c) {
+			fail("blki","cannot start the CRC worker",0);
+			break;
+		}
+		p.crc=c;
+		t=porus_now();
+		// one byte more, to take in the zero-length packet at the end
+		n=porus_bulk_in(h,0x81,buf,len+1,&p);
+		t=porus_now()-t;
+		crc=porus_crc_end(c);
+		if (n!=(long)len) {
+			if (n<0)
+				fail("blki","receiving",n);
+			else
+				fail("blki","short transfer",0);
+			break;
+		}
+		if ((err=porus_rcrc(h,&dcrc))) {
+			fail("blki","RCRC",err);
+			break;
+		}
+		if (crc!=dcrc)
+			fail("blki","CRC mismatch",0);
+		secs[runs++]=t/1e6;
+	}
+	report("blki",len,runs,p.nlat);
+}
+
+/* control round trips: one STAT each */
+static void test_stat(void)
+{
+	double t;
+	int i,s;
+
+	for (i=0;i<reps;++i) {
+		t=porus_now();
+		s=porus_stat(h);
+		t=porus_now()-t;
+		if (s<0) {
+			fail("stat","STAT",s);
+			break;
+		}
+		lat[i]=t;
+		secs[i]=t/1e6;
+	}
+	report("stat",0,i,i);
+}
+
+/* how long the device takes to time out an IN transfer nobody reads */
+static void test_tmoi(void)
+{
+	double t;
+	int s;
+
+	if ((s=porus_tmoi(h,len,'T'))) {
+		fail("tmoi","TMOI",s);
+		return;
+	}
+	t=porus_now();
+	do {
+		usleep(1000);
+		s=porus_stat(h);
+	} while (s==PORUS_STAT_BITX&&porus_now()-t<30e6);
+	t=porus_now()-t;
+	if (s!=PORUS_STAT_TIMO)
+		fail("tmoi","no timeout: STAT",s);
+	else
+		printf("tmoi  timed out after %.1f ms\n",t/1e3);
+}
+
+int main(int argc, char **argv)
+{
+	static char deftests[]="blko,blki,stat";
+	const char *addr=0,*busid="1-1";
+	char *tests=deftests;
+	unsigned int vid=0xffff,pid=0;
+	int port=0,c;
+	char *p,*t;
+
+	while ((c=getopt(argc,argv,"d:i:b:t:l:s:q:n:"))!=-1)
+		switch (c) {
+		case 'd':
+			if (sscanf(optarg,"%x:%x",&vid,&pid)!=2) goto usage;
+			break;
+		case 'i':
+			addr=optarg;
+			if ((p=strchr(optarg,':'))) {
+				*p=0;
+				port=strtoul(p+1,0,0);
+			}
+			break;
+		case 'b': busid=optarg; break;
+		case 't': tests=optarg; break;
+		case 'l': len=strtoul(optarg,0,0); break;
+		case 's': size=strtoul(optarg,0,0); break;
+		case 'q': depth=strtoul(optarg,0,0); break;
+		case 'n': reps=strtoul(optarg,0,0); break;
+		default:
+		usage:
+			fprintf(stderr,"usage: %s [-d vid:pid | -i address[:port] [-b busid]] [-t tests]\n"
+				"\t[-l bytes] [-s request size] [-q requests in flight] [-n runs]\n"
+				"tests are blko, blki, stat and tmoi, separated by commas; bytes is at most 65535\n",argv[0]);
+			return 2;
+		}
+	if (optind<argc||!len||len>65535||!size||depth<1||depth>PORUS_MAX_DEPTH||
+		reps<1||reps>(int)(sizeof(secs)/sizeof(*secs)))
+		goto usage;
+	h=addr?porus_open_usbip(addr,port,busid):porus_open_usb(vid,pid);
+	if (!h) {
+		if (addr)
+			fprintf(stderr,"cannot import %s from %s\n",busid,addr);
+		else
+			fprintf(stderr,"cannot open %04x:%04x (or built without libusb)\n",vid,pid);
+		return 1;
+	}
+	// room for the length rounded up to a whole request, and a packet more
+	buf=malloc(len+size+1024);
+	if (!buf) return 1;
+	printf("%d requests of %lu bytes in flight; packets of %d bytes\n",depth,size,porus_maxpkt(h,0x81));
+	printf("%-5s %8s %5s %8s %8s %8s %9s %9s %9s\n","test","bytes","runs","MB/s",
+		"min MB/s","max MB/s","p50 us","p99 us","max us");
+	for (t=strtok(tests,",");t;t=strtok(0,",")) {
+		if (!strcmp(t,"blko"))
+			test_blko();
+		else if (!strcmp(t,"blki"))
+			test_blki();
+		else if (!strcmp(t,"stat"))
+			test_stat();
+		else if (!strcmp(t,"tmoi"))
+			test_tmoi();
+		else
+			fail(t,"no such test",0);
+	}
+	porus_close(h);
+	free(buf);
+	if (errors) {
+		printf("%lu errors\n",errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,388 @@
+/* test/host/porushost.c -- pipelines, CRC worker and test requests */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "hostpriv.h"
+
+double porus_now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec*1e6+t.tv_nsec/1e3;
+}
+
+/* ------ Requests */
+
+void porus_req_done(porus_req_t *r)
+{
+	r->t_done=porus_now();
+	r->done=1;
+}
+
+int porus_req_wait(porus_host_t *h, porus_req_t *r)
+{
+	while (!r->done)
+		if (h->be->wait(h)) return PORUS_EIO;
+	return r->status;
+}
+
+int porus_control(porus_host_t *h, int type, int request, int value, int index, unsigned char *data, int len, unsigned int timeout)
+{
+	porus_req_t r;
+	int err;
+
+	if (len<0||len>0xffff||(len&&!data)) return PORUS_EINVAL;
+	memset(&r,0,sizeof(r));
+	r.control=1;
+	r.ep=type&0x80;
+	r.buf=data;
+	r.len=len;
+	r.timeout=timeout;
+	r.setup[0]=type;
+	r.setup[1]=request;
+	r.setup[2]=value;
+	r.setup[3]=value>>8;
+	r.setup[4]=index;
+	r.setup[5]=index>>8;
+	r.setup[6]=len;
+	r.setup[7]=len>>8;
+	r.t_submit=porus_now();
+	err=h->be->submit(h,&r);
+	if (!err) err=porus_req_wait(h,&r);
+	return err?err:(int)r.actual;
+}
+
+int porus_maxpkt(porus_host_t *h, int ep)
+{
+	return h->be->maxpkt(h,ep);
+}
+
+int porus_read_maxpkt(porus_host_t *h, int cnf, unsigned short *maxpkt)
+{
+	unsigned char *d;
+	int len,i,r;
+	unsigned char hdr[9];
+
+	// GET_DESCRIPTOR(configuration), first the header for the length
+	r=porus_control(h,0x80,6,0x200|(cnf-1),0,hdr,9,1000);
+	if (r<0) return r;
+	if (r<9||hdr[1]!=2) return PORUS_EIO;
+	len=hdr[2]|hdr[3]<<8;
+	d=malloc(len);
+	if (!d) return PORUS_ENOMEM;
+	r=porus_control(h,0x80,6,0x200|(cnf-1),0,d,len,1000);
+	if (r>=0) {
+		for (i=0;i+1<r&&d[i]>=2&&i+d[i]<=r;i+=d[i])
+			if (d[i+1]==5&&d[i]>=7)
+				maxpkt[(d[i+2]&15)|(d[i+2]&0x80?16:0)]=(d[i+4]|d[i+5]<<8)&0x7ff;
+		r=0;
+	}
+	free(d);
+	return r;
+}
+
+/* ------ Pipelines */
+
+/* Moves len bytes through a pipeline.  Requests are retired oldest 
+first, whatever order they complete in, so that IN data reaches the CRC 
+worker in order. */
+static long pipe_run(porus_host_t *h, int ep, unsigned char *buf, unsigned long len, int zlp, porus_pipe_t *p)
+{
+	porus_req_t req[PORUS_MAX_DEPTH],*r;
+	unsigned long ofs=0,total=0,size,n;
+	unsigned int head=0,tail=0,i;
+	int in=ep&0x80,mp,err=0,ended=0;
+
+	mp=porus_maxpkt(h,ep);
+	if (mp<=0||p->depth<1||p->depth>PORUS_MAX_DEPTH||!p->size)
+		return PORUS_EINVAL;
+	size=(p->size+mp-1)/mp*mp;
+	for (;;) {
+		// keep the pipeline full
+		while (!ended&&!err&&head-tail<(unsigned int)p->depth&&
+			(ofs<len||(!in&&!head))) {
+			r=req+head%p->depth;
+			memset(r,0,sizeof(*r));
+			n=len-ofs<size?len-ofs:size;
+			if (in) n=(n+mp-1)/mp*mp;
+			r->ep=ep;
+			r->buf=buf+ofs;
+			r->len=n;
+			r->timeout=p->timeout;
+			r->zlp=zlp&&ofs+n>=len;
+			r->t_submit=porus_now();
+			err=h->be->submit(h,r);
+			if (err) break;
+			if (!in&&p->crc) porus_crc_feed(p->crc,r->buf,n);
+			ofs+=n;
+			++head;
+		}
+		if (head==tail) break;
+		// then retire the oldest
+		r=req+tail%p->depth;
+		if (porus_req_wait(h,r)==PORUS_EIO&&!r->done)
+			return PORUS_EIO;
+		++tail;
+		if (ended) continue;
+		if (r->status) {
+			if (!err) err=r->status;
+		} else {
+			total+=r->actual;
+			if (in&&p->crc&&r->actual)
+				porus_crc_feed(p->crc,r->buf,r->actual);
+			if (p->lat&&p->nlat<p->maxlat)
+				p->lat[p->nlat++]=r->t_done-r->t_submit;
+		}
+		if (r->status||(in&&(r->actual<r->len||total>=len))) {
+			// stop at an error or the end of an IN transfer
+			ended=1;
+			for (i=tail;i!=head;++i)
+				h->be->cancel(h,req+i%p->depth);
+		}
+	}
+	return err?err:(long)total;
+}
+
+long porus_bulk_out(porus_host_t *h, int ep, const unsigned char *buf, unsigned long len, int zlp, porus_pipe_t *p)
+{
+	if (ep&0x80) return PORUS_EINVAL;
+	return pipe_run(h,ep,(unsigned char *)buf,len,zlp,p);
+}
+
+long porus_bulk_in(porus_host_t *h, int ep, unsigned char *buf, unsigned long len, porus_pipe_t *p)
+{
+	if (!(ep&0x80)||!len) return PORUS_EINVAL;
+	return pipe_run(h,ep,buf,len,0,p);
+}
+
+/* ------ CRC worker */
+
+static unsigned long crc_table[256];
+static pthread_once_t crc_once=PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+	unsigned long c;
+	int i,k;
+
+	for (i=0;i<256;++i) {
+		for (c=i,k=0;k<8;++k)
+			c=c&1?0xedb88320ul^(c>>1):c>>1;
+		crc_table[i]=c;
+	}
+}
+
+unsigned long porus_crc32(unsigned long crc, const unsigned char *buf, unsigned long len)
+{
+	pthread_once(&crc_once,crc_init);
+	crc=~crc&0xffffffff;
+	while (len--)
+		crc=crc_table[(crc^*buf++)&0xff]^(crc>>8);
+	return ~crc&0xffffffff;
+}
+
+#define CRC_RING 256
+
+struct porus_crc_t {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	// signalled when a piece is queued, taken, or the end is asked for
+	pthread_cond_t cond;
+	struct {
+		const unsigned char *buf;
+		unsigned long len;
+	} ring[CRC_RING];
+	unsigned int head, tail;
+	int end;
+	unsigned long crc;
+};
+
+static void *crc_thread(void *arg)
+{
+	porus_crc_t *c=arg;
+	const unsigned char *buf;
+	unsigned long len;
+
+	pthread_mutex_lock(&c->lock);
+	for (;;) {
+		while (c->head==c->tail&&!c->end)
+			pthread_cond_wait(&c->cond,&c->lock);
+		if (c->head==c->tail) break;
+		buf=c->ring[c->tail%CRC_RING].buf;
+		len=c->ring[c->tail%CRC_RING].len;
+		pthread_mutex_unlock(&c->lock);
+		c->crc=porus_crc32(c->crc,buf,len);
+		pthread_mutex_lock(&c->lock);
+		++c->tail;
+		pthread_cond_broadcast(&c->cond);
+	}
+	pthread_mutex_unlock(&c->lock);
+	return 0;
+}
+
+porus_crc_t *porus_crc_start(void)
+{
+	porus_crc_t *c;
+
+	pthread_once(&crc_once,crc_init);
+	c=calloc(1,sizeof(*c));
+	if (!c) return 0;
+	pthread_mutex_init(&c->lock,0);
+	pthread_cond_init(&c->cond,0);
+	if (pthread_create(&c->thread,0,crc_thread,c)) {
+		pthread_cond_destroy(&c->cond);
+		pthread_mutex_destroy(&c->lock);
+		free(c);
+		return 0;
+	}
+	return c;
+}
+
+void porus_crc_feed(porus_crc_t *c, const unsigned char *buf, unsigned long len)
+{
+	pthread_mutex_lock(&c->lock);
+	while (c->head-c->tail>=CRC_RING)
+		pthread_cond_wait(&c->cond,&c->lock);
+	c->ring[c->head%CRC_RING].buf=buf;
+	c->ring[c->head%CRC_RING].len=len;
+	++c->head;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+}
+
+unsigned long porus_crc_end(porus_crc_t *c)
+{
+	unsigned long crc;
+
+	pthread_mutex_lock(&c->lock);
+	c->end=1;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->thread,0);
+	crc=c->crc;
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+	return crc;
+}
+
+/* ------ Test requests */
+
+#define VENDOR_OUT 0x41 // vendor, interface, host to device
+#define VENDOR_IN 0xc1
+
+int porus_stat(porus_host_t *h)
+{
+	unsigned char c;
+	int r=porus_control(h,VENDOR_IN,PORUS_STAT,0,0,&c,1,1000);
+
+	if (r<0) return r;
+	return r==1?c:PORUS_EIO;
+}
+
+int porus_poll_stat(porus_host_t *h, unsigned int mask, unsigned int timeout)
+{
+	double end=porus_now()+timeout*1e3;
+	int s;
+
+	do {
+		s=porus_stat(h);
+	} while (s>=0&&s<32&&(mask&1u<<s)&&porus_now()<end);
+	return s;
+}
+
+int porus_rcrc(porus_host_t *h, unsigned long *crc)
+{
+	unsigned char d[4];
+	int r=porus_control(h,VENDOR_IN,PORUS_RCRC,0,0,d,4,1000);
+
+	if (r<0) return r;
+	if (r!=4) return PORUS_EIO;
+	*crc=(unsigned long)d[0]<<24|(unsigned long)d[1]<<16|d[2]<<8|d[3];
+	return 0;
+}
+
+/* a vendor request with no data stage */
+static int command(porus_host_t *h, int request, unsigned int value)
+{
+	int r;
+
+	if (value>0xffff) return PORUS_EINVAL;
+	r=porus_control(h,VENDOR_OUT,request,value,0,0,0,1000);
+	return r<0?r:0;
+}
+
+int porus_blki(porus_host_t *h, unsigned int len)
+{
+	return command(h,PORUS_BLKI,len);
+}
+
+int porus_blko(porus_host_t *h, unsigned int len)
+{
+	return command(h,PORUS_BLKO,len);
+}
+
+int porus_tmoi(porus_host_t *h, unsigned int len, int c)
+{
+	unsigned char d=c;
+	int r;
+
+	if (len>0xffff) return PORUS_EINVAL;
+	r=porus_control(h,VENDOR_OUT,PORUS_TMOI,len,0,&d,1,1000);
+	return r<0?r:0;
+}
+
+int porus_wvar(porus_host_t *h, unsigned int var)
+{
+	return command(h,PORUS_WVAR,var);
+}
+
+int porus_rvar(porus_host_t *h)
+{
+	unsigned char d[2];
+	int r=porus_control(h,VENDOR_IN,PORUS_RVAR,0,0,d,2,1000);
+
+	if (r<0) return r;
+	return r==2?d[0]<<8|d[1]:PORUS_EIO;
+}
+
+void porus_close(porus_host_t *h)
+{
+	h->be->close(h);
+}
+
+#ifdef PORUS_HOST_NO_LIBUSB
+porus_host_t *porus_open_usb(unsigned int vid, unsigned int pid)
+{
+	return 0;
+}
+#endif
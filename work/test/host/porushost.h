@@ -0,0 +1,233 @@
+// :wrap=soft:
+
+/* test/host/porushost.h -- host library for the PORUS test protocol */
+
+/* PORUS
+   Portable USB Stack
+
+   (c) 2004-2006 Texas Instruments Inc.
+*/
+
+/* This file is part of PORUS.  You can redistribute and/or modify
+   it under the terms of the Common Public License as published by
+   IBM Corporation; either version 1.0 of the License, or
+   (at your option) any later version.
+
+   PORUS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Common Public License for more details.
+
+   You should have received a copy of the Common Public License
+   along with PORUS.  It may also be available at the following URL:
+   
+      http://www.opensource.org/licenses/cpl1.0.txt
+   
+   If you cannot obtain a copy of the License, please contact the 
+   Data Acquisition Products Applications Department at Texas 
+   Instruments Inc.
+*/
+
+#ifndef GUARD_porushost_h
+#define GUARD_porushost_h
+
+/*! \defgroup host_lib Host library
+
+libporus-host drives a PORUS test device from a PC, as test/porustest.py does, but in C and with several bulk transfers in flight on each endpoint, so that the bus is never left idle between them.  porusbench.c is a command-line client built on it.
+
+\section host_backends Back ends
+
+porus_open_usb() reaches a device through the asynchronous API of libusb-1.0.  porus_open_usbip() imports one over USB/IP instead, as vhci-hcd would, and needs no kernel support or privileges; it is what runs against port/usbip/porus, the test device built as an ordinary process on the same machine.  The rest of the library does not know which back end it is using.
+
+\section host_pipe Pipelines
+
+porus_bulk_out() and porus_bulk_in() cut a transfer into requests of porus_pipe_t#size bytes and keep porus_pipe_t#depth of them submitted at once.  As the oldest completes, the next is submitted, so the host controller always has the next request ready when one ends.  Request sizes are rounded up to whole packets, so that a short packet can only come at the end.  An IN transfer ends at the first short packet: the requests queued behind it are cancelled, and their data, if any, is dropped.
+
+\section host_crc CRC worker
+
+The test protocol checks data by CRC-32 (that of zlib).  A porus_crc_t is a thread which computes it while the transfer runs: a pipeline hands it each request's data as the request is submitted (OUT) or completes (IN), in order.  Checking the data then costs the bus nothing, and only porus_crc_end() waits for whatever is left.
+
+\section host_errors Errors
+
+Functions returning int or long return a negative PORUS_E code on failure.  The library does not print anything.
+*/
+//@{
+
+/*! \name Error codes */
+//@{
+//! Back end or transport failure
+#define PORUS_EIO (-1)
+//! Invalid argument, or no such endpoint
+#define PORUS_EINVAL (-2)
+//! Request timed out
+#define PORUS_ETIMEOUT (-3)
+//! Request stalled
+#define PORUS_ESTALL (-4)
+//! The device sent more data than the request had room for
+#define PORUS_EOVERFLOW (-5)
+//! Request was cancelled
+#define PORUS_ECANCELLED (-6)
+//! Out of memory
+#define PORUS_ENOMEM (-7)
+//@}
+
+/*! \name Test protocol
+
+Vendor requests, sent to interface 0, and the codes STAT returns.  See port/c55x/test/main.c. */
+//@{
+#define PORUS_WVAR 0x01
+#define PORUS_RVAR 0x02
+#define PORUS_BLKI 0x03
+#define PORUS_BLKO 0x04
+#define PORUS_STAT 0x05
+#define PORUS_RCRC 0x06
+#define PORUS_TMOI 0x07
+
+#define PORUS_STAT_IDLE 0
+#define PORUS_STAT_BORX 1
+#define PORUS_STAT_BOCC 2
+#define PORUS_STAT_BICC 3
+#define PORUS_STAT_BITX 4
+#define PORUS_STAT_TIMO 5
+#define PORUS_STAT_EROR 6
+#define PORUS_STAT_STRO 7
+#define PORUS_STAT_STRI 8
+//@}
+
+//! Most requests a pipeline keeps in flight
+#define PORUS_MAX_DEPTH 64
+
+//! Open device
+/*! Opened by porus_open_usb() or porus_open_usbip(), and freed by porus_close(). */
+typedef struct porus_host_t porus_host_t;
+
+//! CRC worker
+typedef struct porus_crc_t porus_crc_t;
+
+//! Pipeline parameters
+/*! Passed to porus_bulk_out() and porus_bulk_in(). */
+typedef struct porus_pipe_t {
+	//! Requests kept in flight, 1 to PORUS_MAX_DEPTH
+	int depth;
+	//! Bytes per request; rounded up to whole packets
+	unsigned long size;
+	//! Timeout of each request in milliseconds, or 0 for none
+	unsigned int timeout;
+	//! CRC worker to feed with the data, or 0
+	porus_crc_t *crc;
+	//! Array for the time each request took, or 0
+	/*! If set, the time from submission to completion of each request, in microseconds, is stored here, up to \c maxlat of them, and \c nlat is advanced.  Set \c nlat to 0 to start. */
+	double *lat;
+	unsigned long maxlat, nlat;
+} porus_pipe_t;
+
+//! Open a device with libusb
+/*! Opens the first device with the given IDs, and claims interface 0.
+
+\return The device, or 0 if there is none, it cannot be opened, or the library was built without libusb
+*/
+porus_host_t *porus_open_usb(unsigned int vid, unsigned int pid);
+
+//! Import a device over USB/IP
+/*! Connects to the USB/IP server at \p addr (dotted quad) and \p port, imports the device \p busid (such as "1-1"), and selects configuration 1, as vhci-hcd would.
+
+\return The device, or 0 if the server cannot be reached or refuses the import
+*/
+porus_host_t *porus_open_usbip(const char *addr, int port, const char *busid);
+
+//! Close a device
+/*! Closes the device and frees \p h.  Nothing may be in flight; the pipelines and porus_control() never return with requests outstanding, unless the back end has failed. */
+void porus_close(porus_host_t *h);
+
+//! Packet size of an endpoint
+/*! \param ep Endpoint address, with bit 7 set for IN
+\return The maximum packet size, or PORUS_EINVAL if there is no such endpoint */
+int porus_maxpkt(porus_host_t *h, int ep);
+
+//! Run a control transfer
+/*! Sends a SETUP with \p type, \p request, \p value, \p index and a length of \p len, then moves the data stage to or from \p data, as bit 7 of \p type says.
+
+\return The length of the data stage, or an error code
+*/
+int porus_control(porus_host_t *h, int type, int request, int value, int index, unsigned char *data, int len, unsigned int timeout);
+
+//! Send a bulk transfer
+/*! Sends the \p len bytes at \p buf to endpoint \p ep, through a pipeline with the parameters in \p p.  If \p zlp is set and \p len is a whole number of packets, a zero-length packet ends the transfer.
+
+\return \p len, or an error code
+*/
+long porus_bulk_out(porus_host_t *h, int ep, const unsigned char *buf, unsigned long len, int zlp, porus_pipe_t *p);
+
+//! Receive a bulk transfer
+/*! Receives from endpoint \p ep (bit 7 set) into \p buf, through a pipeline with the parameters in \p p, until \p len bytes or a short packet have come.  \p buf must have room for \p len rounded up to a whole packet.  To take in the zero-length packet which ends a transfer of whole packets, ask for more than is expected.
+
+\return The number of bytes received, or an error code
+*/
+long porus_bulk_in(porus_host_t *h, int ep, unsigned char *buf, unsigned long len, porus_pipe_t *p);
+
+//! Microsecond clock
+/*! A monotonic clock for timing transfers. */
+double porus_now(void);
+
+/*! \name CRC worker */
+//@{
+
+//! CRC-32 of a buffer
+/*! Continues \p crc (0 to start) over the \p len bytes at \p buf. */
+unsigned long porus_crc32(unsigned long crc, const unsigned char *buf, unsigned long len);
+
+//! Start a CRC worker
+/*! \return The worker, or 0 if the thread cannot be started */
+porus_crc_t *porus_crc_start(void);
+
+//! Queue data for a CRC worker
+/*! The \p len bytes at \p buf are added to the CRC, in order, by the worker thread.  They must not change until porus_crc_end().  Blocks only if a great many pieces are queued already. */
+void porus_crc_feed(porus_crc_t *c, const unsigned char *buf, unsigned long len);
+
+//! Finish a CRC worker
+/*! Waits for the worker to take in everything it has been fed, stops it, and frees \p c.
+
+\return The CRC-32 of the data
+*/
+unsigned long porus_crc_end(porus_crc_t *c);
+
+//@}
+
+/*! \name Test requests
+
+Each returns 0 or an error code, except as noted. */
+//@{
+
+//! STAT: returns the device's status code (PORUS_STAT_*), or an error code
+int porus_stat(porus_host_t *h);
+
+//! Poll STAT while it is one of a set
+/*! Sends STAT until the code it returns is not in \p mask, a set of bits (1<<PORUS_STAT_*), or \p timeout milliseconds have passed.
+
+\return The last code, or an error code
+*/
+int porus_poll_stat(porus_host_t *h, unsigned int mask, unsigned int timeout);
+
+//! RCRC: reads the CRC of the last BLKO or BLKI data into \p crc
+int porus_rcrc(porus_host_t *h, unsigned long *crc);
+
+//! BLKI: has the device send \p len pseudo-random bytes on endpoint 1, ended by a short packet
+int porus_blki(porus_host_t *h, unsigned int len);
+
+//! BLKO: has the device take \p len bytes on endpoint 1, ended by a short packet
+int porus_blko(porus_host_t *h, unsigned int len);
+
+//! TMOI: has the device offer \p len bytes of \p c on endpoint 1, which are not meant to be read, so that the endpoint times out
+int porus_tmoi(porus_host_t *h, unsigned int len, int c);
+
+//! WVAR: writes the device variable
+int porus_wvar(porus_host_t *h, unsigned int var);
+
+//! RVAR: returns the device variable, or an error code
+int porus_rvar(porus_host_t *h);
+
+//@}
+
+//@}
+
+#endif
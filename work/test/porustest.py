@@ -4,6 +4,7 @@ import cmd, shlex
 import sys
 import zlib,binascii,struct
 import random,time
+import os,math,optparse
 
 endpointTypeNames={
     usb.ENDPOINT_TYPE_BULK:'Bulk',
@@ -17,7 +18,11 @@ porusLongStatCodes={
     1:'Receiving Bulk OUT data',
     2:'Calculating Bulk OUT CRC',
     3:'Generating Bulk IN test data / calculating CRC',
-    4:'Transmitting Bulk In test data'
+    4:'Transmitting Bulk In test data',
+    5:'Timed out',
+    6:'Error',
+    7:'Streaming Bulk OUT data',
+    8:'Streaming Bulk IN data'
 }
 
 porusShortStatCodes={
@@ -27,7 +32,9 @@ porusShortStatCodes={
     3:'BICC',
     4:'BITX',
     5:'TIMO',
-    6:'EROR'
+    6:'EROR',
+    7:'STRO',
+    8:'STRI'
 }
 
 indentLevel=0
@@ -49,7 +56,7 @@ def tupleToStr(t):
     return s
 
 def toUns32(i):
-    return struct.unpack('!L',struct.pack('!L',i))[0]
+    return long(i)&0xffffffffL
     
 def uhex32(n):
     return binascii.hexlify(struct.pack('!L',n))
@@ -91,6 +98,310 @@ def porusBLKI(devh,length):
 def porusTMOI(devh,length,c):
     devh.controlMsg(0x41,7,[c],length)
 
+def porusSTRO(devh,on):
+    devh.controlMsg(0x41,9,[],on)
+
+def porusSTRI(devh,blocks):
+    devh.controlMsg(0x41,11,[],blocks)
+
+def porusCTLO(devh,buf):
+    devh.controlMsg(0x41,12,buf)
+
+def porusCTLI(devh,length):
+    return toUns(devh.controlMsg(0xC1,13,length))
+
+def porusRSTR(devh,which=0):
+    buf=toUns(devh.controlMsg(0xC1, 10, 10, which))
+    blocks=buf[0]<<24|buf[1]<<16|buf[2]<<8|buf[3]
+    maxlevel=buf[4]<<24|buf[5]<<16|buf[6]<<8|buf[7]
+    full=buf[8]<<8|buf[9]
+    return (blocks,maxlevel,full)
+
+# Benchmark support.  Test data and the host's CRCs are prepared before 
+# the clock starts, and results are checked after it stops, so that only 
+# the transfers themselves are timed.
+
+if sys.platform=='win32':
+    timer=time.clock
+else:
+    timer=time.time
+
+benchTimeout=3000
+
+benchTests=['blko','blki','stro','stri','ctlo','ctli']
+
+benchFields=['label','test','size','packet','reps','errors',
+    'mbps_min','mbps_p50','mbps_max','mbps_mean',
+    'us_p50','us_p90','us_p99','us_max','us_hist',
+    'maxlevel','stalls']
+
+def percentile(s,p):
+    """Returns the p'th percentile of the sorted list s, by the 
+    nearest-rank method"""
+    if not s: return 0
+    i=int(math.ceil(p*len(s)/100.0))-1
+    return s[max(i,0)]
+
+def histogram(s):
+    """Returns a histogram of the microsecond times in s, as a sorted 
+    list of (lower bound,count) pairs.  The buckets are powers of two: 
+    the bucket with lower bound b holds times from b up to 2b, and the 
+    first bucket also holds anything below 1 us."""
+    h={}
+    for v in s:
+	b=1
+	while v>=b*2: b*=2
+	h[b]=h.get(b,0)+1
+    k=h.keys()
+    k.sort()
+    return [(b,h[b]) for b in k]
+
+def benchWrite(devh,mps,buf,chunk,short):
+    """Writes buf to endpoint 1, chunk bytes at a time.  If short is 
+    set and buf is a whole number of packets, a zero-length packet 
+    ends the transfer."""
+    for i in range(0,len(buf),chunk):
+	devh.bulkWrite(1,buf[i:i+chunk],benchTimeout)
+    if short and len(buf)%mps==0:
+	devh.bulkWrite(1,'',benchTimeout)
+
+def benchRead(devh,mps,chunk):
+    """Reads from endpoint 0x81, chunk bytes at a time, until a short 
+    packet.  Returns the tuples read, unconverted."""
+    bufs=[]
+    while 1:
+	tbuf=devh.bulkRead(0x81,chunk,benchTimeout)
+	bufs.append(tbuf)
+	if len(tbuf)<chunk or len(tbuf)%mps:
+	    break
+    return bufs
+
+# Each benchmark runs one transfer of n bytes, and returns a tuple of the 
+# seconds it took, whether the data checked out, and the device's stream 
+# statistics (maxlevel,full), which are 0 for the tests that have none.
+
+def benchBLKO(devh,mps,n,chunk):
+    buf=os.urandom(n)
+    crc=toUns32(zlib.crc32(buf))
+    porusBLKO(devh,n)
+    t=timer()
+    benchWrite(devh,mps,buf,chunk,1)
+    t=timer()-t
+    while porusSTAT(devh): pass
+    return (t,long(crc)==porusRCRC(devh),0,0)
+
+def benchBLKI(devh,mps,n,chunk):
+    porusBLKI(devh,n)
+    while porusSTAT(devh)==3: pass
+    t=timer()
+    bufs=benchRead(devh,mps,chunk)
+    t=timer()-t
+    buf=''.join(map(tupleToStr,bufs))
+    crc=toUns32(zlib.crc32(buf))
+    return (t,len(buf)==n and long(crc)==porusRCRC(devh),0,0)
+
+def benchSTRO(devh,mps,n,chunk):
+    blocks=n/512
+    buf=os.urandom(n)
+    crc=toUns32(zlib.crc32(buf))
+    porusSTRO(devh,1)
+    while porusSTAT(devh)!=7: pass
+    t=timer()
+    benchWrite(devh,mps,buf,chunk,0)
+    t=timer()-t
+    while porusRSTR(devh)[0]<blocks: pass
+    porusSTRO(devh,0)
+    ok=long(crc)==porusRCRC(devh)
+    (blocks,maxlevel,full)=porusRSTR(devh)
+    return (t,ok,maxlevel,full)
+
+def benchSTRI(devh,mps,n,chunk):
+    porusSTRI(devh,n/512)
+    t=timer()
+    bufs=benchRead(devh,mps,chunk)
+    t=timer()-t
+    buf=''.join(map(tupleToStr,bufs))
+    crc=toUns32(zlib.crc32(buf))
+    ok=len(buf)==n and long(crc)==porusRCRC(devh)
+    (blocks,maxlevel,full)=porusRSTR(devh,1)
+    return (t,ok,maxlevel,full)
+
+def benchCTLO(devh,mps,n,chunk):
+    buf=os.urandom(n)
+    crc=toUns32(zlib.crc32(buf))
+    t=timer()
+    porusCTLO(devh,buf)
+    t=timer()-t
+    return (t,long(crc)==porusRCRC(devh),0,0)
+
+def benchCTLI(devh,mps,n,chunk):
+    t=timer()
+    buf=devh.controlMsg(0xC1,13,n)
+    t=timer()-t
+    return (t,toUns(buf)==[i&0xff for i in range(n)],0,0)
+
+benchFuncs={
+    'blko':benchBLKO,
+    'blki':benchBLKI,
+    'stro':benchSTRO,
+    'stri':benchSTRI,
+    'ctlo':benchCTLO,
+    'ctli':benchCTLI
+}
+
+def benchFits(test,n):
+    """Returns true if test can move n bytes.  BLKO and BLKI lengths, and 
+    STRO and STRI block counts, are passed in wValue, and the stream 
+    tests move whole 512-byte blocks."""
+    if test in ('blko','blki','ctlo','ctli'):
+	return n<65536
+    return n%512==0 and n>0 and n/512<65536
+
+def benchPoint(devh,mps,opts,test,n,packet):
+    """Runs one point of the sweep, and returns its row"""
+    f=benchFuncs[test]
+    times=[]
+    errors=0
+    maxlevel=0
+    stalls=0
+    for i in range(opts.reps):
+	(t,ok,level,full)=f(devh,mps,n,packet)
+	times.append(t)
+	if not ok: errors+=1
+	maxlevel=max(maxlevel,level)
+	stalls+=full
+    us=[t*1e6 for t in times]
+    us.sort()
+    mbps=[n/t/1e6 for t in times if t>0]
+    mbps.sort()
+    total=sum(times)
+    if total>0:
+	mean=n*len(times)/total/1e6
+    else:
+	mean=0
+    return {'label':opts.label,'test':test,'size':n,'packet':packet,
+	'reps':opts.reps,'errors':errors,
+	'mbps_min':percentile(mbps,0),'mbps_p50':percentile(mbps,50),
+	'mbps_max':percentile(mbps,100),'mbps_mean':mean,
+	'us_p50':percentile(us,50),'us_p90':percentile(us,90),
+	'us_p99':percentile(us,99),'us_max':percentile(us,100),
+	'us_hist':histogram(us),
+	'maxlevel':maxlevel,'stalls':stalls}
+
+def runBench(devh,mps,opts):
+    """Runs the sweep given by opts, and returns a list of rows.  Bulk 
+    tests run for every size and packet; control tests run for every 
+    control size."""
+    rows=[]
+    for test in opts.tests:
+	if test in ('ctlo','ctli'):
+	    sizes=opts.ctlsizes
+	    packets=[0]
+	else:
+	    sizes=opts.sizes
+	    # round requests up to a whole number of packets
+	    packets=[(p+mps-1)/mps*mps for p in opts.packets]
+	for n in sizes:
+	    if not benchFits(test,n):
+		print >>sys.stderr, "%s: skipping %d bytes"%(test,n)
+		continue
+	    for p in packets:
+		if p:
+		    print >>sys.stderr, "%s %d bytes, %d byte requests .."%(test,n,p)
+		else:
+		    print >>sys.stderr, "%s %d bytes .."%(test,n)
+		rows.append(benchPoint(devh,mps,opts,test,n,p))
+    return rows
+
+def benchHistStr(h):
+    return ' '.join(['%d:%d'%(b,c) for (b,c) in h])
+
+def writeBench(rows,opts):
+    """Writes rows to opts.output in opts.format"""
+    if opts.output is None:
+	f=sys.stdout
+    else:
+	f=open(opts.output,'w')
+    if opts.format=='json':
+	import json
+	json.dump(rows,f,indent=1,sort_keys=True)
+	f.write('\n')
+    elif opts.format=='csv':
+	import csv
+	w=csv.writer(f)
+	w.writerow(benchFields)
+	for r in rows:
+	    r=r.copy()
+	    r['us_hist']=benchHistStr(r['us_hist'])
+	    w.writerow([r[k] for k in benchFields])
+    else:
+	print >>f, "%-5s %6s %6s %5s %4s %8s %8s %8s %9s %9s %9s %4s %5s"%('test',
+	    'size','packet','reps','errs','MB/s min','MB/s p50','MB/s max',
+	    'us p50','us p90','us p99','lvl','full')
+	for r in rows:
+	    print >>f, "%-5s %6d %6d %5d %4d %8.3f %8.3f %8.3f %9.1f %9.1f %9.1f %4d %5d"%(r['test'],
+		r['size'],r['packet'],r['reps'],r['errors'],
+		r['mbps_min'],r['mbps_p50'],r['mbps_max'],
+		r['us_p50'],r['us_p90'],r['us_p99'],r['maxlevel'],r['stalls'])
+	    print >>f, "      us histogram: "+benchHistStr(r['us_hist'])
+    if f is not sys.stdout:
+	f.close()
+
+def intList(option,opt,value,parser):
+    try:
+	setattr(parser.values,option.dest,[int(s,0) for s in value.split(',')])
+    except ValueError:
+	raise optparse.OptionValueError("%s needs a comma-separated list of integers"%opt)
+
+def benchParser():
+    p=optparse.OptionParser(usage="%prog bench [options]",
+	description="Runs a sweep of PORUS test device benchmarks and "
+	"writes one row of results for each point.  Throughput is in MB/s "
+	"(10^6 bytes per second) and times are in microseconds; only the "
+	"data phase of each transfer is timed.")
+    p.add_option('-d','--dev',type='int',help="device number, as "
+	"listed by ls (default: the first PORUS test device)")
+    p.add_option('-t','--tests',default=benchTests,action='callback',
+	type='string',callback=lambda o,s,v,p: setattr(p.values,o.dest,v.split(',')),
+	help="comma-separated tests to run (default: all of %s)"%','.join(benchTests))
+    p.add_option('-s','--sizes',default=[512,4096,32768,65024],
+	action='callback',type='string',callback=intList,
+	help="comma-separated bulk transfer sizes in bytes (default "
+	"512,4096,32768,65024)")
+    p.add_option('-p','--packets',default=[64,512,4096,16384],
+	action='callback',type='string',callback=intList,
+	help="comma-separated host request sizes in bytes, rounded up to "
+	"whole packets (default 64,512,4096,16384)")
+    p.add_option('-c','--ctl-sizes',dest='ctlsizes',default=[1,8,64,256],
+	action='callback',type='string',callback=intList,
+	help="comma-separated control transfer sizes in bytes (default "
+	"1,8,64,256)")
+    p.add_option('-n','--reps',type='int',default=20,
+	help="transfers timed at each point (default 20)")
+    p.add_option('-l','--label',default='',
+	help="label for every row, such as the firmware build")
+    p.add_option('-f','--format',choices=['text','csv','json'],
+	default='text',help="text, csv or json (default text)")
+    p.add_option('-o','--output',help="write to this file instead of "
+	"standard output")
+    return p
+
+def benchCheck(opts):
+    """Checks options that optparse cannot.  Prints a message and returns 
+    false if they are unusable."""
+    for t in opts.tests:
+	if not benchFuncs.has_key(t):
+	    print "Unknown test %s"%t
+	    return 0
+    for n in opts.packets:
+	if n<1:
+	    print "Request sizes must be positive"
+	    return 0
+    if opts.reps<1:
+	print "Need at least one repetition"
+	return 0
+    return 1
+
 def getDeviceClassName(devcls):
     names={0:'interface',
     	9:'hub',
@@ -302,6 +613,41 @@ Performs the PORUS BLKI test with <len> bytes.  Prints status messages."""
 	
 Performs the PORUS BLKO test with <len> bytes.  Prints status messages."""
 
+    def help_ctlo(self):
+	print """ctlo <len>
+
+Performs the PORUS CTLO test: sends <len> random bytes in one control 
+write, which the device takes a control write buffer at a time, then 
+compares CRCs."""
+
+    def help_ctli(self):
+	print """ctli <len>
+
+Performs the PORUS CTLI test: reads <len> bytes in one control read, 
+which the device generates a packet at a time, and checks that byte n 
+is n modulo 256."""
+
+    def help_stro(self):
+	print """stro <blocks>
+
+Performs the PORUS STRO test: streams <blocks> 512-byte blocks to 
+endpoint 1 without stopping, then compares CRCs and prints the 
+device's streaming statistics."""
+
+    def help_stri(self):
+	print """stri <blocks>
+
+Performs the PORUS STRI test: the device streams <blocks> 512-byte 
+blocks from endpoint 1 as one transfer, ended by a zero-length packet.  
+Compares CRCs and prints the device's streaming statistics."""
+
+    def help_bench(self):
+	print """bench [options]
+
+Runs a sweep of benchmarks on the open device and prints the results.  
+Takes the same options as 'porustest.py bench', except -d; use 
+'bench --help' to list them."""
+
     def help_quit(self):
 	print """q, quit
 
@@ -439,6 +785,61 @@ Performs RVAR on a PORUS test device.  Prints the result in hex."""
 	    print "Error:", sys.exc_info()[1]
 	return 0
 
+    def do_ctlo(self,args):
+	if self.devh is None:
+	    print "No device is open"
+	    return 0
+	args=shlex.split(args)
+	if len(args)<1:
+	    print "Need a number of bytes"
+	    return 0
+	try:
+	    bc=int(args[0])
+	except ValueError:
+	    print "Number of bytes must be an integer"
+	    return 0
+	try:
+	    rndbuf=rndstring(bc)
+	    crc=toUns32(zlib.crc32(rndbuf))
+	    print "CRC is %s"%uhex32(crc)
+	    print "Sending CTLO .."
+	    porusCTLO(self.devh,rndbuf)
+	    pcrc=porusRCRC(self.devh)
+	    print "Peripheral CRC is %s"%uhex32(pcrc)
+	    if long(crc)==pcrc:
+		print "Match -- test OK!"
+	    else:
+		print "oops."
+	except:
+	    print "Error:", sys.exc_info()[1]
+	return 0
+
+    def do_ctli(self,args):
+	if self.devh is None:
+	    print "No device is open"
+	    return 0
+	args=shlex.split(args)
+	if len(args)<1:
+	    print "Need a number of bytes"
+	    return 0
+	try:
+	    bc=int(args[0])
+	except ValueError:
+	    print "Number of bytes must be an integer"
+	    return 0
+	try:
+	    print "Sending CTLI .."
+	    buf=porusCTLI(self.devh,bc)
+	    if len(buf)!=bc:
+		print "oops. Got %d bytes"%len(buf)
+	    elif buf!=[i&0xff for i in range(bc)]:
+		print "oops. Data does not match"
+	    else:
+		print "Match -- test OK!"
+	except:
+	    print "Error:", sys.exc_info()[1]
+	return 0
+
     def do_blki(self,args):
 	if self.devh is None:
 	    print "No device is open"
@@ -506,6 +907,108 @@ Performs RVAR on a PORUS test device.  Prints the result in hex."""
 	    print "Error:", sys.exc_info()[1]
 	return 0
 
+    def do_stro(self,args):
+	if self.devh is None:
+	    print "No device is open"
+	    return 0
+	args=shlex.split(args)
+	if len(args)<1:
+	    print "Need a number of blocks"
+	    return 0
+	try:
+	    n=int(args[0])
+	except ValueError:
+	    print "Number of blocks must be an integer"
+	    return 0
+	try:
+	    print "Sending STRO .."
+	    porusSTRO(self.devh,1)
+	    while porusSTAT(self.devh)!=7: pass
+	    print "Generating %d random blocks .."%n
+	    rndbuf=rndstring(n*512)
+	    crc=toUns32(zlib.crc32(rndbuf))
+	    print "CRC is %s"%uhex32(crc)
+	    print "Streaming .."
+	    t=time.time()
+	    ep=self.getEP(1)
+	    for i in range(n):
+		self.devh.bulkWrite(ep.address,rndbuf[i*512:(i+1)*512],3000)
+	    t=time.time()-t
+	    print "Sent %d bytes in %f seconds (%f kB/s)"%(len(rndbuf),t,len(rndbuf)/t/1024)
+	    while porusRSTR(self.devh)[0]<n: pass
+	    porusSTRO(self.devh,0)
+	    pcrc=porusRCRC(self.devh)
+	    print "Peripheral CRC is %s"%uhex32(pcrc)
+	    (blocks,maxlevel,full)=porusRSTR(self.devh)
+	    print "%d blocks, at most %d waiting, %d times full"%(blocks,maxlevel,full)
+	    if long(crc)==pcrc:
+		print "Match -- test OK!"
+	    else:
+		print "oops."
+	except:
+	    print "Error:", sys.exc_info()[1]
+	return 0
+
+    def do_stri(self,args):
+	if self.devh is None:
+	    print "No device is open"
+	    return 0
+	args=shlex.split(args)
+	if len(args)<1:
+	    print "Need a number of blocks"
+	    return 0
+	try:
+	    n=int(args[0])
+	except ValueError:
+	    print "Number of blocks must be an integer"
+	    return 0
+	try:
+	    print "Sending STRI .."
+	    porusSTRI(self.devh,n)
+	    ep=self.getEP(1)
+	    buf=''
+	    t=time.time()
+	    while 1:
+		tbuf=tupleToStr(self.devh.bulkRead(0x81,4096,3000))
+		buf+=tbuf
+		if len(tbuf)%ep.maxPacketSize or not len(tbuf):
+		    break
+	    t=time.time()-t
+	    print "Received %d bytes in %f seconds (%f kB/s)"%(len(buf),t,len(buf)/t/1024)
+	    crc=toUns32(zlib.crc32(buf))
+	    print "CRC is %s"%uhex32(crc)
+	    pcrc=porusRCRC(self.devh)
+	    print "Peripheral CRC is %s"%uhex32(pcrc)
+	    (blocks,maxlevel,full)=porusRSTR(self.devh,1)
+	    print "%d blocks, at most %d waiting, %d underruns"%(blocks,maxlevel,full)
+	    if long(crc)==pcrc and len(buf)==n*512:
+		print "Match -- test OK!"
+	    else:
+		print "oops."
+	except:
+	    print "Error:", sys.exc_info()[1]
+	return 0
+
+    def do_bench(self,args):
+	if self.devh is None:
+	    print "No device is open"
+	    return 0
+	try:
+	    (opts,rest)=benchParser().parse_args(shlex.split(args))
+	except SystemExit:
+	    return 0
+	if not benchCheck(opts):
+	    return 0
+	ep=self.getEP(1)
+	if ep is None:
+	    print "Device has no endpoint 1"
+	    return 0
+	try:
+	    writeBench(runBench(self.devh,ep.maxPacketSize,opts),opts)
+	except:
+	    print "Error:", sys.exc_info()[1]
+	return 0
+
     def do_ls(self,args):
 	if self.devh is None:
 	    self.devs=getdevs()
@@ -578,7 +1081,46 @@ Performs RVAR on a PORUS test device.  Prints the result in hex."""
 	    self.do_close('')
 	return 1
 
+def findPorus(devs):
+    """Returns the number of the first PORUS test device in devs, or 
+    None if there is none"""
+    for i in range(len(devs)):
+	d=devs[i][1]
+	if d.idVendor==0xffff and d.idProduct==0:
+	    return i
+    return None
+
+def benchMain(argv):
+    """Runs 'porustest.py bench'.  Returns the exit status: 0 if every 
+    transfer checked out, 1 otherwise."""
+    (opts,args)=benchParser().parse_args(argv)
+    if not benchCheck(opts):
+	return 1
+    s=usbsh("USB Shell")
+    s.devs=getdevs()
+    if opts.dev is None:
+	opts.dev=findPorus(s.devs)
+	if opts.dev is None:
+	    print >>sys.stderr, "No PORUS test device found"
+	    return 1
+    if opts.dev<0 or opts.dev>=len(s.devs):
+	print >>sys.stderr, "Device number is out of range"
+	return 1
+    s.do_open(str(opts.dev))
+    ep=s.getEP(1)
+    if ep is None:
+	print >>sys.stderr, "Device has no endpoint 1"
+	return 1
+    rows=runBench(s.devh,ep.maxPacketSize,opts)
+    s.do_close('')
+    writeBench(rows,opts)
+    for r in rows:
+	if r['errors']: return 1
+    return 0
+
 if __name__=='__main__':
+    if len(sys.argv)>1 and sys.argv[1]=='bench':
+	sys.exit(benchMain(sys.argv[2:]))
     s=usbsh("USB Shell")
     s.prompt="usb> "
     s.cmdloop()